@@ -0,0 +1,400 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * REQUEST-STATS extension: lets clients read the request statistics
+ * collected by Dispatch (see dix/reqstats.c).
+ *
+ * Requests:
+ *   0 QueryVersion  major, minor -> major, minor
+ *   1 GetRequests   -> LISTofREQUESTSTATS, one per request type seen
+ *   2 GetClients    -> LISTofCLIENTSTATS, one per running client
+ *   3 Reset         clears all statistics, no reply
+ *   4 GetSchedule   -> LISTofSCHEDSTATS, one per running client (1.1)
+ *
+ * 64 bit counters are sent as hi, lo pairs of CARD32.  Times are in
+ * microseconds, p50 and p99 are upper bounds of the percentiles.
+ * GetClients and GetSchedule need server GetAttr access, and Reset
+ * needs Manage access.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "extnsionst.h"
+#include "swaprep.h"
+#include "extinit.h"
+#include "xace.h"
+#include "reqstats.h"
+
+#define REQSTATS_NAME			"REQUEST-STATS"
+#define REQSTATS_MAJOR_VERSION		1
+#define REQSTATS_MINOR_VERSION		1
+
+#define X_ReqStatsQueryVersion		0
+#define X_ReqStatsGetRequests		1
+#define X_ReqStatsGetClients		2
+#define X_ReqStatsReset			3
+#define X_ReqStatsGetSchedule		4
+
+typedef struct {
+    CARD8 reqType;
+    CARD8 reqStatsReqType;
+    CARD16 length;
+    CARD16 majorVersion;
+    CARD16 minorVersion;
+} xReqStatsQueryVersionReq;
+
+typedef struct {
+    CARD8 reqType;
+    CARD8 reqStatsReqType;
+    CARD16 length;
+} xReqStatsReq;
+
+typedef struct {
+    BYTE type;
+    CARD8 pad0;
+    CARD16 sequenceNumber;
+    CARD32 length;
+    CARD16 majorVersion;
+    CARD16 minorVersion;
+    CARD32 pad1;
+    CARD32 pad2;
+    CARD32 pad3;
+    CARD32 pad4;
+    CARD32 pad5;
+} xReqStatsQueryVersionReply;
+
+typedef struct {
+    BYTE type;
+    CARD8 pad0;
+    CARD16 sequenceNumber;
+    CARD32 length;
+    CARD32 num;
+    CARD32 pad1;
+    CARD32 pad2;
+    CARD32 pad3;
+    CARD32 pad4;
+    CARD32 pad5;
+} xReqStatsListReply;
+
+typedef struct {
+    CARD32 count_hi;
+    CARD32 count_lo;
+    CARD32 time_hi;
+    CARD32 time_lo;
+    CARD32 p50;
+    CARD32 p99;
+    CARD32 bytes_in_hi;
+    CARD32 bytes_in_lo;
+    CARD32 bytes_out_hi;
+    CARD32 bytes_out_lo;
+} xReqStatsCounters;
+
+typedef struct {
+    CARD8 major;
+    CARD8 pad;
+    CARD16 minor;
+    xReqStatsCounters stats;
+} xReqStatsRequest;
+
+typedef struct {
+    CARD32 resource_base;
+    xReqStatsCounters stats;
+} xReqStatsClient;
+
+typedef struct {
+    CARD32 resource_base;
+    CARD32 turns_hi;
+    CARD32 turns_lo;
+    CARD32 boosted_hi;
+    CARD32 boosted_lo;
+    CARD32 wait_hi;
+    CARD32 wait_lo;
+    CARD32 p50;
+    CARD32 p99;
+    CARD32 max;
+} xReqStatsSchedule;
+
+static void
+ReqStatsFillCounters(ClientPtr client, xReqStatsCounters *out,
+                     ReqStatsPtr stats)
+{
+    *out = (xReqStatsCounters) {
+        .count_hi = stats->count >> 32,
+        .count_lo = stats->count,
+        .time_hi = stats->time >> 32,
+        .time_lo = stats->time,
+        .p50 = ReqStatsPercentile(stats, 50),
+        .p99 = ReqStatsPercentile(stats, 99),
+        .bytes_in_hi = stats->bytesIn >> 32,
+        .bytes_in_lo = stats->bytesIn,
+        .bytes_out_hi = stats->bytesOut >> 32,
+        .bytes_out_lo = stats->bytesOut
+    };
+
+    if (client->swapped)
+        SwapLongs((CARD32 *) out, sizeof(*out) / 4);
+}
+
+static void
+ReqStatsWriteListReply(ClientPtr client, int num, int size, void *data)
+{
+    xReqStatsListReply rep = {
+        .type = X_Reply,
+        .sequenceNumber = client->sequence,
+        .length = bytes_to_int32(num * size),
+        .num = num
+    };
+
+    if (client->swapped) {
+        swaps(&rep.sequenceNumber);
+        swapl(&rep.length);
+        swapl(&rep.num);
+    }
+    WriteToClient(client, sizeof(rep), &rep);
+    WriteToClient(client, num * size, data);
+}
+
+static int
+ProcReqStatsQueryVersion(ClientPtr client)
+{
+    xReqStatsQueryVersionReply rep = {
+        .type = X_Reply,
+        .sequenceNumber = client->sequence,
+        .length = 0,
+        .majorVersion = REQSTATS_MAJOR_VERSION,
+        .minorVersion = REQSTATS_MINOR_VERSION
+    };
+
+    REQUEST_SIZE_MATCH(xReqStatsQueryVersionReq);
+
+    if (client->swapped) {
+        swaps(&rep.sequenceNumber);
+        swaps(&rep.majorVersion);
+        swaps(&rep.minorVersion);
+    }
+    WriteToClient(client, sizeof(rep), &rep);
+    return Success;
+}
+
+static int
+ProcReqStatsGetRequests(ClientPtr client)
+{
+    xReqStatsRequest *list;
+    int major, minor, num = 0, max = EXTENSION_BASE;
+
+    REQUEST_SIZE_MATCH(xReqStatsReq);
+
+    for (major = EXTENSION_BASE; major < EXTENSION_BASE + MAXEXTENSIONS;
+         major++) {
+        if (ReqStatsLookup(major, 0))
+            max += REQSTATS_MAX_MINOR + 1;
+    }
+
+    list = xallocarray(max, sizeof(xReqStatsRequest));
+    if (!list)
+        return BadAlloc;
+
+    for (major = 0; major < EXTENSION_BASE + MAXEXTENSIONS; major++) {
+        for (minor = 0; minor <= REQSTATS_MAX_MINOR; minor++) {
+            ReqStatsPtr stats = ReqStatsLookup(major, minor);
+
+            if (!stats)
+                break;
+            if (stats->count) {
+                xReqStatsRequest *entry = &list[num++];
+
+                entry->major = major;
+                entry->pad = 0;
+                entry->minor = major < EXTENSION_BASE ? 0 : minor;
+                if (client->swapped)
+                    swaps(&entry->minor);
+                ReqStatsFillCounters(client, &entry->stats, stats);
+            }
+            /* Core requests have no minor opcode */
+            if (major < EXTENSION_BASE)
+                break;
+        }
+    }
+
+    ReqStatsWriteListReply(client, num, sizeof(xReqStatsRequest), list);
+    free(list);
+    return Success;
+}
+
+static int
+ProcReqStatsGetClients(ClientPtr client)
+{
+    xReqStatsClient *list;
+    int i, num = 0, rc;
+
+    REQUEST_SIZE_MATCH(xReqStatsReq);
+
+    /* Lists all clients, so it is up to the security policy */
+    rc = XaceHook(XACE_SERVER_ACCESS, client, DixGetAttrAccess);
+    if (rc != Success)
+        return rc;
+
+    list = xallocarray(currentMaxClients, sizeof(xReqStatsClient));
+    if (!list)
+        return BadAlloc;
+
+    for (i = 0; i < currentMaxClients; i++) {
+        xReqStatsClient *entry;
+
+        if (!clients[i] || clients[i]->clientState != ClientStateRunning)
+            continue;
+
+        entry = &list[num++];
+        entry->resource_base = clients[i]->clientAsMask;
+        if (client->swapped)
+            swapl(&entry->resource_base);
+        ReqStatsFillCounters(client, &entry->stats,
+                             ReqStatsClient(clients[i]));
+    }
+
+    ReqStatsWriteListReply(client, num, sizeof(xReqStatsClient), list);
+    free(list);
+    return Success;
+}
+
+static int
+ProcReqStatsGetSchedule(ClientPtr client)
+{
+    xReqStatsSchedule *list;
+    int i, num = 0, rc;
+
+    REQUEST_SIZE_MATCH(xReqStatsReq);
+
+    rc = XaceHook(XACE_SERVER_ACCESS, client, DixGetAttrAccess);
+    if (rc != Success)
+        return rc;
+
+    list = xallocarray(currentMaxClients, sizeof(xReqStatsSchedule));
+    if (!list)
+        return BadAlloc;
+
+    for (i = 0; i < currentMaxClients; i++) {
+        SchedStatsPtr stats;
+
+        if (!clients[i] || clients[i]->clientState != ClientStateRunning)
+            continue;
+
+        stats = ReqStatsClientSchedule(clients[i]);
+        list[num] = (xReqStatsSchedule) {
+            .resource_base = clients[i]->clientAsMask,
+            .turns_hi = stats->turns >> 32,
+            .turns_lo = stats->turns,
+            .boosted_hi = stats->boosted >> 32,
+            .boosted_lo = stats->boosted,
+            .wait_hi = stats->wait >> 32,
+            .wait_lo = stats->wait,
+            .p50 = ReqStatsHistogramPercentile(stats->histogram, 50),
+            .p99 = ReqStatsHistogramPercentile(stats->histogram, 99),
+            .max = min(stats->maxWait, 0xffffffff)
+        };
+        if (client->swapped)
+            SwapLongs((CARD32 *) &list[num], sizeof(*list) / 4);
+        num++;
+    }
+
+    ReqStatsWriteListReply(client, num, sizeof(xReqStatsSchedule), list);
+    free(list);
+    return Success;
+}
+
+static int
+ProcReqStatsReset(ClientPtr client)
+{
+    int rc;
+
+    REQUEST_SIZE_MATCH(xReqStatsReq);
+
+    rc = XaceHook(XACE_SERVER_ACCESS, client, DixManageAccess);
+    if (rc != Success)
+        return rc;
+
+    ReqStatsReset();
+    return Success;
+}
+
+static int
+ProcReqStatsDispatch(ClientPtr client)
+{
+    REQUEST(xReq);
+    switch (stuff->data) {
+    case X_ReqStatsQueryVersion:
+        return ProcReqStatsQueryVersion(client);
+    case X_ReqStatsGetRequests:
+        return ProcReqStatsGetRequests(client);
+    case X_ReqStatsGetClients:
+        return ProcReqStatsGetClients(client);
+    case X_ReqStatsReset:
+        return ProcReqStatsReset(client);
+    case X_ReqStatsGetSchedule:
+        return ProcReqStatsGetSchedule(client);
+    default:
+        return BadRequest;
+    }
+}
+
+static int _X_COLD
+SProcReqStatsQueryVersion(ClientPtr client)
+{
+    REQUEST(xReqStatsQueryVersionReq);
+    REQUEST_SIZE_MATCH(xReqStatsQueryVersionReq);
+    swaps(&stuff->majorVersion);
+    swaps(&stuff->minorVersion);
+    return ProcReqStatsQueryVersion(client);
+}
+
+static int _X_COLD
+SProcReqStatsDispatch(ClientPtr client)
+{
+    REQUEST(xReq);
+    swaps(&stuff->length);
+    switch (stuff->data) {
+    case X_ReqStatsQueryVersion:
+        return SProcReqStatsQueryVersion(client);
+    case X_ReqStatsGetRequests:
+    case X_ReqStatsGetClients:
+    case X_ReqStatsReset:
+    case X_ReqStatsGetSchedule:
+        return ProcReqStatsDispatch(client);
+    default:
+        return BadRequest;
+    }
+}
+
+void
+ReqStatsExtensionInit(void)
+{
+    AddExtension(REQSTATS_NAME, 0, 0,
+                 ProcReqStatsDispatch, SProcReqStatsDispatch,
+                 NULL, StandardMinorOpcode);
+}
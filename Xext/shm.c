@@ -686,6 +686,12 @@ ProcShmGetImage(ClientPtr client)
     VERIFY_SHMSIZE(shmdesc, stuff->offset, length, client);
     xgi.size = length;
 
+    if (length && DoStartGetImage(client, pDraw, stuff->x, stuff->y,
+                                  stuff->width, stuff->height,
+                                  stuff->format, stuff->planeMask,
+                                  &pVisibleRegion))
+        return Success;
+
     if (length == 0) {
         /* nothing to do */
     }
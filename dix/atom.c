@@ -58,86 +58,171 @@ SOFTWARE.
 
 #define InitialTableSize 256
 
+/* Atom names are copied into chunks of this size; longer names get a
+ * chunk of their own. */
+#define ArenaChunkSize 4096
+
 typedef struct _Node {
-    struct _Node *left, *right;
-    Atom a;
-    unsigned int fingerPrint;
     const char *string;
+    unsigned int len;
+    unsigned int hash;
 } NodeRec, *NodePtr;
 
+/*
+ * Atoms are found through an open addressing hash table of atom numbers,
+ * with linear probing.  The table is at most half full.  Each slot keeps
+ * the hash of the name next to the atom, so that probing rarely has to
+ * look at the names.  Atoms are never freed, except all at once by
+ * FreeAllAtoms(), so there are no deleted slots to deal with.
+ */
+typedef struct _HashSlot {
+    unsigned int hash;
+    Atom a;
+} HashSlotRec, *HashSlotPtr;
+
+typedef struct _ArenaChunk {
+    struct _ArenaChunk *next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaChunkRec, *ArenaChunkPtr;
+
 static Atom lastAtom = None;
-static NodePtr atomRoot = NULL;
 static unsigned long tableLength;
-static NodePtr *nodeTable;
+static NodePtr nodeTable;
 
-Atom
-MakeAtom(const char *string, unsigned len, Bool makeit)
+static HashSlotPtr hashTable;
+static unsigned int hashMask;
+
+static ArenaChunkPtr arena;
+
+/* 32 bit FNV-1a */
+static unsigned int
+HashAtomName(const char *string, unsigned len)
 {
-    NodePtr *np;
+    unsigned int hash = 2166136261u;
     unsigned i;
-    int comp;
-    unsigned int fp = 0;
 
-    np = &atomRoot;
-    for (i = 0; i < (len + 1) / 2; i++) {
-        fp = fp * 27 + string[i];
-        fp = fp * 27 + string[len - 1 - i];
-    }
-    while (*np != NULL) {
-        if (fp < (*np)->fingerPrint)
-            np = &((*np)->left);
-        else if (fp > (*np)->fingerPrint)
-            np = &((*np)->right);
-        else {                  /* now start testing the strings */
-            comp = strncmp(string, (*np)->string, (int) len);
-            if ((comp < 0) || ((comp == 0) && (len < strlen((*np)->string))))
-                np = &((*np)->left);
-            else if (comp > 0)
-                np = &((*np)->right);
-            else
-                return (*np)->a;
-        }
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char) string[i];
+        hash *= 16777619u;
     }
-    if (makeit) {
-        NodePtr nd;
+    return hash;
+}
 
-        nd = malloc(sizeof(NodeRec));
-        if (!nd)
-            return BAD_RESOURCE;
-        if (lastAtom < XA_LAST_PREDEFINED) {
-            nd->string = string;
+static const char *
+ArenaStrndup(const char *string, unsigned len)
+{
+    ArenaChunkPtr chunk = arena;
+    char *copy;
+
+    if (!chunk || chunk->size - chunk->used < len + 1) {
+        size_t size = max(ArenaChunkSize, len + 1);
+
+        chunk = malloc(sizeof(ArenaChunkRec) + size);
+        if (!chunk)
+            return NULL;
+        chunk->size = size;
+        chunk->used = 0;
+        /* A name too long for a chunk does not retire the current one */
+        if (arena && size > ArenaChunkSize) {
+            chunk->next = arena->next;
+            arena->next = chunk;
         }
         else {
-            nd->string = strndup(string, len);
-            if (!nd->string) {
-                free(nd);
-                return BAD_RESOURCE;
-            }
+            chunk->next = arena;
+            arena = chunk;
         }
-        if ((lastAtom + 1) >= tableLength) {
-            NodePtr *table;
-
-            table = reallocarray(nodeTable, tableLength, 2 * sizeof(NodePtr));
-            if (!table) {
-                if (nd->string != string) {
-                    /* nd->string has been strdup'ed */
-                    free((char *) nd->string);
-                }
-                free(nd);
-                return BAD_RESOURCE;
-            }
-            tableLength <<= 1;
-            nodeTable = table;
+    }
+    copy = chunk->data + chunk->used;
+    chunk->used += len + 1;
+
+    memcpy(copy, string, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static Bool
+GrowHashTable(void)
+{
+    unsigned int size = (hashMask + 1) * 2;
+    HashSlotPtr table;
+    unsigned int i, j;
+
+    table = calloc(size, sizeof(HashSlotRec));
+    if (!table)
+        return FALSE;
+
+    for (i = 0; i <= hashMask; i++) {
+        if (hashTable[i].a == None)
+            continue;
+        for (j = hashTable[i].hash & (size - 1); table[j].a != None;
+             j = (j + 1) & (size - 1))
+            ;
+        table[j] = hashTable[i];
+    }
+    free(hashTable);
+    hashTable = table;
+    hashMask = size - 1;
+    return TRUE;
+}
+
+Atom
+MakeAtom(const char *string, unsigned len, Bool makeit)
+{
+    unsigned int hash = HashAtomName(string, len);
+    unsigned int i;
+    HashSlotPtr slot;
+    NodePtr nd;
+
+    for (i = hash & hashMask;; i = (i + 1) & hashMask) {
+        slot = &hashTable[i];
+        if (slot->a == None)
+            break;
+        if (slot->hash == hash) {
+            nd = &nodeTable[slot->a];
+            if (nd->len == len && !memcmp(nd->string, string, len))
+                return slot->a;
         }
-        *np = nd;
-        nd->left = nd->right = NULL;
-        nd->fingerPrint = fp;
-        nd->a = ++lastAtom;
-        nodeTable[lastAtom] = nd;
-        return nd->a;
     }
-    else
+
+    if (!makeit)
         return None;
+
+    if ((lastAtom + 1) >= tableLength) {
+        NodePtr table;
+
+        table = reallocarray(nodeTable, tableLength, 2 * sizeof(NodeRec));
+        if (!table)
+            return BAD_RESOURCE;
+        tableLength <<= 1;
+        nodeTable = table;
+    }
+    /* Keep the hash table at most half full */
+    if ((lastAtom + 1) * 2 > hashMask) {
+        if (!GrowHashTable())
+            return BAD_RESOURCE;
+        for (i = hash & hashMask; hashTable[i].a != None;
+             i = (i + 1) & hashMask)
+            ;
+        slot = &hashTable[i];
+    }
+
+    nd = &nodeTable[lastAtom + 1];
+    if (lastAtom < XA_LAST_PREDEFINED) {
+        nd->string = string;
+    }
+    else {
+        nd->string = ArenaStrndup(string, len);
+        if (!nd->string)
+            return BAD_RESOURCE;
+    }
+    nd->len = len;
+    nd->hash = hash;
+
+    slot->hash = hash;
+    slot->a = ++lastAtom;
+    return lastAtom;
 }
 
 Bool
@@ -149,13 +234,9 @@ ValidAtom(Atom atom)
 const char *
 NameForAtom(Atom atom)
 {
-    NodePtr node;
-
-    if (atom > lastAtom)
-        return 0;
-    if ((node = nodeTable[atom]) == NULL)
+    if (atom == None || atom > lastAtom)
         return 0;
-    return node->string;
+    return nodeTable[atom].string;
 }
 
 void
@@ -164,30 +245,20 @@ AtomError(void)
     FatalError("initializing atoms");
 }
 
-static void
-FreeAtom(NodePtr patom)
-{
-    if (patom->left)
-        FreeAtom(patom->left);
-    if (patom->right)
-        FreeAtom(patom->right);
-    if (patom->a > XA_LAST_PREDEFINED) {
-        /*
-         * All strings above XA_LAST_PREDEFINED are strdup'ed, so it's safe to
-         * cast here
-         */
-        free((char *) patom->string);
-    }
-    free(patom);
-}
-
 void
 FreeAllAtoms(void)
 {
-    if (atomRoot == NULL)
+    ArenaChunkPtr chunk, next;
+
+    if (nodeTable == NULL)
         return;
-    FreeAtom(atomRoot);
-    atomRoot = NULL;
+    for (chunk = arena; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    arena = NULL;
+    free(hashTable);
+    hashTable = NULL;
     free(nodeTable);
     nodeTable = NULL;
     lastAtom = None;
@@ -198,10 +269,14 @@ InitAtoms(void)
 {
     FreeAllAtoms();
     tableLength = InitialTableSize;
-    nodeTable = xallocarray(InitialTableSize, sizeof(NodePtr));
+    nodeTable = xallocarray(InitialTableSize, sizeof(NodeRec));
     if (!nodeTable)
         AtomError();
-    nodeTable[None] = NULL;
+    hashMask = 2 * InitialTableSize - 1;
+    hashTable = calloc(hashMask + 1, sizeof(HashSlotRec));
+    if (!hashTable)
+        AtomError();
+    nodeTable[None].string = NULL;
     MakePredeclaredAtoms();
     if (lastAtom != XA_LAST_PREDEFINED)
         AtomError();
@@ -129,6 +129,7 @@ int ProcInitialConnection();
 #include "xkbsrv.h"
 #include "site.h"
 #include "client.h"
+#include "reqstats.h"
 
 #ifdef XSERVER_DTRACE
 #include "registry.h"
@@ -220,6 +221,10 @@ UpdateCurrentTimeIf(void)
 /* in milliseconds */
 #define SMART_SCHEDULE_DEFAULT_INTERVAL	5
 #define SMART_SCHEDULE_MAX_SLICE	15
+#define SMART_SCHEDULE_DEFAULT_BOOST	100
+
+/* Requests run back to back before the time slice is checked again */
+#define DISPATCH_BATCH			16
 
 #ifdef HAVE_SETITIMER
 Bool SmartScheduleSignalEnable = TRUE;
@@ -228,6 +233,7 @@ Bool SmartScheduleSignalEnable = TRUE;
 long SmartScheduleSlice = SMART_SCHEDULE_DEFAULT_INTERVAL;
 long SmartScheduleInterval = SMART_SCHEDULE_DEFAULT_INTERVAL;
 long SmartScheduleMaxSlice = SMART_SCHEDULE_MAX_SLICE;
+long SmartScheduleBoost = SMART_SCHEDULE_DEFAULT_BOOST;
 long SmartScheduleTime;
 int SmartScheduleLatencyLimited = 0;
 static ClientPtr SmartLastClient;
@@ -261,8 +267,10 @@ clients_are_ready(void)
 void
 mark_client_ready(ClientPtr client)
 {
-    if (xorg_list_is_empty(&client->ready))
+    if (xorg_list_is_empty(&client->ready)) {
         xorg_list_append(&client->ready, &ready_clients);
+        client->smart_ready_tick = SmartScheduleTime;
+    }
 }
 
 /*
@@ -282,6 +290,19 @@ mark_client_not_ready(ClientPtr client)
     xorg_list_del(&client->ready);
 }
 
+/*
+ * Without the timer, the clock is only read between turns, so clients
+ * that became ready while the server slept start waiting from now.
+ */
+static void
+mark_clients_ready_now(void)
+{
+    ClientPtr client;
+
+    xorg_list_for_each_entry(client, &ready_clients, ready)
+        client->smart_ready_tick = SmartScheduleTime;
+}
+
 static void
 mark_client_grab(ClientPtr grab)
 {
@@ -306,17 +327,61 @@ mark_client_ungrab(void)
     }
 }
 
+/*
+ * The client user input goes to: the one holding the keyboard or
+ * pointer grab, or else the one owning the focus window.
+ */
+static ClientPtr
+SmartScheduleFocusClient(void)
+{
+    DeviceIntPtr keybd = inputInfo.keyboard;
+    DeviceIntPtr ptr = inputInfo.pointer;
+    WindowPtr win;
+
+    if (!keybd || !ptr)
+        return NullClient;
+    if (keybd->deviceGrab.grab)
+        return rClient(keybd->deviceGrab.grab);
+    if (ptr->deviceGrab.grab)
+        return rClient(ptr->deviceGrab.grab);
+    if (!keybd->focus)
+        return NullClient;
+
+    win = keybd->focus->win;
+    if (win == NoneWin || win == PointerRootWin || win == FollowKeyboardWin)
+        return NullClient;
+    return wClient(win);
+}
+
+/*
+ * Interactive clients, which got input in the last SmartScheduleBoost
+ * milliseconds or own the focus, run before the others of the same
+ * priority.  Clients penalized for hogging the server are not boosted,
+ * or a busy focus owner could starve everybody else.
+ */
+static Bool
+SmartScheduleBoosted(ClientPtr pClient, long now, ClientPtr focus)
+{
+    if (pClient->smart_priority < 0)
+        return FALSE;
+    return pClient == focus ||
+        (now - pClient->smart_input_tick) < SmartScheduleBoost;
+}
+
 static ClientPtr
-SmartScheduleClient(void)
+SmartScheduleClient(Bool *boosted)
 {
-    ClientPtr pClient, best = NULL;
+    ClientPtr pClient, best = NULL, focus = NullClient;
     int bestRobin, robin;
+    Bool bestBoost = FALSE, boost;
     long now = SmartScheduleTime;
     long idle;
     int nready = 0;
 
     bestRobin = 0;
     idle = 2 * SmartScheduleSlice;
+    if (SmartScheduleBoost)
+        focus = SmartScheduleFocusClient();
 
     xorg_list_for_each_entry(pClient, &ready_clients, ready) {
         nready++;
@@ -333,19 +398,27 @@ SmartScheduleClient(void)
              SmartLastIndex[pClient->smart_priority -
                             SMART_MIN_PRIORITY]) & 0xff;
 
+        boost = SmartScheduleBoost &&
+            SmartScheduleBoosted(pClient, now, focus);
+
         /* pick the best client */
         if (!best ||
             pClient->priority > best->priority ||
             (pClient->priority == best->priority &&
-             (pClient->smart_priority > best->smart_priority ||
-              (pClient->smart_priority == best->smart_priority && robin > bestRobin))))
+             (boost > bestBoost ||
+              (boost == bestBoost &&
+               (pClient->smart_priority > best->smart_priority ||
+                (pClient->smart_priority == best->smart_priority &&
+                 robin > bestRobin))))))
         {
             best = pClient;
             bestRobin = robin;
+            bestBoost = boost;
         }
 #ifdef SMART_DEBUG
         if ((now - SmartLastPrint) >= 5000)
-            fprintf(stderr, " %2d: %3d", pClient->index, pClient->smart_priority);
+            fprintf(stderr, " %2d: %3d%s", pClient->index,
+                    pClient->smart_priority, boost ? "*" : "");
 #endif
     }
 #ifdef SMART_DEBUG
@@ -379,6 +452,7 @@ SmartScheduleClient(void)
     else {
         SmartScheduleSlice = SmartScheduleInterval;
     }
+    *boosted = bestBoost;
     return best;
 }
 
@@ -402,8 +476,9 @@ DisableLimitedSchedulingLatency(void)
 void
 Dispatch(void)
 {
-    int result;
+    int result, req_len, batch, client_index;
     ClientPtr client;
+    Bool boosted, slept = FALSE;
     long start_tick;
 
     nextFreeClientID = 1;
@@ -418,6 +493,11 @@ Dispatch(void)
             FlushIfCriticalOutputPending();
         }
 
+        if (reqStatsDumpPending)
+            ReqStatsDump();
+
+        if (!clients_are_ready())
+            slept = TRUE;
         if (!WaitForSomething(clients_are_ready()))
             continue;
 
@@ -427,30 +507,58 @@ Dispatch(void)
 	*****************/
 
         if (!dispatchException && clients_are_ready()) {
-            client = SmartScheduleClient();
+            if (!SmartScheduleSignalEnable) {
+                SmartScheduleTime = GetTimeInMillis();
+                if (slept)
+                    mark_clients_ready_now();
+            }
+            slept = FALSE;
+
+            client = SmartScheduleClient(&boosted);
+            client_index = client->index;
+            ReqStatsSchedule(client, boosted);
 
             isItTimeToYield = FALSE;
 
             start_tick = SmartScheduleTime;
+            batch = 0;
             while (!isItTimeToYield) {
-                if (InputCheckPending())
+                if (InputCheckPending()) {
                     ProcessInputEvents();
-
-                FlushIfCriticalOutputPending();
-                if ((SmartScheduleTime - start_tick) >= SmartScheduleSlice)
-                {
-                    /* Penalize clients which consume ticks */
-                    if (client->smart_priority > SMART_MIN_PRIORITY)
-                        client->smart_priority--;
-                    break;
+                    FlushIfCriticalOutputPending();
                 }
 
-                /* now, finally, deal with client requests */
-                result = ReadRequestFromClient(client);
-                if (result <= 0) {
-                    if (result < 0)
-                        CloseDownClient(client);
-                    break;
+                /*
+                 * Requests that are already complete in the client's
+                 * buffer are run in batches.  Critical output, the time
+                 * slice and the clock are only looked at between batches.
+                 */
+                if (batch > 0 &&
+                    (result = ReadBufferedRequestFromClient(client)) > 0) {
+                    batch--;
+                    ReqStatsContinue(client);
+                }
+                else {
+                    if (!SmartScheduleSignalEnable)
+                        SmartScheduleTime = GetTimeInMillis();
+                    FlushIfCriticalOutputPending();
+                    if ((SmartScheduleTime - start_tick) >= SmartScheduleSlice)
+                    {
+                        /* Penalize clients which consume ticks */
+                        if (client->smart_priority > SMART_MIN_PRIORITY)
+                            client->smart_priority--;
+                        break;
+                    }
+
+                    /* now, finally, deal with client requests */
+                    result = ReadRequestFromClient(client);
+                    if (result <= 0) {
+                        if (result < 0)
+                            CloseDownClient(client);
+                        break;
+                    }
+                    batch = DISPATCH_BATCH;
+                    ReqStatsStart(client);
                 }
 
                 client->sequence++;
@@ -470,6 +578,7 @@ Dispatch(void)
                                           client->index,
                                           client->requestBuffer);
 #endif
+                req_len = result;
                 if (result > (maxBigRequestSize << 2))
                     result = BadLength;
                 else {
@@ -478,8 +587,9 @@ Dispatch(void)
                         result =
                             (*client->requestVector[client->majorOp]) (client);
                 }
-                if (!SmartScheduleSignalEnable)
-                    SmartScheduleTime = GetTimeInMillis();
+                /* Unless the request freed its own client (KillClient) */
+                if (clients[client_index] == client)
+                    ReqStatsDone(client, req_len);
 
 #ifdef XSERVER_DTRACE
                 if (XSERVER_REQUEST_DONE_ENABLED())
@@ -500,8 +610,13 @@ Dispatch(void)
                 }
             }
             FlushAllOutput();
-            if (client == SmartLastClient)
+            if (!SmartScheduleSignalEnable)
+                SmartScheduleTime = GetTimeInMillis();
+            /* Unless it was closed down, the client waits again from now */
+            if (client == SmartLastClient) {
                 client->smart_stop_tick = SmartScheduleTime;
+                client->smart_ready_tick = SmartScheduleTime;
+            }
         }
         dispatchException &= ~DE_PRIORITYCHANGE;
     }
@@ -2066,6 +2181,143 @@ ProcPutImage(ClientPtr client)
     return Success;
 }
 
+/*
+ * A band of image data.  The output layer may keep it after
+ * WriteImageBand() returns, and release it any time later.
+ */
+typedef struct _ImageBand {
+    Bool writing;               /* in WriteImageBand(), not to be freed */
+    Bool released;              /* released while being written */
+    char data[];
+} ImageBandRec, *ImageBandPtr;
+
+static ImageBandPtr
+AllocImageBand(int length, Bool clear)
+{
+    ImageBandPtr band;
+
+    band = clear ? calloc(1, sizeof(ImageBandRec) + length) :
+        malloc(sizeof(ImageBandRec) + length);
+    if (band)
+        band->writing = FALSE;
+    return band;
+}
+
+static void
+ReleaseImageBand(void *closure)
+{
+    ImageBandPtr band = closure;
+
+    if (band->writing)
+        band->released = TRUE;
+    else
+        free(band);
+}
+
+/*
+ * Hands a band of image data over to the client and returns the band
+ * to get the next one into, NULL if that can't be allocated.  That is
+ * the same band unless the client could not keep up and the output
+ * layer kept it, so a slow client does not cost another copy of the
+ * band.  A fresh band is cleared if the scanlines have padding GetImage
+ * doesn't write, so no stale heap goes out in it.
+ */
+static ImageBandPtr
+WriteImageBand(ClientPtr client, int count, ImageBandPtr band, int length,
+               Bool clear)
+{
+    ImageBandPtr next;
+
+    band->writing = TRUE;
+    band->released = FALSE;
+    WriteBufferToClient(client, count, band->data, ReleaseImageBand, band);
+    band->writing = FALSE;
+    if (band->released)
+        return band;
+
+    next = AllocImageBand(length, clear);
+    if (!next)
+        MarkClientException(client);
+    return next;
+}
+
+/*
+ * The visible region of a window a GetImage was put to sleep for, in
+ * screen coordinates while the window was at x, y.
+ */
+typedef struct _GetImageClip {
+    int sequence;
+    int x, y;
+    RegionRec region;
+} GetImageClipRec;
+
+static void
+FreeGetImageClip(ClientPtr client)
+{
+    if (client->getImageClip) {
+        RegionUninit(&client->getImageClip->region);
+        free(client->getImageClip);
+        client->getImageClip = NULL;
+    }
+}
+
+/**
+ * Lets the screen start reading back an image @client gets.  Returns
+ * TRUE if the client has been put to sleep until the image is ready, and
+ * the request reset to be run again then.
+ *
+ * The image is read as it is now, so *ppVisibleRegion, the visible
+ * region of a window or NULL, is saved then.  When the request is run
+ * again, *ppVisibleRegion is set to the saved region, moved along with
+ * the window, and stays valid until the client's next GetImage.
+ */
+Bool
+DoStartGetImage(ClientPtr client, DrawablePtr pDraw, int x, int y,
+                int width, int height, unsigned int format,
+                unsigned long planemask, RegionPtr *ppVisibleRegion)
+{
+    GetImageClipRec *clip = client->getImageClip;
+
+    if (clip && clip->sequence != client->sequence) {
+        FreeGetImageClip(client);
+        clip = NULL;
+    }
+    if (clip && *ppVisibleRegion) {
+        RegionTranslate(&clip->region, pDraw->x - clip->x, pDraw->y - clip->y);
+        clip->x = pDraw->x;
+        clip->y = pDraw->y;
+        *ppVisibleRegion = &clip->region;
+    }
+
+    if (!pDraw->pScreen->StartGetImage || !width || !height ||
+        !(*pDraw->pScreen->StartGetImage) (pDraw, x, y, width, height,
+                                           format, planemask, client))
+        return FALSE;
+
+    /* Without the saved region, the image is censored as the window is
+     * when it is sent */
+    if (!clip && *ppVisibleRegion &&
+        (clip = malloc(sizeof(GetImageClipRec)))) {
+        RegionNull(&clip->region);
+        if (RegionCopy(&clip->region, *ppVisibleRegion)) {
+            clip->x = pDraw->x;
+            clip->y = pDraw->y;
+            client->getImageClip = clip;
+        }
+        else {
+            RegionUninit(&clip->region);
+            free(clip);
+            clip = NULL;
+        }
+    }
+    if (clip)
+        clip->sequence = client->sequence;
+
+    ResetCurrentRequest(client);
+    client->sequence--;
+    return TRUE;
+}
+
 static int
 DoGetImage(ClientPtr client, int format, Drawable drawable,
            int x, int y, int width, int height,
@@ -2079,7 +2331,9 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     int relx, rely;
     long widthBytesLine, length;
     Mask plane = 0;
+    ImageBandPtr pBand;
     char *pBuf;
+    Bool padded;
     xGetImageReply xgi;
     RegionPtr pVisibleRegion = NULL;
 
@@ -2156,10 +2410,12 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     if (format == ZPixmap) {
         widthBytesLine = PixmapBytePad(width, pDraw->depth);
         length = widthBytesLine * height;
+        padded = widthBytesLine * 8 != width * BitsPerPixel(pDraw->depth);
 
     }
     else {
         widthBytesLine = BitmapBytePad(width);
+        padded = widthBytesLine * 8 != width;
         plane = ((Mask) 1) << (pDraw->depth - 1);
         /* only planes asked for */
         length = widthBytesLine * height *
@@ -2170,6 +2426,17 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     xgi.length = length;
 
     xgi.length = bytes_to_int32(xgi.length);
+
+    if (pDraw->type == DRAWABLE_WINDOW) {
+        pVisibleRegion = &((WindowPtr) pDraw)->borderClip;
+        pDraw->pScreen->SourceValidate(pDraw, x, y, width, height,
+                                       IncludeInferiors);
+    }
+
+    if (DoStartGetImage(client, pDraw, x, y, width, height, format,
+                        planemask, &pVisibleRegion))
+        return Success;
+
     if (widthBytesLine == 0 || height == 0)
         linesPerBuf = 0;
     else if (widthBytesLine >= IMAGE_BUFSIZE)
@@ -2192,16 +2459,11 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
             length += widthBytesLine;
         }
     }
-    if (!(pBuf = calloc(1, length)))
+    if (!(pBand = AllocImageBand(length, TRUE)))
         return BadAlloc;
+    pBuf = pBand->data;
     WriteReplyToClient(client, sizeof(xGetImageReply), &xgi);
 
-    if (pDraw->type == DRAWABLE_WINDOW) {
-        pVisibleRegion = &((WindowPtr) pDraw)->borderClip;
-        pDraw->pScreen->SourceValidate(pDraw, x, y, width, height,
-                                       IncludeInferiors);
-    }
-
     if (linesPerBuf == 0) {
         /* nothing to do */
     }
@@ -2225,7 +2487,11 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
             ReformatImage(pBuf, (int) (nlines * widthBytesLine),
                           BitsPerPixel(pDraw->depth), ClientOrder(client));
 
-            WriteToClient(client, (int) (nlines * widthBytesLine), pBuf);
+            pBand = WriteImageBand(client, (int) (nlines * widthBytesLine),
+                                   pBand, length, padded);
+            if (!pBand)
+                return BadAlloc;
+            pBuf = pBand->data;
             linesDone += nlines;
         }
     }
@@ -2253,13 +2519,18 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
                     ReformatImage(pBuf, (int) (nlines * widthBytesLine),
                                   1, ClientOrder(client));
 
-                    WriteToClient(client, (int)(nlines * widthBytesLine), pBuf);
+                    pBand = WriteImageBand(client,
+                                           (int) (nlines * widthBytesLine),
+                                           pBand, length, padded);
+                    if (!pBand)
+                        return BadAlloc;
+                    pBuf = pBand->data;
                     linesDone += nlines;
                 }
             }
         }
     }
-    free(pBuf);
+    free(pBand);
     return Success;
 }
 
@@ -3445,6 +3716,7 @@ CloseDownClient(ClientPtr client)
         if (ClientIsAsleep(client))
             ClientSignal(client);
         ProcessWorkQueueZombies();
+        FreeGetImageClip(client);
         CloseDownConnection(client);
         output_pending_clear(client);
         mark_client_not_ready(client);
@@ -3517,6 +3789,8 @@ InitClient(ClientPtr client, int i, void *ospriv)
     QueryMinMaxKeyCodes(&client->minKC, &client->maxKC);
     client->smart_start_tick = SmartScheduleTime;
     client->smart_stop_tick = SmartScheduleTime;
+    client->smart_input_tick = SmartScheduleTime - SmartScheduleBoost;
+    client->smart_ready_tick = SmartScheduleTime;
     client->clientIds = NULL;
 }
 
@@ -486,6 +486,30 @@ static CARD8 criticalEvents[32] = {
     0x7c, 0x30, 0x40            /* key, button, expose, and configure events */
 };
 
+/* @return TRUE if the event reports user input to the client */
+static Bool
+event_is_input(const xEvent *event)
+{
+    int type = event->u.u.type;
+
+    switch (xi2_get_type(event)) {
+    case XI_KeyPress:
+    case XI_KeyRelease:
+    case XI_ButtonPress:
+    case XI_ButtonRelease:
+    case XI_Motion:
+    case XI_TouchBegin:
+    case XI_TouchUpdate:
+    case XI_TouchEnd:
+        return TRUE;
+    }
+
+    if (type >= KeyPress && type <= MotionNotify)
+        return TRUE;
+    /* XI 1.x device events are critical, see SetCriticalEvent() */
+    return type >= EXTENSION_EVENT_BASE && BitIsOn(criticalEvents, type);
+}
+
 static void
 SyntheticMotion(DeviceIntPtr dev, int x, int y)
 {
@@ -2023,6 +2047,8 @@ TryClientEvents(ClientPtr client, DeviceIntPtr dev, xEvent *pEvents,
             client->smart_priority++;
         SetCriticalOutputPending();
     }
+    if (event_is_input(pEvents))
+        client->smart_input_tick = SmartScheduleTime;
 
     WriteEventsToClient(client, count, pEvents);
 #ifdef DEBUG_EVENTS
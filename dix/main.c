@@ -107,6 +107,7 @@ Equipment Corporation.
 #include "registry.h"
 #include "client.h"
 #include "exevents.h"
+#include "reqstats.h"
 #ifdef PANORAMIX
 #include "panoramiXsrv.h"
 #else
@@ -190,6 +191,7 @@ dix_main(int argc, char *argv[], char *envp[])
         dixResetRegistry();
         InitFonts();
         InitCallbackManager();
+        ReqStatsInit();
         InitOutput(&screenInfo, argc, argv);
 
         if (screenInfo.numScreens < 1)
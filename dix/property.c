@@ -65,8 +65,204 @@ SOFTWARE.
  *   Properties belong to windows.  The list of properties should not be
  *   traversed directly.  Instead, use the three functions listed above.
  *
+ *   Windows with many properties, like the root window, also get an
+ *   index from property name to the first property of that name in the
+ *   list, so that lookups don't have to walk it.  The list stays the
+ *   only place the properties live and keeps their order.
+ *
  *****************************************************************/
 
+/* Windows get an index once they have this many properties */
+#define PropertyIndexThreshold 16
+
+/*
+ * An open addressing hash table with linear probing, at most half full.
+ * Properties with the same name (see XSELinux polyinstantiation) share
+ * the slot of the first one in the list.
+ */
+typedef struct _PropertyIndex {
+    int bits;
+    int used;
+    PropertyPtr slots[];
+} PropertyIndexRec, *PropertyIndexPtr;
+
+static PropertyIndexPtr
+PropertyIndex(WindowPtr pWin)
+{
+    return pWin->optional ? pWin->optional->propIndex : NULL;
+}
+
+static unsigned int
+PropertyHash(Atom name, int bits)
+{
+    return (CARD32) name * 0x9e3779b1u >> (32 - bits);
+}
+
+static PropertyPtr *
+FindPropertySlot(PropertyIndexPtr pIndex, Atom name)
+{
+    unsigned int mask = (1 << pIndex->bits) - 1;
+    unsigned int i;
+
+    for (i = PropertyHash(name, pIndex->bits); pIndex->slots[i];
+         i = (i + 1) & mask) {
+        if (pIndex->slots[i]->propertyName == name)
+            break;
+    }
+    return &pIndex->slots[i];
+}
+
+/* Does not replace a property already indexed under the same name */
+static void
+IndexProperty(PropertyIndexPtr pIndex, PropertyPtr pProp)
+{
+    PropertyPtr *slot = FindPropertySlot(pIndex, pProp->propertyName);
+
+    if (!*slot) {
+        *slot = pProp;
+        pIndex->used++;
+    }
+}
+
+static PropertyIndexPtr
+AllocPropertyIndex(int bits)
+{
+    PropertyIndexPtr pIndex;
+
+    pIndex = calloc(1, sizeof(PropertyIndexRec) +
+                    (sizeof(PropertyPtr) << bits));
+    if (pIndex)
+        pIndex->bits = bits;
+    return pIndex;
+}
+
+/**
+ * Indexes @pProp, just put at the head of the list of @pWin, building or
+ * growing the index as needed.  Without memory for the index, lookups
+ * just fall back to the list.
+ */
+static void
+AddPropertyToIndex(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr pIndex = pWin->optional->propIndex, grown;
+    PropertyPtr p, *slot;
+    int i, n, bits;
+
+    if (!pIndex) {
+        n = 0;
+        for (p = pWin->optional->userProps; p; p = p->next)
+            n++;
+        if (n < PropertyIndexThreshold)
+            return;
+
+        for (bits = 5; (1 << bits) < 2 * n; bits++)
+            ;
+        pIndex = AllocPropertyIndex(bits);
+        if (!pIndex)
+            return;
+        for (p = pWin->optional->userProps; p; p = p->next)
+            IndexProperty(pIndex, p);
+        pWin->optional->propIndex = pIndex;
+        return;
+    }
+
+    if ((pIndex->used + 1) * 2 > (1 << pIndex->bits)) {
+        grown = AllocPropertyIndex(pIndex->bits + 1);
+        if (grown) {
+            for (i = 0; i < (1 << pIndex->bits); i++)
+                if (pIndex->slots[i])
+                    IndexProperty(grown, pIndex->slots[i]);
+        }
+        free(pIndex);
+        pWin->optional->propIndex = pIndex = grown;
+        if (!pIndex)
+            return;
+    }
+
+    /* Properties are added at the head, so this one comes first */
+    slot = FindPropertySlot(pIndex, pProp->propertyName);
+    if (!*slot)
+        pIndex->used++;
+    *slot = pProp;
+}
+
+/**
+ * Unindexes @pProp, which is about to be unlinked from the list of @pWin.
+ */
+static void
+RemovePropertyFromIndex(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr pIndex = PropertyIndex(pWin);
+    unsigned int mask, i, j, k;
+    PropertyPtr *slot, p;
+
+    if (!pIndex)
+        return;
+
+    slot = FindPropertySlot(pIndex, pProp->propertyName);
+    if (*slot != pProp)
+        return;
+
+    /* Another property of that name takes its place */
+    for (p = pProp->next; p; p = p->next) {
+        if (p->propertyName == pProp->propertyName) {
+            *slot = p;
+            return;
+        }
+    }
+
+    /* Shift back the entries that probed past the slot */
+    mask = (1 << pIndex->bits) - 1;
+    i = j = slot - pIndex->slots;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!pIndex->slots[j])
+            break;
+        k = PropertyHash(pIndex->slots[j]->propertyName, pIndex->bits);
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+            pIndex->slots[i] = pIndex->slots[j];
+            i = j;
+        }
+    }
+    pIndex->slots[i] = NULL;
+    pIndex->used--;
+}
+
+static void
+FreePropertyIndex(WindowPtr pWin)
+{
+    if (pWin->optional) {
+        free(pWin->optional->propIndex);
+        pWin->optional->propIndex = NULL;
+    }
+}
+
+/**
+ * Unlinks @pProp from the list of @pWin, without freeing it.
+ */
+static void
+UnlinkProperty(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyPtr prevProp;
+
+    RemovePropertyFromIndex(pWin, pProp);
+
+    if (pWin->optional->userProps == pProp) {
+        /* Takes care of head */
+        if (!(pWin->optional->userProps = pProp->next)) {
+            FreePropertyIndex(pWin);
+            CheckWindowOptionalNeed(pWin);
+        }
+    }
+    else {
+        /* Need to traverse to find the previous element */
+        prevProp = pWin->optional->userProps;
+        while (prevProp->next != pProp)
+            prevProp = prevProp->next;
+        prevProp->next = pProp->next;
+    }
+}
+
 #ifdef notdef
 static void
 PrintPropertys(WindowPtr pWin)
@@ -90,14 +286,19 @@ int
 dixLookupProperty(PropertyPtr *result, WindowPtr pWin, Atom propertyName,
                   ClientPtr client, Mask access_mode)
 {
+    PropertyIndexPtr pIndex = PropertyIndex(pWin);
     PropertyPtr pProp;
     int rc = BadMatch;
 
     client->errorValue = propertyName;
 
-    for (pProp = wUserProps(pWin); pProp; pProp = pProp->next)
-        if (pProp->propertyName == propertyName)
-            break;
+    if (pIndex)
+        pProp = *FindPropertySlot(pIndex, propertyName);
+    else {
+        for (pProp = wUserProps(pWin); pProp; pProp = pProp->next)
+            if (pProp->propertyName == propertyName)
+                break;
+    }
 
     if (pProp)
         rc = XaceHookPropertyAccess(client, pWin, &pProp, access_mode);
@@ -295,6 +496,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
         }
         pProp->next = pWin->optional->userProps;
         pWin->optional->userProps = pProp;
+        AddPropertyToIndex(pWin, pProp);
     }
     else if (rc == Success) {
         /* To append or prepend to a property the request format and type
@@ -368,7 +570,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 int
 DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     int rc;
 
     rc = dixLookupProperty(&pProp, pWin, propName, client, DixDestroyAccess);
@@ -376,19 +578,7 @@ DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
         return Success;         /* Succeed if property does not exist */
 
     if (rc == Success) {
-        if (pWin->optional->userProps == pProp) {
-            /* Takes care of head */
-            if (!(pWin->optional->userProps = pProp->next))
-                CheckWindowOptionalNeed(pWin);
-        }
-        else {
-            /* Need to traverse to find the previous element */
-            prevProp = pWin->optional->userProps;
-            while (prevProp->next != pProp)
-                prevProp = prevProp->next;
-            prevProp->next = pProp->next;
-        }
-
+        UnlinkProperty(pWin, pProp);
         deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp);
         free(pProp->data);
         dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
@@ -401,6 +591,7 @@ DeleteAllWindowProperties(WindowPtr pWin)
 {
     PropertyPtr pProp, pNextProp;
 
+    FreePropertyIndex(pWin);
     pProp = wUserProps(pWin);
     while (pProp) {
         deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp);
@@ -443,7 +634,7 @@ NullPropertyReply(ClientPtr client, ATOM propertyType, int format)
 int
 ProcGetProperty(ClientPtr client)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     unsigned long n, len, ind;
     int rc;
     WindowPtr pWin;
@@ -529,6 +720,18 @@ ProcGetProperty(ClientPtr client)
         deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp);
 
     WriteReplyToClient(client, sizeof(xGenericReply), &reply);
+    if (stuff->delete && reply.bytesAfter == 0 &&
+        (!client->swapped || reply.format == 8)) {
+        /* The data goes away with the property, so it can be handed over */
+        UnlinkProperty(pWin, pProp);
+        if (len)
+            WriteBufferToClient(client, len, (char *) pProp->data + ind,
+                                free, pProp->data);
+        else
+            free(pProp->data);
+        dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+        return Success;
+    }
     if (len) {
         switch (reply.format) {
         case 32:
@@ -546,19 +749,7 @@ ProcGetProperty(ClientPtr client)
 
     if (stuff->delete && (reply.bytesAfter == 0)) {
         /* Delete the Property */
-        if (pWin->optional->userProps == pProp) {
-            /* Takes care of head */
-            if (!(pWin->optional->userProps = pProp->next))
-                CheckWindowOptionalNeed(pWin);
-        }
-        else {
-            /* Need to traverse to find the previous element */
-            prevProp = pWin->optional->userProps;
-            while (prevProp->next != pProp)
-                prevProp = prevProp->next;
-            prevProp->next = pProp->next;
-        }
-
+        UnlinkProperty(pWin, pProp);
         free(pProp->data);
         dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
     }
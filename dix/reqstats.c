@@ -0,0 +1,440 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Per request type and per client statistics: number of requests,
+ * service time and its distribution, and bytes read and written.  Per
+ * client scheduling statistics: turns and time spent waiting for them.
+ *
+ * Requests are only ever dispatched from the main thread, one at a
+ * time, so the counters need no locking.  They can be queried with the
+ * REQUEST-STATS extension, and are written to the log on SIGUSR2.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <signal.h>
+
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "privates.h"
+#include "registry.h"
+#include "client.h"
+#include "reqstats.h"
+
+IOStatsRec ioStats;
+
+static ReqStatsRec coreStats[EXTENSION_BASE];
+static ReqStatsPtr extStats[MAXEXTENSIONS];
+
+static DevPrivateKeyRec reqStatsClientKeyRec;
+#define reqStatsClientKey (&reqStatsClientKeyRec)
+
+static DevPrivateKeyRec schedStatsClientKeyRec;
+#define schedStatsClientKey (&schedStatsClientKeyRec)
+
+/* Set for a client whose last request was reset to be run again */
+static DevPrivateKeyRec reqResumeClientKeyRec;
+#define reqResumeClientKey (&reqResumeClientKeyRec)
+
+/* Scheduling statistics of all clients, including the ones now gone */
+static SchedStatsRec schedStats;
+
+/* The request being dispatched */
+static ClientPtr reqClient;
+static CARD64 reqStart;
+static CARD64 reqBytesOut;
+static int reqSequence;
+static Bool reqResumed;
+
+/* When the last request was done */
+static CARD64 reqEnd;
+
+volatile char reqStatsDumpPending;
+
+CallbackListPtr ReqStatsDumpCallback;
+
+static void
+ReqStatsSignal(int signo)
+{
+    reqStatsDumpPending = TRUE;
+}
+
+void
+ReqStatsReset(void)
+{
+    int i;
+
+    memset(coreStats, 0, sizeof(coreStats));
+    memset(&ioStats, 0, sizeof(ioStats));
+    memset(&schedStats, 0, sizeof(schedStats));
+    for (i = 0; i < MAXEXTENSIONS; i++) {
+        free(extStats[i]);
+        extStats[i] = NULL;
+    }
+
+    if (dixPrivateKeyRegistered(reqStatsClientKey)) {
+        for (i = 0; i < currentMaxClients; i++)
+            if (clients[i]) {
+                memset(ReqStatsClient(clients[i]), 0, sizeof(ReqStatsRec));
+                memset(ReqStatsClientSchedule(clients[i]), 0,
+                       sizeof(SchedStatsRec));
+            }
+    }
+}
+
+void
+ReqStatsInit(void)
+{
+    ReqStatsReset();
+
+    if (!dixRegisterPrivateKey(reqStatsClientKey, PRIVATE_CLIENT,
+                               sizeof(ReqStatsRec)) ||
+        !dixRegisterPrivateKey(schedStatsClientKey, PRIVATE_CLIENT,
+                               sizeof(SchedStatsRec)) ||
+        !dixRegisterPrivateKey(reqResumeClientKey, PRIVATE_CLIENT,
+                               sizeof(Bool)))
+        FatalError("ReqStatsInit: cannot register client private\n");
+
+    OsSignal(SIGUSR2, ReqStatsSignal);
+}
+
+/**
+ * Returns the statistics of requests with the given opcodes, or NULL if
+ * there are none.
+ */
+ReqStatsPtr
+ReqStatsLookup(int major, int minor)
+{
+    ReqStatsPtr ext;
+
+    if (major < EXTENSION_BASE)
+        return &coreStats[major];
+
+    ext = extStats[major - EXTENSION_BASE];
+    if (!ext)
+        return NULL;
+
+    return &ext[min(minor, REQSTATS_MAX_MINOR)];
+}
+
+ReqStatsPtr
+ReqStatsClient(ClientPtr client)
+{
+    return dixLookupPrivate(&client->devPrivates, reqStatsClientKey);
+}
+
+SchedStatsPtr
+ReqStatsClientSchedule(ClientPtr client)
+{
+    return dixLookupPrivate(&client->devPrivates, schedStatsClientKey);
+}
+
+static int
+ReqStatsBucket(CARD64 time)
+{
+    int bucket = 0;
+
+    while (time && bucket < REQSTATS_BUCKETS - 1) {
+        time >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void
+ReqStatsAdd(ReqStatsPtr stats, CARD64 time, int bytesIn, CARD64 bytesOut)
+{
+    stats->count++;
+    stats->time += time;
+    stats->bytesIn += bytesIn;
+    stats->bytesOut += bytesOut;
+    stats->histogram[ReqStatsBucket(time)]++;
+}
+
+/**
+ * Returns an upper bound of the given percentile of the times counted
+ * in @histogram, in microseconds.
+ */
+CARD32
+ReqStatsHistogramPercentile(const CARD32 *histogram, int percent)
+{
+    CARD64 total = 0, target, seen = 0;
+    int i;
+
+    for (i = 0; i < REQSTATS_BUCKETS; i++)
+        total += histogram[i];
+    if (!total)
+        return 0;
+
+    target = (total * percent + 99) / 100;
+    for (i = 0; i < REQSTATS_BUCKETS - 1; i++) {
+        seen += histogram[i];
+        if (seen >= target)
+            break;
+    }
+    return (CARD32) 1 << i;
+}
+
+/**
+ * Returns an upper bound of the given percentile of service times, in
+ * microseconds.
+ */
+CARD32
+ReqStatsPercentile(ReqStatsPtr stats, int percent)
+{
+    return ReqStatsHistogramPercentile(stats->histogram, percent);
+}
+
+static void
+SchedStatsAdd(SchedStatsPtr stats, CARD64 wait, Bool boosted)
+{
+    stats->turns++;
+    if (boosted)
+        stats->boosted++;
+    stats->wait += wait;
+    if (wait > stats->maxWait)
+        stats->maxWait = wait;
+    stats->histogram[ReqStatsBucket(wait)]++;
+}
+
+/**
+ * Accounts a turn the scheduler gave to @client, and the time it waited
+ * for it since it became ready, as far as SmartScheduleTime tells.
+ */
+void
+ReqStatsSchedule(ClientPtr client, Bool boosted)
+{
+    long ticks = SmartScheduleTime - client->smart_ready_tick;
+    CARD64 wait = 0;
+
+    if (ticks > 0)
+        wait = (CARD64) ticks * 1000;
+
+    SchedStatsAdd(&schedStats, wait, boosted);
+    SchedStatsAdd(ReqStatsClientSchedule(client), wait, boosted);
+}
+
+/*
+ * A request that sleeps until it can be completed, like a GetImage
+ * waiting for its readback, resets itself and gives its sequence number
+ * back.  It is accounted on that first run only.  When it is run again,
+ * what it writes is only accounted to the client, like events are.
+ */
+static void
+ReqStatsBegin(ClientPtr client)
+{
+    Bool *resume = dixLookupPrivate(&client->devPrivates, reqResumeClientKey);
+
+    reqResumed = *resume;
+    *resume = FALSE;
+    reqClient = reqResumed ? NULL : client;
+    reqBytesOut = 0;
+    reqSequence = client->sequence + 1;
+}
+
+void
+ReqStatsStart(ClientPtr client)
+{
+    ReqStatsBegin(client);
+    reqStart = GetTimeInMicros();
+}
+
+/**
+ * Like ReqStatsStart(), for a request dispatched right after the last
+ * one: it starts when the last one was done, which saves reading the
+ * clock again.
+ */
+void
+ReqStatsContinue(ClientPtr client)
+{
+    ReqStatsBegin(client);
+    reqStart = reqEnd;
+}
+
+/**
+ * Accounts the request started with ReqStatsStart(), which was @bytes
+ * long, to its type and to @client.  Must not be called once the
+ * client has been freed.
+ */
+void
+ReqStatsDone(ClientPtr client, int bytes)
+{
+    CARD64 time;
+    int slot = client->majorOp - EXTENSION_BASE;
+    ReqStatsPtr stats;
+
+    reqEnd = GetTimeInMicros();
+    time = reqEnd - reqStart;
+    reqClient = NULL;
+
+    if (client->sequence != reqSequence)
+        *(Bool *) dixLookupPrivate(&client->devPrivates,
+                                   reqResumeClientKey) = TRUE;
+    if (reqResumed)
+        return;
+
+    if (slot >= 0 && !extStats[slot])
+        extStats[slot] = calloc(REQSTATS_MAX_MINOR + 1, sizeof(ReqStatsRec));
+
+    stats = ReqStatsLookup(client->majorOp, client->minorOp);
+    if (stats)
+        ReqStatsAdd(stats, time, bytes, reqBytesOut);
+
+    ReqStatsAdd(ReqStatsClient(client), time, bytes, reqBytesOut);
+}
+
+/**
+ * Accounts @bytes written to @client, either as part of the current
+ * request or, for events, only to the client.
+ */
+void
+ReqStatsWrite(ClientPtr client, int bytes)
+{
+    if (client == reqClient)
+        reqBytesOut += bytes;
+    else if (dixPrivateKeyRegistered(reqStatsClientKey))
+        ReqStatsClient(client)->bytesOut += bytes;
+}
+
+static const char *
+ReqStatsName(char *buf, size_t size, int major, int minor)
+{
+#ifdef X_REGISTRY_REQUEST
+    if (major < EXTENSION_BASE)
+        return LookupMajorName(major);
+    return LookupRequestName(major, minor);
+#else
+    /* Request names are only registered for the security extensions */
+    if (major < EXTENSION_BASE)
+        snprintf(buf, size, "%d", major);
+    else
+        snprintf(buf, size, "%d:%d", major, minor);
+    return buf;
+#endif
+}
+
+static void
+ReqStatsLog(const char *name, ReqStatsPtr stats)
+{
+    LogMessageVerb(X_NONE, 0,
+                   "%-40s %10llu %12llu %8u %8u %12llu %12llu\n", name,
+                   (unsigned long long) stats->count,
+                   (unsigned long long) stats->time,
+                   (unsigned) ReqStatsPercentile(stats, 50),
+                   (unsigned) ReqStatsPercentile(stats, 99),
+                   (unsigned long long) stats->bytesIn,
+                   (unsigned long long) stats->bytesOut);
+}
+
+static void
+SchedStatsLog(const char *name, SchedStatsPtr stats)
+{
+    LogMessageVerb(X_NONE, 0,
+                   "%-40s %10llu %10llu %12llu %8u %8u %10llu\n", name,
+                   (unsigned long long) stats->turns,
+                   (unsigned long long) stats->boosted,
+                   (unsigned long long) stats->wait,
+                   (unsigned) ReqStatsHistogramPercentile(stats->histogram,
+                                                          50),
+                   (unsigned) ReqStatsHistogramPercentile(stats->histogram,
+                                                          99),
+                   (unsigned long long) stats->maxWait);
+}
+
+/**
+ * Writes the statistics of every request type and client to the log.
+ */
+void
+ReqStatsDump(void)
+{
+    char name[64];
+    int major, minor, i;
+
+    reqStatsDumpPending = FALSE;
+
+    LogMessageVerb(X_INFO, 0, "Request statistics (times in us):\n");
+    LogMessageVerb(X_NONE, 0,
+                   "%-40s %10s %12s %8s %8s %12s %12s\n", "request",
+                   "count", "time", "p50", "p99", "bytes in", "bytes out");
+
+    for (major = 0; major < EXTENSION_BASE; major++) {
+        if (coreStats[major].count)
+            ReqStatsLog(ReqStatsName(name, sizeof(name), major, 0),
+                        &coreStats[major]);
+    }
+
+    for (major = EXTENSION_BASE; major < EXTENSION_BASE + MAXEXTENSIONS;
+         major++) {
+        ReqStatsPtr ext = extStats[major - EXTENSION_BASE];
+
+        if (!ext)
+            continue;
+        for (minor = 0; minor <= REQSTATS_MAX_MINOR; minor++) {
+            if (ext[minor].count)
+                ReqStatsLog(ReqStatsName(name, sizeof(name), major, minor),
+                            &ext[minor]);
+        }
+    }
+
+    if (ioStats.requests)
+        LogMessageVerb(X_NONE, 0,
+                       "%llu requests, %llu reads, %llu writes, "
+                       "%.2f system calls per request\n",
+                       (unsigned long long) ioStats.requests,
+                       (unsigned long long) ioStats.reads,
+                       (unsigned long long) ioStats.writes,
+                       (double) (ioStats.reads + ioStats.writes) /
+                       ioStats.requests);
+
+    for (i = 1; i < currentMaxClients; i++) {
+        const char *cmd;
+
+        if (!clients[i] || clients[i]->clientState != ClientStateRunning)
+            continue;
+
+        cmd = GetClientCmdName(clients[i]);
+        snprintf(name, sizeof(name), "client %d (%s)", i, cmd ? cmd : "?");
+        ReqStatsLog(name, ReqStatsClient(clients[i]));
+    }
+
+    LogMessageVerb(X_INFO, 0, "Scheduling statistics (times in us):\n");
+    LogMessageVerb(X_NONE, 0,
+                   "%-40s %10s %10s %12s %8s %8s %10s\n", "client",
+                   "turns", "boosted", "wait", "p50", "p99", "max");
+
+    for (i = 1; i < currentMaxClients; i++) {
+        const char *cmd;
+
+        if (!clients[i] || clients[i]->clientState != ClientStateRunning)
+            continue;
+
+        cmd = GetClientCmdName(clients[i]);
+        snprintf(name, sizeof(name), "client %d (%s)", i, cmd ? cmd : "?");
+        SchedStatsLog(name, ReqStatsClientSchedule(clients[i]));
+    }
+    SchedStatsLog("all clients", &schedStats);
+
+    CallCallbacks(&ReqStatsDumpCallback, NULL);
+}
@@ -149,14 +149,13 @@ Equipment Corporation.
 #define TypeNameString(t) LookupResourceName(t)
 #endif
 
-static void RebuildTable(int    /*client */
+static Bool RebuildTable(int    /*client */
     );
 
 #define SERVER_MINID 32
 
-#define INITBUCKETS 64
 #define INITHASHSIZE 6
-#define MAXHASHSIZE 16
+#define RESOURCE_CHUNK 32
 
 typedef struct _Resource {
     struct _Resource *next;
@@ -165,15 +164,55 @@ typedef struct _Resource {
     void *value;
 } ResourceRec, *ResourcePtr;
 
+/*
+ *	Resources live in an open addressing hash table of their IDs, with
+ *	linear probing.  The newest resource with a given ID is stored in
+ *	the table itself, so a lookup usually touches one cache line; other
+ *	resources sharing the ID (say, the damage of a window) are chained
+ *	to it, newest first, and are carved out of per-client chunks.
+ *
+ *	The next field of a slot also gives its state: NULL if the slot is
+ *	empty, DELETED_SLOT if its resources were freed, otherwise the next
+ *	resource with that ID or END_OF_CHAIN.  Freed slots are not emptied,
+ *	so that walks over the table stay valid while delete functions free
+ *	other resources; they are reclaimed when the table is rebuilt.
+ */
+static ResourceRec endOfChain, deletedSlot;
+
+#define END_OF_CHAIN (&endOfChain)
+#define DELETED_SLOT (&deletedSlot)
+
+typedef struct _ResourceChunk {
+    struct _ResourceChunk *next;
+    ResourceRec res[RESOURCE_CHUNK];
+} ResourceChunkRec, *ResourceChunkPtr;
+
 typedef struct _ClientResource {
-    ResourcePtr *resources;
-    int elements;
-    int buckets;
-    int hashsize;               /* log(2)(buckets) */
+    ResourcePtr slots;
+    int size;                   /* slots, 0 if the client is not in use */
+    int hashsize;               /* log(2)(size) */
+    unsigned int removals;      /* bumped whenever a resource is removed */
+    int used;                   /* slots that are not empty */
+    int generation;             /* bumped whenever the slots move */
+    int walking;                /* walks over the slots under way */
+    ResourceChunkPtr chunks;    /* chained resources come from these */
+    ResourcePtr freeList;
     XID fakeID;
     XID endFakeID;
 } ClientResourceRec;
 
+static inline Bool
+SlotInUse(ResourcePtr slot)
+{
+    return slot->next && slot->next != DELETED_SLOT;
+}
+
+static inline ResourcePtr
+NextResource(ResourcePtr res)
+{
+    return res->next != END_OF_CHAIN ? res->next : NULL;
+}
+
 RESTYPE lastResourceType;
 static RESTYPE lastResourceClass;
 RESTYPE TypeMask;
@@ -632,7 +671,7 @@ ResourceClientBits(void)
 Bool
 InitClientResources(ClientPtr client)
 {
-    int i, j;
+    int i;
 
     if (client == serverClient) {
         lastResourceType = RT_LASTPREDEF;
@@ -644,13 +683,16 @@ InitClientResources(ClientPtr client)
             return FALSE;
         memcpy(resourceTypes, predefTypes, sizeof(predefTypes));
     }
-    clientTable[i = client->index].resources =
-        malloc(INITBUCKETS * sizeof(ResourcePtr));
-    if (!clientTable[i].resources)
+    clientTable[i = client->index].slots =
+        calloc(1 << INITHASHSIZE, sizeof(ResourceRec));
+    if (!clientTable[i].slots)
         return FALSE;
-    clientTable[i].buckets = INITBUCKETS;
-    clientTable[i].elements = 0;
+    clientTable[i].size = 1 << INITHASHSIZE;
     clientTable[i].hashsize = INITHASHSIZE;
+    clientTable[i].removals = 0;
+    clientTable[i].used = 0;
+    clientTable[i].chunks = NULL;
+    clientTable[i].freeList = NULL;
     /* Many IDs allocated from the server client are visible to clients,
      * so we don't use the SERVER_BIT for them, but we have to start
      * past the magic value constants used in the protocol.  For normal
@@ -659,9 +701,6 @@ InitClientResources(ClientPtr client)
     clientTable[i].fakeID = client->clientAsMask |
         (client->index ? SERVER_BIT : SERVER_MINID);
     clientTable[i].endFakeID = (clientTable[i].fakeID | RESOURCE_ID_MASK) + 1;
-    for (j = 0; j < INITBUCKETS; j++) {
-        clientTable[i].resources[j] = NULL;
-    }
     return TRUE;
 }
 
@@ -678,18 +717,108 @@ HashResourceID(XID id, int numBits)
     return (id ^ (id >> numBits)) & ~((~0) << numBits);
 }
 
+/*
+ * Slot at which probing for id starts.  Clients allocate IDs
+ * sequentially, which HashResourceID() would keep in one contiguous run
+ * of slots; with linear probing, every miss would walk all of it.  A
+ * multiplicative hash spreads them over the table instead.
+ */
+static inline int
+SlotHash(XID id, int hashsize)
+{
+    return ((CARD32) id * 0x9e3779b1u) >> (32 - hashsize);
+}
+
+/*
+ * Returns the slot holding the resources with the given id, or NULL.
+ */
+static ResourcePtr
+FindResourceSlot(ClientResourceRec *rrec, XID id)
+{
+    int mask = rrec->size - 1;
+    int i = SlotHash(id, rrec->hashsize);
+    ResourcePtr slot;
+
+    for (;; i = (i + 1) & mask) {
+        slot = &rrec->slots[i];
+        if (!slot->next)
+            return NULL;
+        if (slot->id == id && slot->next != DELETED_SLOT)
+            return slot;
+    }
+}
+
+static inline ResourcePtr
+LookupResource(XID id)
+{
+    int cid = CLIENT_ID(id);
+
+    if ((cid >= LimitClients) || !clientTable[cid].size)
+        return NULL;
+
+    return FindResourceSlot(&clientTable[cid], id);
+}
+
+static ResourcePtr
+AllocResource(ClientResourceRec *rrec)
+{
+    ResourcePtr res = rrec->freeList;
+    ResourceChunkPtr chunk;
+    int i;
+
+    if (res) {
+        rrec->freeList = res->next;
+        return res;
+    }
+
+    chunk = malloc(sizeof(ResourceChunkRec));
+    if (!chunk)
+        return NULL;
+    chunk->next = rrec->chunks;
+    rrec->chunks = chunk;
+    for (i = RESOURCE_CHUNK; --i > 0;) {
+        chunk->res[i].next = rrec->freeList;
+        rrec->freeList = &chunk->res[i];
+    }
+    return &chunk->res[0];
+}
+
+/*
+ * Takes res out of the table and copies it to *copy.  res is either slot
+ * itself or chained to it, after prev.
+ */
+static void
+RemoveResource(ClientResourceRec *rrec, ResourcePtr slot, ResourcePtr prev,
+               ResourcePtr res, ResourcePtr copy)
+{
+    ResourcePtr next = res->next;
+
+    *copy = *res;
+    if (res == slot) {
+        if (next == END_OF_CHAIN) {
+            slot->next = DELETED_SLOT;
+        }
+        else {
+            *slot = *next;
+            next->next = rrec->freeList;
+            rrec->freeList = next;
+        }
+    }
+    else {
+        prev->next = next;
+        res->next = rrec->freeList;
+        rrec->freeList = res;
+    }
+    rrec->removals++;
+}
+
 static XID
 AvailableID(int client, XID id, XID maxid, XID goodid)
 {
-    ResourcePtr res;
-
     if ((goodid >= id) && (goodid <= maxid))
         return goodid;
     for (; id <= maxid; id++) {
-        res = clientTable[client].resources[HashResourceID(id, clientTable[client].hashsize)];
-        while (res && (res->id != id))
-            res = res->next;
-        if (!res)
+        if (!FindResourceSlot(&clientTable[client], id))
             return id;
     }
     return 0;
@@ -699,8 +828,7 @@ void
 GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
 {
     XID id, maxid;
-    ResourcePtr *resp;
-    ResourcePtr res;
+    ResourcePtr slot;
     int i;
     XID goodid;
 
@@ -709,18 +837,20 @@ GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
         id |= client ? SERVER_BIT : SERVER_MINID;
     maxid = id | RESOURCE_ID_MASK;
     goodid = 0;
-    for (resp = clientTable[client].resources, i = clientTable[client].buckets;
-         --i >= 0;) {
-        for (res = *resp++; res; res = res->next) {
-            if ((res->id < id) || (res->id > maxid))
-                continue;
-            if (((res->id - id) >= (maxid - res->id)) ?
-                (goodid = AvailableID(client, id, res->id - 1, goodid)) :
-                !(goodid = AvailableID(client, res->id + 1, maxid, goodid)))
-                maxid = res->id - 1;
-            else
-                id = res->id + 1;
-        }
+    for (slot = clientTable[client].slots, i = clientTable[client].size;
+         --i >= 0; slot++) {
+        XID resid = slot->id;
+
+        if (!SlotInUse(slot))
+            continue;
+        if ((resid < id) || (resid > maxid))
+            continue;
+        if (((resid - id) >= (maxid - resid)) ?
+            (goodid = AvailableID(client, id, resid - 1, goodid)) :
+            !(goodid = AvailableID(client, resid + 1, maxid, goodid)))
+            maxid = resid - 1;
+        else
+            id = resid + 1;
     }
     if (id > maxid)
         id = maxid = 0;
@@ -798,77 +928,114 @@ AddResource(XID id, RESTYPE type, void *value)
 {
     int client;
     ClientResourceRec *rrec;
-    ResourcePtr res, *head;
+    ResourcePtr slot, freeSlot, res;
+    int i, mask;
 
 #ifdef XSERVER_DTRACE
     XSERVER_RESOURCE_ALLOC(id, type, value, TypeNameString(type));
 #endif
     client = CLIENT_ID(id);
     rrec = &clientTable[client];
-    if (!rrec->buckets) {
+    if (!rrec->size) {
         ErrorF("[dix] AddResource(%lx, %x, %lx), client=%d \n",
                (unsigned long) id, type, (unsigned long) value, client);
         FatalError("client not in use\n");
     }
-    if ((rrec->elements >= 4 * rrec->buckets) && (rrec->hashsize < MAXHASHSIZE))
-        RebuildTable(client);
-    head = &rrec->resources[HashResourceID(id, clientTable[client].hashsize)];
-    res = malloc(sizeof(ResourceRec));
-    if (!res) {
+    /* Keep the load below 3/4, and at least one slot empty.  During a
+     * walk the table is only rebuilt when it is full, as the walk has to
+     * start over then. */
+    if (((rrec->used + 1) * 4 > rrec->size * 3) &&
+        (!rrec->walking || rrec->used + 1 >= rrec->size) &&
+        !RebuildTable(client) && (rrec->used + 1 >= rrec->size)) {
         (*resourceTypes[type & TypeMask].deleteFunc) (value, id);
         return FALSE;
     }
-    res->next = *head;
-    res->id = id;
-    res->type = type;
-    res->value = value;
-    *head = res;
-    rrec->elements++;
-    CallResourceStateCallback(ResourceStateAdding, res);
+
+    mask = rrec->size - 1;
+    freeSlot = NULL;
+    for (i = SlotHash(id, rrec->hashsize);; i = (i + 1) & mask) {
+        slot = &rrec->slots[i];
+        if (!slot->next)
+            break;
+        if (slot->next == DELETED_SLOT) {
+            if (!freeSlot)
+                freeSlot = slot;
+        }
+        else if (slot->id == id)
+            break;
+    }
+
+    if (slot->next) {
+        /* The newest resource goes into the slot, the others follow */
+        res = AllocResource(rrec);
+        if (!res) {
+            (*resourceTypes[type & TypeMask].deleteFunc) (value, id);
+            return FALSE;
+        }
+        *res = *slot;
+        slot->next = res;
+    }
+    else {
+        if (freeSlot)
+            slot = freeSlot;
+        else
+            rrec->used++;
+        slot->next = END_OF_CHAIN;
+    }
+    slot->id = id;
+    slot->type = type;
+    slot->value = value;
+    CallResourceStateCallback(ResourceStateAdding, slot);
     return TRUE;
 }
 
-static void
+/*
+ * Rehashes the slots of client, dropping deleted ones, and doubles the
+ * table if it would still be more than half full.
+ */
+static Bool
 RebuildTable(int client)
 {
-    int j;
-    ResourcePtr res, next;
-    ResourcePtr **tails, *resources;
-    ResourcePtr **tptr, *rptr;
-
-    /*
-     * For now, preserve insertion order, since some ddx layers depend
-     * on resources being free in the opposite order they are added.
-     */
-
-    j = 2 * clientTable[client].buckets;
-    tails =  xallocarray(j, sizeof(ResourcePtr *));
-    if (!tails)
-        return;
-    resources =  xallocarray(j, sizeof(ResourcePtr));
-    if (!resources) {
-        free(tails);
-        return;
-    }
-    for (rptr = resources, tptr = tails; --j >= 0; rptr++, tptr++) {
-        *rptr = NULL;
-        *tptr = rptr;
+    ClientResourceRec *rrec = &clientTable[client];
+    ResourcePtr slots;
+    int i, j, ids, size, hashsize;
+
+    ids = 0;
+    for (i = 0; i < rrec->size; i++)
+        if (SlotInUse(&rrec->slots[i]))
+            ids++;
+
+    size = rrec->size;
+    hashsize = rrec->hashsize;
+    while ((ids + 1) * 2 > size) {
+        size *= 2;
+        hashsize++;
     }
-    clientTable[client].hashsize++;
-    for (j = clientTable[client].buckets,
-         rptr = clientTable[client].resources; --j >= 0; rptr++) {
-        for (res = *rptr; res; res = next) {
-            next = res->next;
-            res->next = NULL;
-            tptr = &tails[HashResourceID(res->id, clientTable[client].hashsize)];
-            **tptr = res;
-            *tptr = &res->next;
-        }
+
+    slots = calloc(size, sizeof(ResourceRec));
+    if (!slots)
+        return FALSE;
+
+    /* Chains move as a whole, so resources sharing an ID are still
+     * freed in the opposite order they were added, which some ddx
+     * layers depend on.
+     */
+    for (i = 0; i < rrec->size; i++) {
+        if (!SlotInUse(&rrec->slots[i]))
+            continue;
+        j = SlotHash(rrec->slots[i].id, hashsize);
+        while (slots[j].next)
+            j = (j + 1) & (size - 1);
+        slots[j] = rrec->slots[i];
     }
-    free(tails);
-    clientTable[client].buckets *= 2;
-    free(clientTable[client].resources);
-    clientTable[client].resources = resources;
+
+    free(rrec->slots);
+    rrec->slots = slots;
+    rrec->size = size;
+    rrec->hashsize = hashsize;
+    rrec->used = ids;
+    rrec->generation++;
+    return TRUE;
 }
 
 static void
@@ -878,42 +1045,29 @@ doFreeResource(ResourcePtr res, Bool skip)
 
     if (!skip)
         resourceTypes[res->type & TypeMask].deleteFunc(res->value, res->id);
-
-    free(res);
 }
 
 void
 FreeResource(XID id, RESTYPE skipDeleteFuncType)
 {
     int cid;
-    ResourcePtr res;
-    ResourcePtr *prev, *head;
-    int *eltptr;
-    int elements;
-
-    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-        eltptr = &clientTable[cid].elements;
+    ClientResourceRec *rrec;
+    ResourcePtr slot;
+    ResourceRec res;
 
-        prev = head;
-        while ((res = *prev)) {
-            if (res->id == id) {
-                RESTYPE rtype = res->type;
+    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].size) {
+        rrec = &clientTable[cid];
 
+        /* The slot is looked up again every time, as the delete
+         * function may have changed the table */
+        while ((slot = FindResourceSlot(rrec, id))) {
 #ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(res->id, res->type,
-                                      res->value, TypeNameString(res->type));
+            XSERVER_RESOURCE_FREE(slot->id, slot->type,
+                                  slot->value, TypeNameString(slot->type));
 #endif
-                *prev = res->next;
-                elements = --*eltptr;
-
-                doFreeResource(res, rtype == skipDeleteFuncType);
+            RemoveResource(rrec, slot, NULL, slot, &res);
 
-                if (*eltptr != elements)
-                    prev = head;        /* prev may no longer be valid */
-            }
-            else
-                prev = &res->next;
+            doFreeResource(&res, res.type == skipDeleteFuncType);
         }
     }
 }
@@ -922,28 +1076,27 @@ void
 FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 {
     int cid;
-    ResourcePtr res;
-    ResourcePtr *prev, *head;
+    ClientResourceRec *rrec;
+    ResourcePtr slot, this, prev;
+    ResourceRec res;
 
-    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
+    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].size) {
+        rrec = &clientTable[cid];
+        slot = FindResourceSlot(rrec, id);
 
-        prev = head;
-        while ((res = *prev)) {
-            if (res->id == id && res->type == type) {
+        for (prev = NULL, this = slot; this; prev = this,
+             this = NextResource(this)) {
+            if (this->type == type) {
 #ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(res->id, res->type,
-                                      res->value, TypeNameString(res->type));
+                XSERVER_RESOURCE_FREE(this->id, this->type,
+                                      this->value, TypeNameString(this->type));
 #endif
-                *prev = res->next;
-                clientTable[cid].elements--;
+                RemoveResource(rrec, slot, prev, this, &res);
 
-                doFreeResource(res, skipFree);
+                doFreeResource(&res, skipFree);
 
                 break;
             }
-            else
-                prev = &res->next;
         }
     }
 }
@@ -957,52 +1110,57 @@ FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 Bool
 ChangeResourceValue(XID id, RESTYPE rtype, void *value)
 {
-    int cid;
     ResourcePtr res;
 
-    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if ((res->id == id) && (res->type == rtype)) {
-                res->value = value;
-                return TRUE;
-            }
-    }
+    for (res = LookupResource(id); res; res = NextResource(res))
+        if (res->type == rtype) {
+            res->value = value;
+            return TRUE;
+        }
     return FALSE;
 }
 
-/* Note: if func adds or deletes resources, then func can get called
- * more than once for some resources.  If func adds new resources,
- * func might or might not get called for them.  func cannot both
- * add and delete an equal number of resources!
+/* Note: if func deletes resources, then func can get called more than
+ * once for some resources.  If func adds new resources, func might or
+ * might not get called for them.
+ *
+ * The table is not rebuilt during a walk unless it fills up (see
+ * AddResource), which would take func adding a quarter as many
+ * resources as the table holds; the walk starts over then.
  */
 
 void
 FindClientResourcesByType(ClientPtr client,
                           RESTYPE type, FindResType func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourcePtr slot, this, next;
+    int i, generation;
+    unsigned int removals;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
+    rrec = &clientTable[client->index];
+    rrec->walking++;
+    for (i = 0; i < rrec->size; i++) {
+        slot = &rrec->slots[i];
+        for (this = SlotInUse(slot) ? slot : NULL; this; this = next) {
+            next = NextResource(this);
             if (!type || this->type == type) {
-                elements = *eltptr;
+                removals = rrec->removals;
+                generation = rrec->generation;
                 (*func) (this->value, this->id, cdata);
-                if (*eltptr != elements)
-                    next = resources[i];        /* start over */
+                if (rrec->generation != generation) {
+                    i = -1;     /* the table was rebuilt, start over */
+                    break;
+                }
+                if (rrec->removals != removals)
+                    next = SlotInUse(slot) ? slot : NULL;       /* start over */
             }
         }
     }
+    rrec->walking--;
 }
 
 void FindSubResources(void *resource,
@@ -1017,25 +1175,32 @@ void FindSubResources(void *resource,
 void
 FindAllClientResources(ClientPtr client, FindAllRes func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourcePtr slot, this, next;
+    int i, generation;
+    unsigned int removals;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
-            elements = *eltptr;
+    rrec = &clientTable[client->index];
+    rrec->walking++;
+    for (i = 0; i < rrec->size; i++) {
+        slot = &rrec->slots[i];
+        for (this = SlotInUse(slot) ? slot : NULL; this; this = next) {
+            next = NextResource(this);
+            removals = rrec->removals;
+            generation = rrec->generation;
             (*func) (this->value, this->id, this->type, cdata);
-            if (*eltptr != elements)
-                next = resources[i];    /* start over */
+            if (rrec->generation != generation) {
+                i = -1;         /* the table was rebuilt, start over */
+                break;
+            }
+            if (rrec->removals != removals)
+                next = SlotInUse(slot) ? slot : NULL;   /* start over */
         }
     }
+    rrec->walking--;
 }
 
 void *
@@ -1043,74 +1208,95 @@ LookupClientResourceComplex(ClientPtr client,
                             RESTYPE type,
                             FindComplexResType func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    void *value;
-    int i;
+    ClientResourceRec *rrec;
+    ResourcePtr slot, this, next;
+    void *value = NULL;
+    int i, generation;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
+    rrec = &clientTable[client->index];
+    rrec->walking++;
+    for (i = 0; i < rrec->size; i++) {
+        slot = &rrec->slots[i];
+        for (this = SlotInUse(slot) ? slot : NULL; this; this = next) {
+            next = NextResource(this);
             if (!type || this->type == type) {
                 /* workaround func freeing the type as DRI1 does */
                 value = this->value;
+                generation = rrec->generation;
                 if ((*func) (value, this->id, cdata))
-                    return value;
+                    goto found;
+                if (rrec->generation != generation) {
+                    i = -1;     /* the table was rebuilt, start over */
+                    break;
+                }
             }
         }
     }
-    return NULL;
+    value = NULL;
+found:
+    rrec->walking--;
+    return value;
 }
 
 void
 FreeClientNeverRetainResources(ClientPtr client)
 {
-    ResourcePtr *resources;
-    ResourcePtr this;
-    ResourcePtr *prev;
-    int j, elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourcePtr slot, this, prev;
+    ResourceRec res;
+    int j, generation;
+    unsigned int removals;
 
     if (!client)
         return;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (j = 0; j < clientTable[client->index].buckets; j++) {
-        prev = &resources[j];
-        while ((this = *prev)) {
-            RESTYPE rtype = this->type;
-
-            if (rtype & RC_NEVERRETAIN) {
+    rrec = &clientTable[client->index];
+    rrec->walking++;
+    for (j = 0; j < rrec->size; j++) {
+        slot = &rrec->slots[j];
+        prev = NULL;
+        this = SlotInUse(slot) ? slot : NULL;
+        while (this) {
+            if (this->type & RC_NEVERRETAIN) {
 #ifdef XSERVER_DTRACE
                 XSERVER_RESOURCE_FREE(this->id, this->type,
                                       this->value, TypeNameString(this->type));
 #endif
-                *prev = this->next;
-                clientTable[client->index].elements--;
-                elements = *eltptr;
-
-                doFreeResource(this, FALSE);
-
-                if (*eltptr != elements)
-                    prev = &resources[j];       /* prev may no longer be valid */
+                RemoveResource(rrec, slot, prev, this, &res);
+                removals = rrec->removals;
+                generation = rrec->generation;
+
+                doFreeResource(&res, FALSE);
+
+                if (rrec->generation != generation) {
+                    j = -1;     /* the table was rebuilt, start over */
+                    break;
+                }
+                if (rrec->removals != removals)
+                    prev = NULL;        /* prev may no longer be valid */
+                this = prev ? NextResource(prev) :
+                    SlotInUse(slot) ? slot : NULL;
+            }
+            else {
+                prev = this;
+                this = NextResource(this);
             }
-            else
-                prev = &this->next;
         }
     }
+    rrec->walking--;
 }
 
 void
 FreeClientResources(ClientPtr client)
 {
-    ResourcePtr *resources;
-    ResourcePtr this;
-    int j;
+    ClientResourceRec *rrec;
+    ResourcePtr slot;
+    ResourceRec res;
+    ResourceChunkPtr chunk, next;
+    int j, generation;
 
     /* This routine shouldn't be called with a null client, but just in
        case ... */
@@ -1120,35 +1306,45 @@ FreeClientResources(ClientPtr client)
 
     HandleSaveSet(client);
 
-    resources = clientTable[client->index].resources;
-    for (j = 0; j < clientTable[client->index].buckets; j++) {
-        /* It may seem silly to update the head of this resource list as
-           we delete the members, since the entire list will be deleted any way,
-           but there are some resource deletion functions "FreeClientPixels" for
-           one which do a LookupID on another resource id (a Colormap id in this
-           case), so the resource list must be kept valid up to the point that
-           it is deleted, so every time we delete a resource, we must update the
-           head, just like in FreeResource. I hope that this doesn't slow down
-           mass deletion appreciably. PRH */
+    rrec = &clientTable[client->index];
+    rrec->walking++;
+    for (j = 0; j < rrec->size; j++) {
+        /* It may seem silly to take each resource out of the table as we
+           delete it, since the entire table will be deleted any way, but
+           there are some resource deletion functions "FreeClientPixels"
+           for one which do a LookupID on another resource id (a Colormap
+           id in this case), so the table must be kept valid up to the
+           point that it is deleted. PRH */
 
-        ResourcePtr *head;
+        slot = &rrec->slots[j];
+        generation = rrec->generation;
 
-        head = &resources[j];
-
-        for (this = *head; this; this = *head) {
+        while (SlotInUse(slot)) {
 #ifdef XSERVER_DTRACE
-            XSERVER_RESOURCE_FREE(this->id, this->type,
-                                  this->value, TypeNameString(this->type));
+            XSERVER_RESOURCE_FREE(slot->id, slot->type,
+                                  slot->value, TypeNameString(slot->type));
 #endif
-            *head = this->next;
-            clientTable[client->index].elements--;
+            RemoveResource(rrec, slot, NULL, slot, &res);
+
+            doFreeResource(&res, FALSE);
 
-            doFreeResource(this, FALSE);
+            if (rrec->generation != generation) {
+                j = -1;         /* the table was rebuilt, start over */
+                break;
+            }
         }
     }
-    free(clientTable[client->index].resources);
-    clientTable[client->index].resources = NULL;
-    clientTable[client->index].buckets = 0;
+    rrec->walking--;
+    free(rrec->slots);
+    rrec->slots = NULL;
+    rrec->size = 0;
+    rrec->used = 0;
+    for (chunk = rrec->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    rrec->chunks = NULL;
+    rrec->freeList = NULL;
 }
 
 void
@@ -1157,7 +1353,7 @@ FreeAllResources(void)
     int i;
 
     for (i = currentMaxClients; --i >= 0;) {
-        if (clientTable[i].buckets)
+        if (clientTable[i].size)
             FreeClientResources(clients[i]);
     }
 }
@@ -1191,20 +1387,16 @@ int
 dixLookupResourceByType(void **result, XID id, RESTYPE rtype,
                         ClientPtr client, Mask mode)
 {
-    int cid = CLIENT_ID(id);
-    ResourcePtr res = NULL;
+    int cid;
+    ResourcePtr res;
 
     *result = NULL;
     if ((rtype & TypeMask) > lastResourceType)
         return BadImplementation;
 
-    if ((cid < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if (res->id == id && res->type == rtype)
-                break;
-    }
+    for (res = LookupResource(id); res; res = NextResource(res))
+        if (res->type == rtype)
+            break;
     if (client) {
         client->errorValue = id;
     }
@@ -1228,18 +1420,14 @@ int
 dixLookupResourceByClass(void **result, XID id, RESTYPE rclass,
                          ClientPtr client, Mask mode)
 {
-    int cid = CLIENT_ID(id);
-    ResourcePtr res = NULL;
+    int cid;
+    ResourcePtr res;
 
     *result = NULL;
 
-    if ((cid < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if (res->id == id && (res->type & rclass))
-                break;
-    }
+    for (res = LookupResource(id); res; res = NextResource(res))
+        if (res->type & rclass)
+            break;
     if (client) {
         client->errorValue = id;
     }
@@ -282,6 +282,7 @@ _glamor_block_handler(ScreenPtr screen, void *timeout)
 
     glamor_make_current(glamor_priv);
     glFlush();
+    glamor_poll_readbacks(screen, timeout);
 
     screen->BlockHandler = glamor_priv->saved_procs.block_handler;
     screen->BlockHandler(screen, timeout);
@@ -465,6 +466,8 @@ glamor_init(ScreenPtr screen, unsigned int flags)
         return FALSE;
 
     glamor_priv->flags = flags;
+    glamor_init_fbo_cache(glamor_priv);
+    glamor_stats_init();
 
     if (!dixRegisterPrivateKey(&glamor_screen_private_key, PRIVATE_SCREEN, 0)) {
         LogMessage(X_WARNING,
@@ -612,8 +615,9 @@ glamor_init(ScreenPtr screen, unsigned int flags)
         goto fail;
     }
 
+    /* GLES 3 maps PBOs with glMapBufferRange, see glamor_prepare.c */
     glamor_priv->has_rw_pbo = FALSE;
-    if (glamor_priv->gl_flavor == GLAMOR_GL_DESKTOP)
+    if (glamor_priv->gl_flavor == GLAMOR_GL_DESKTOP || gl_version >= 30)
         glamor_priv->has_rw_pbo = TRUE;
 
     glamor_priv->has_khr_debug = epoxy_has_gl_extension("GL_KHR_debug");
@@ -625,7 +629,16 @@ glamor_init(ScreenPtr screen, unsigned int flags)
         epoxy_has_gl_extension("GL_ARB_map_buffer_range") ||
         epoxy_has_gl_extension("GL_EXT_map_buffer_range");
     glamor_priv->has_buffer_storage =
-        epoxy_has_gl_extension("GL_ARB_buffer_storage");
+        epoxy_has_gl_extension("GL_ARB_buffer_storage") ||
+        epoxy_has_gl_extension("GL_EXT_buffer_storage");
+    glamor_priv->has_upload_pbo =
+        glamor_priv->gl_flavor == GLAMOR_GL_DESKTOP ?
+        glamor_priv->has_map_buffer_range : gl_version >= 30;
+    glamor_priv->has_async_readback =
+        glamor_priv->gl_flavor == GLAMOR_GL_DESKTOP ?
+        glamor_priv->has_map_buffer_range &&
+        (gl_version >= 32 || epoxy_has_gl_extension("GL_ARB_sync")) :
+        gl_version >= 30;
     glamor_priv->has_mesa_tile_raster_order =
         epoxy_has_gl_extension("GL_MESA_tile_raster_order");
     glamor_priv->has_nv_texture_barrier =
@@ -679,6 +692,8 @@ glamor_init(ScreenPtr screen, unsigned int flags)
 
     glamor_set_debug_level(&glamor_debug_level);
 
+    glamor_init_program_cache(screen);
+
     if (!glamor_font_init(screen))
         goto fail;
 
@@ -731,7 +746,9 @@ glamor_init(ScreenPtr screen, unsigned int flags)
     ps->Glyphs = glamor_composite_glyphs;
 
     glamor_init_vbo(screen);
+    glamor_init_upload(screen);
     glamor_init_gradient_shader(screen);
+    glamor_init_readbacks(screen);
     glamor_pixmap_init(screen);
     glamor_sync_init(screen);
 
@@ -757,6 +774,7 @@ glamor_release_screen_priv(ScreenPtr screen)
 
     glamor_priv = glamor_get_screen_private(screen);
     glamor_fini_vbo(screen);
+    glamor_fini_upload(screen);
     glamor_pixmap_fini(screen);
     free(glamor_priv);
 
@@ -793,6 +811,9 @@ glamor_close_screen(ScreenPtr screen)
 
     screen_pixmap = screen->GetScreenPixmap(screen);
     glamor_pixmap_destroy_fbo(screen_pixmap);
+    glamor_fini_readbacks(screen);
+    glamor_fini_fbo_cache(glamor_priv);
+    glamor_fini_program_cache(glamor_priv);
 
     glamor_release_screen_priv(screen);
 
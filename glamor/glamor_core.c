@@ -78,6 +78,25 @@ glamor_compile_glsl_prog(GLenum type, const char *source)
     return prog;
 }
 
+/**
+ * Binds the attributes and fragment outputs of @prog ahead of linking
+ * it.  The same bindings key the program in the shader cache.
+ */
+void
+glamor_bind_glsl_prog(GLint prog, const glamor_glsl_bindings *bindings)
+{
+    if (bindings->position)
+        glBindAttribLocation(prog, GLAMOR_VERTEX_POS, bindings->position);
+    if (bindings->source)
+        glBindAttribLocation(prog, GLAMOR_VERTEX_SOURCE, bindings->source);
+    if (bindings->mask)
+        glBindAttribLocation(prog, GLAMOR_VERTEX_MASK, bindings->mask);
+    if (bindings->dual_blend) {
+        glBindFragDataLocationIndexed(prog, 0, 0, "color0");
+        glBindFragDataLocationIndexed(prog, 0, 1, "color1");
+    }
+}
+
 void
 glamor_link_glsl_prog(ScreenPtr screen, GLint prog, const char *format, ...)
 {
@@ -95,6 +114,11 @@ glamor_link_glsl_prog(ScreenPtr screen, GLint prog, const char *format, ...)
         va_end(va);
     }
 
+    /* Programs loaded by glamor_load_glsl_prog() are already linked */
+    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+    if (ok)
+        return;
+
     glLinkProgram(prog);
     glGetProgramiv(prog, GL_LINK_STATUS, &ok);
     if (!ok) {
@@ -39,6 +39,9 @@ extern void
 AbortServer(void)
     _X_NORETURN;
 
+extern void
+glamor_count_fallback(const char *op, const char *reason);
+
 #define GLAMOR_PANIC(_format_, ...)			\
   do {							\
     LogMessageVerb(X_NONE, 0, "Glamor Fatal Error"	\
@@ -65,6 +68,7 @@ AbortServer(void)
 
 #define glamor_fallback(_format_,...)			\
   do {							\
+    glamor_count_fallback(__FUNCTION__, _format_);	\
     if (glamor_debug_level >= GLAMOR_DEBUG_FALLBACK)	\
       __debug_output_message(_format_,			\
 			     "Glamor fallback",		\
@@ -30,9 +30,20 @@
 
 #include "glamor_priv.h"
 
-void
-glamor_destroy_fbo(glamor_screen_private *glamor_priv,
-                   glamor_pixmap_fbo *fbo)
+/*
+ * The FBOs of destroyed pixmaps are kept for a while and handed out
+ * again for pixmaps of the same size and format, which saves creating a
+ * texture and framebuffer object, expensive with many drivers, for every
+ * short lived pixmap.  Cached FBOs are dropped once they haven't been
+ * reused for GLAMOR_FBO_CACHE_EXPIRE milliseconds, and the oldest ones
+ * are dropped to keep the cache under GLAMOR_FBO_CACHE_MAX_BYTES.
+ */
+#define GLAMOR_FBO_CACHE_EXPIRE		1000
+#define GLAMOR_FBO_CACHE_MAX_BYTES	(32 * 1024 * 1024)
+
+static void
+glamor_delete_fbo(glamor_screen_private *glamor_priv,
+                  glamor_pixmap_fbo *fbo)
 {
     glamor_make_current(glamor_priv);
 
@@ -44,6 +55,174 @@ glamor_destroy_fbo(glamor_screen_private *glamor_priv,
     free(fbo);
 }
 
+static int
+glamor_fbo_cache_class(int size)
+{
+    int class = 0;
+
+    while (size > 1 && class < GLAMOR_FBO_CACHE_CLASSES - 1) {
+        size >>= 1;
+        class++;
+    }
+    return class;
+}
+
+static struct xorg_list *
+glamor_fbo_cache_bucket(glamor_screen_private *glamor_priv, int w, int h)
+{
+    return &glamor_priv->fbo_cache[glamor_fbo_cache_class(w)]
+        [glamor_fbo_cache_class(h)];
+}
+
+static size_t
+glamor_fbo_size(glamor_screen_private *glamor_priv, glamor_pixmap_fbo *fbo)
+{
+    int cpp = fbo->format == glamor_priv->one_channel_format ? 1 : 4;
+
+    return (size_t) fbo->width * fbo->height * cpp;
+}
+
+static void
+glamor_fbo_cache_remove(glamor_screen_private *glamor_priv,
+                        glamor_pixmap_fbo *fbo)
+{
+    xorg_list_del(&fbo->list);
+    xorg_list_del(&fbo->lru);
+    glamor_priv->fbo_cache_bytes -= glamor_fbo_size(glamor_priv, fbo);
+}
+
+/**
+ * Drops the cached FBOs that haven't been reused for a while, and runs
+ * again when the oldest remaining one is due.
+ */
+static CARD32
+glamor_fbo_expire(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    glamor_screen_private *glamor_priv = arg;
+    glamor_pixmap_fbo *fbo, *tmp;
+
+    xorg_list_for_each_entry_safe(fbo, tmp, &glamor_priv->fbo_cache_lru,
+                                  lru) {
+        INT32 age = now - fbo->cached;
+
+        if (age < GLAMOR_FBO_CACHE_EXPIRE)
+            return GLAMOR_FBO_CACHE_EXPIRE - age;
+        glamor_fbo_cache_remove(glamor_priv, fbo);
+        glamor_delete_fbo(glamor_priv, fbo);
+        glamor_priv->fbo_cache_stats.expirations++;
+    }
+    return 0;
+}
+
+static Bool
+glamor_fbo_cache_put(glamor_screen_private *glamor_priv,
+                     glamor_pixmap_fbo *fbo)
+{
+    size_t size = glamor_fbo_size(glamor_priv, fbo);
+
+    if (!fbo->cacheable || size > GLAMOR_FBO_CACHE_MAX_BYTES / 4)
+        return FALSE;
+
+    while (glamor_priv->fbo_cache_bytes + size > GLAMOR_FBO_CACHE_MAX_BYTES) {
+        glamor_pixmap_fbo *old =
+            xorg_list_first_entry(&glamor_priv->fbo_cache_lru,
+                                  glamor_pixmap_fbo, lru);
+
+        glamor_fbo_cache_remove(glamor_priv, old);
+        glamor_delete_fbo(glamor_priv, old);
+        glamor_priv->fbo_cache_stats.evictions++;
+    }
+
+    fbo->cached = GetTimeInMillis();
+    if (xorg_list_is_empty(&glamor_priv->fbo_cache_lru))
+        glamor_priv->fbo_cache_timer =
+            TimerSet(glamor_priv->fbo_cache_timer, 0,
+                     GLAMOR_FBO_CACHE_EXPIRE, glamor_fbo_expire, glamor_priv);
+    /* Most recently cached first, its memory is more likely to be warm */
+    xorg_list_add(&fbo->list,
+                  glamor_fbo_cache_bucket(glamor_priv, fbo->width,
+                                          fbo->height));
+    xorg_list_append(&fbo->lru, &glamor_priv->fbo_cache_lru);
+    glamor_priv->fbo_cache_bytes += size;
+    return TRUE;
+}
+
+static glamor_pixmap_fbo *
+glamor_fbo_cache_get(glamor_screen_private *glamor_priv,
+                     int w, int h, GLenum format)
+{
+    glamor_pixmap_fbo *fbo;
+
+    xorg_list_for_each_entry(fbo, glamor_fbo_cache_bucket(glamor_priv, w, h),
+                             list) {
+        if (fbo->width == w && fbo->height == h && fbo->format == format) {
+            glamor_fbo_cache_remove(glamor_priv, fbo);
+            glamor_priv->fbo_cache_stats.hits++;
+            return fbo;
+        }
+    }
+
+    glamor_priv->fbo_cache_stats.misses++;
+    return NULL;
+}
+
+static void
+glamor_purge_fbo_cache(glamor_screen_private *glamor_priv)
+{
+    glamor_pixmap_fbo *fbo, *tmp;
+
+    xorg_list_for_each_entry_safe(fbo, tmp, &glamor_priv->fbo_cache_lru,
+                                  lru) {
+        glamor_fbo_cache_remove(glamor_priv, fbo);
+        glamor_delete_fbo(glamor_priv, fbo);
+    }
+}
+
+void
+glamor_init_fbo_cache(glamor_screen_private *glamor_priv)
+{
+    int i, j;
+
+    for (i = 0; i < GLAMOR_FBO_CACHE_CLASSES; i++)
+        for (j = 0; j < GLAMOR_FBO_CACHE_CLASSES; j++)
+            xorg_list_init(&glamor_priv->fbo_cache[i][j]);
+    xorg_list_init(&glamor_priv->fbo_cache_lru);
+    glamor_priv->fbo_cache_bytes = 0;
+}
+
+void
+glamor_log_fbo_cache(glamor_screen_private *glamor_priv, int verb)
+{
+    unsigned long hits = glamor_priv->fbo_cache_stats.hits;
+    unsigned long lookups = hits + glamor_priv->fbo_cache_stats.misses;
+
+    if (lookups)
+        LogMessageVerb(X_INFO, verb,
+                       "glamor: FBO cache: %lu of %lu FBOs reused (%lu%%), "
+                       "%lu evicted, %lu expired, %zu bytes cached\n",
+                       hits, lookups, hits * 100 / lookups,
+                       glamor_priv->fbo_cache_stats.evictions,
+                       glamor_priv->fbo_cache_stats.expirations,
+                       glamor_priv->fbo_cache_bytes);
+}
+
+void
+glamor_fini_fbo_cache(glamor_screen_private *glamor_priv)
+{
+    glamor_log_fbo_cache(glamor_priv, 3);
+    glamor_purge_fbo_cache(glamor_priv);
+    TimerFree(glamor_priv->fbo_cache_timer);
+    glamor_priv->fbo_cache_timer = NULL;
+}
+
+void
+glamor_destroy_fbo(glamor_screen_private *glamor_priv,
+                   glamor_pixmap_fbo *fbo)
+{
+    if (!glamor_fbo_cache_put(glamor_priv, fbo))
+        glamor_delete_fbo(glamor_priv, fbo);
+}
+
 static int
 glamor_pixmap_ensure_fb(glamor_screen_private *glamor_priv,
                         glamor_pixmap_fbo *fbo)
@@ -158,12 +337,30 @@ glamor_pixmap_fbo *
 glamor_create_fbo(glamor_screen_private *glamor_priv,
                   int w, int h, GLenum format, int flag)
 {
-    GLint tex = _glamor_create_tex(glamor_priv, w, h, format);
+    glamor_pixmap_fbo *fbo;
+    GLint tex;
+
+    fbo = glamor_fbo_cache_get(glamor_priv, w, h, format);
+    if (fbo) {
+        if (flag == GLAMOR_CREATE_FBO_NO_FBO || fbo->fb ||
+            glamor_pixmap_ensure_fb(glamor_priv, fbo) == 0)
+            return fbo;
+        glamor_delete_fbo(glamor_priv, fbo);
+    }
 
+    tex = _glamor_create_tex(glamor_priv, w, h, format);
+    if (!tex && !xorg_list_is_empty(&glamor_priv->fbo_cache_lru)) {
+        /* Give the memory held by the cache back and try again */
+        glamor_purge_fbo_cache(glamor_priv);
+        tex = _glamor_create_tex(glamor_priv, w, h, format);
+    }
     if (!tex) /* Texture creation failed due to GL_OUT_OF_MEMORY */
         return NULL;
 
-    return glamor_create_fbo_from_tex(glamor_priv, w, h, format, tex, flag);
+    fbo = glamor_create_fbo_from_tex(glamor_priv, w, h, format, tex, flag);
+    if (fbo)
+        fbo->cacheable = TRUE;
+    return fbo;
 }
 
 /**
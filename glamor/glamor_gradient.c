@@ -38,6 +38,11 @@
 #define RADIAL_SMALL_STOPS (6 + 2)
 #define RADIAL_LARGE_STOPS (16 + 2)
 
+static const glamor_glsl_bindings gradient_bindings = {
+    .position = "v_position",
+    .source = "v_texcoord",
+};
+
 static char *
 _glamor_create_getcolor_fs_source(ScreenPtr screen, int stops_count,
                                   int use_array)
@@ -187,6 +192,7 @@ _glamor_create_radial_gradient_program(ScreenPtr screen, int stops_count,
     GLint gradient_prog = 0;
     char *gradient_fs = NULL;
     GLint fs_prog, vs_prog;
+    Bool cached;
 
     const char *gradient_vs =
         GLAMOR_DEFAULT_PRECISION
@@ -326,10 +332,6 @@ _glamor_create_radial_gradient_program(ScreenPtr screen, int stops_count,
         glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][2] = 0;
     }
 
-    gradient_prog = glCreateProgram();
-
-    vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, gradient_vs);
-
     fs_getcolor_source =
         _glamor_create_getcolor_fs_source(screen, stops_count,
                                           (stops_count > 0));
@@ -340,21 +342,30 @@ _glamor_create_radial_gradient_program(ScreenPtr screen, int stops_count,
                 PIXMAN_REPEAT_REFLECT,
                 fs_getcolor_source);
 
-    fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, gradient_fs);
+    gradient_prog = glCreateProgram();
+    cached = glamor_load_glsl_prog(screen, gradient_prog,
+                                   gradient_vs, gradient_fs,
+                                   &gradient_bindings);
+    if (!cached) {
+        vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, gradient_vs);
+        fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, gradient_fs);
+
+        glAttachShader(gradient_prog, vs_prog);
+        glAttachShader(gradient_prog, fs_prog);
+        glDeleteShader(vs_prog);
+        glDeleteShader(fs_prog);
+
+        glamor_bind_glsl_prog(gradient_prog, &gradient_bindings);
+    }
+
+    glamor_link_glsl_prog(screen, gradient_prog, "radial gradient");
 
+    if (!cached)
+        glamor_save_glsl_prog(screen, gradient_prog, gradient_vs, gradient_fs,
+                              &gradient_bindings);
     free(gradient_fs);
     free(fs_getcolor_source);
 
-    glAttachShader(gradient_prog, vs_prog);
-    glAttachShader(gradient_prog, fs_prog);
-    glDeleteShader(vs_prog);
-    glDeleteShader(fs_prog);
-
-    glBindAttribLocation(gradient_prog, GLAMOR_VERTEX_POS, "v_position");
-    glBindAttribLocation(gradient_prog, GLAMOR_VERTEX_SOURCE, "v_texcoord");
-
-    glamor_link_glsl_prog(screen, gradient_prog, "radial gradient");
-
     if (dyn_gen) {
         index = 2;
         glamor_priv->radial_max_nstops = stops_count;
@@ -379,6 +390,7 @@ _glamor_create_linear_gradient_program(ScreenPtr screen, int stops_count,
     GLint gradient_prog = 0;
     char *gradient_fs = NULL;
     GLint fs_prog, vs_prog;
+    Bool cached;
 
     const char *gradient_vs =
         GLAMOR_DEFAULT_PRECISION
@@ -509,10 +521,6 @@ _glamor_create_linear_gradient_program(ScreenPtr screen, int stops_count,
         glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][2] = 0;
     }
 
-    gradient_prog = glCreateProgram();
-
-    vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, gradient_vs);
-
     fs_getcolor_source =
         _glamor_create_getcolor_fs_source(screen, stops_count, stops_count > 0);
 
@@ -521,20 +529,30 @@ _glamor_create_linear_gradient_program(ScreenPtr screen, int stops_count,
                 PIXMAN_REPEAT_NORMAL, PIXMAN_REPEAT_REFLECT,
                 fs_getcolor_source);
 
-    fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, gradient_fs);
-    free(gradient_fs);
-    free(fs_getcolor_source);
-
-    glAttachShader(gradient_prog, vs_prog);
-    glAttachShader(gradient_prog, fs_prog);
-    glDeleteShader(vs_prog);
-    glDeleteShader(fs_prog);
-
-    glBindAttribLocation(gradient_prog, GLAMOR_VERTEX_POS, "v_position");
-    glBindAttribLocation(gradient_prog, GLAMOR_VERTEX_SOURCE, "v_texcoord");
+    gradient_prog = glCreateProgram();
+    cached = glamor_load_glsl_prog(screen, gradient_prog,
+                                   gradient_vs, gradient_fs,
+                                   &gradient_bindings);
+    if (!cached) {
+        vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, gradient_vs);
+        fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, gradient_fs);
+
+        glAttachShader(gradient_prog, vs_prog);
+        glAttachShader(gradient_prog, fs_prog);
+        glDeleteShader(vs_prog);
+        glDeleteShader(fs_prog);
+
+        glamor_bind_glsl_prog(gradient_prog, &gradient_bindings);
+    }
 
     glamor_link_glsl_prog(screen, gradient_prog, "linear gradient");
 
+    if (!cached)
+        glamor_save_glsl_prog(screen, gradient_prog, gradient_vs, gradient_fs,
+                              &gradient_bindings);
+    free(gradient_fs);
+    free(fs_getcolor_source);
+
     if (dyn_gen) {
         index = 2;
         glamor_priv->linear_max_nstops = stops_count;
@@ -102,6 +102,312 @@ glamor_put_image(DrawablePtr drawable, GCPtr gc, int depth, int x, int y,
     glamor_put_image_bail(drawable, gc, depth, x, y, w, h, leftPad, format, bits);
 }
 
+/*
+ * Asynchronous GetImage.
+ *
+ * Reading an image back with glReadPixels stalls the server until the
+ * GPU has caught up.  Instead, GetImage and ShmGetImage of a large
+ * enough area first read the image into a PBO with a fence behind it,
+ * and the client sleeps while the server serves the others.  The block
+ * handler wakes the client once the fence has signalled, the request is
+ * executed again, and glamor_get_image() copies the image out of the
+ * PBO without waiting for the GPU.  A readback that the request didn't
+ * use when it ran again, say because the window went away meanwhile, is
+ * freed by the next block handler.  The PBO of the last readback freed
+ * is kept for the next one.
+ */
+
+/* Below this, a synchronous read costs less than the extra wakeup */
+#define GLAMOR_READBACK_MIN_BYTES	(16 * 1024)
+
+struct glamor_readback {
+    struct xorg_list link;
+    ClientPtr client;
+    /** the client's sequence number until the request runs again */
+    int sequence;
+    PixmapPtr pixmap;
+    /** the area read, in pixmap coordinates */
+    BoxRec box;
+    uint32_t stride;
+    GLuint pbo;
+    size_t size;
+    GLsync fence;
+    Bool ready;
+    uint8_t *map;
+};
+
+static void
+glamor_free_readback(glamor_screen_private *glamor_priv,
+                     struct glamor_readback *readback)
+{
+    if (glamor_priv->readback_active == readback)
+        glamor_priv->readback_active = NULL;
+    xorg_list_del(&readback->link);
+
+    glamor_make_current(glamor_priv);
+    glDeleteSync(readback->fence);
+    if (readback->map) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    if (readback->size > glamor_priv->readback_pbo_size) {
+        glDeleteBuffers(1, &glamor_priv->readback_pbo);
+        glamor_priv->readback_pbo = readback->pbo;
+        glamor_priv->readback_pbo_size = readback->size;
+    }
+    else
+        glDeleteBuffers(1, &readback->pbo);
+    dixDestroyPixmap(readback->pixmap, 0);
+    free(readback);
+}
+
+static Bool
+glamor_readback_wakeup(ClientPtr client, void *closure)
+{
+    ClientWakeup(client);
+    return TRUE;
+}
+
+static Bool
+glamor_start_get_image(DrawablePtr drawable, int x, int y, int w, int h,
+                       unsigned int format, unsigned long plane_mask,
+                       ClientPtr client)
+{
+    ScreenPtr screen = drawable->pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
+    glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
+    uint32_t stride = PixmapBytePad(w, drawable->depth);
+    size_t size = (size_t) stride * h;
+    struct glamor_readback *readback, *tmp;
+    int off_x, off_y;
+    BoxRec box;
+    Bool ret;
+
+    glamor_get_drawable_deltas(drawable, pixmap, &off_x, &off_y);
+    box.x1 = x;
+    box.x2 = x + w;
+    box.y1 = y;
+    box.y2 = y + h;
+
+    /* Back from sleep: hand the data to the glamor_get_image() calls
+     * that are about to follow */
+    glamor_priv->readback_active = NULL;
+    xorg_list_for_each_entry_safe(readback, tmp, &glamor_priv->readbacks,
+                                  link) {
+        if (readback->client != client)
+            continue;
+        if (readback->ready && readback->pixmap == pixmap &&
+            readback->stride == stride &&
+            readback->box.x1 == box.x1 + drawable->x + off_x &&
+            readback->box.y1 == box.y1 + drawable->y + off_y &&
+            readback->box.x2 == box.x2 + drawable->x + off_x &&
+            readback->box.y2 == box.y2 + drawable->y + off_y) {
+            glamor_priv->readback_active = readback;
+            return FALSE;
+        }
+        glamor_free_readback(glamor_priv, readback);
+    }
+
+    if (format != ZPixmap ||
+        !GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv) ||
+        size < GLAMOR_READBACK_MIN_BYTES)
+        goto chain;
+
+    readback = calloc(1, sizeof(*readback));
+    if (!readback)
+        goto chain;
+
+    glamor_make_current(glamor_priv);
+    if (glamor_priv->readback_pbo_size >= size) {
+        readback->pbo = glamor_priv->readback_pbo;
+        readback->size = glamor_priv->readback_pbo_size;
+        glamor_priv->readback_pbo = 0;
+        glamor_priv->readback_pbo_size = 0;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+    }
+    else {
+        glGenBuffers(1, &readback->pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        if (glGetError() != GL_NO_ERROR) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            glDeleteBuffers(1, &readback->pbo);
+            free(readback);
+            goto chain;
+        }
+        readback->size = size;
+    }
+
+    glamor_download_boxes(pixmap, &box, 1,
+                          drawable->x + off_x, drawable->y + off_y,
+                          -x, -y, NULL, stride);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    readback->client = client;
+    readback->sequence = client->sequence - 1;
+    readback->pixmap = pixmap;
+    pixmap->refcnt++;
+    readback->box.x1 = box.x1 + drawable->x + off_x;
+    readback->box.y1 = box.y1 + drawable->y + off_y;
+    readback->box.x2 = box.x2 + drawable->x + off_x;
+    readback->box.y2 = box.y2 + drawable->y + off_y;
+    readback->stride = stride;
+    xorg_list_append(&readback->link, &glamor_priv->readbacks);
+
+    if (!ClientSleep(client, glamor_readback_wakeup, readback)) {
+        glamor_free_readback(glamor_priv, readback);
+        goto chain;
+    }
+    return TRUE;
+
+chain:
+    if (!glamor_priv->saved_procs.start_get_image)
+        return FALSE;
+    screen->StartGetImage = glamor_priv->saved_procs.start_get_image;
+    ret = screen->StartGetImage(drawable, x, y, w, h, format, plane_mask,
+                                client);
+    glamor_priv->saved_procs.start_get_image = screen->StartGetImage;
+    screen->StartGetImage = glamor_start_get_image;
+    return ret;
+}
+
+/**
+ * Wakes up the clients whose images have arrived, and frees the images
+ * of those that ran the request again without using them.  Called from
+ * the block handler.
+ */
+void
+glamor_poll_readbacks(ScreenPtr screen, void *timeout)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    struct glamor_readback *readback, *tmp;
+
+    /* The request that started using it is done */
+    glamor_priv->readback_active = NULL;
+
+    xorg_list_for_each_entry_safe(readback, tmp, &glamor_priv->readbacks,
+                                  link) {
+        if (readback->ready) {
+            if (readback->client->sequence != readback->sequence)
+                glamor_free_readback(glamor_priv, readback);
+            continue;
+        }
+        if (glClientWaitSync(readback->fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            AdjustWaitForDelay(timeout, 1);
+            continue;
+        }
+        readback->ready = TRUE;
+        ClientSignal(readback->client);
+        AdjustWaitForDelay(timeout, 0);
+    }
+}
+
+/*
+ * Copies a band of the image from the readback started for the current
+ * request, if there is one that covers it.
+ */
+static Bool
+glamor_get_image_readback(PixmapPtr pixmap, BoxPtr box, char *d,
+                          uint32_t stride)
+{
+    ScreenPtr screen = pixmap->drawable.pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    struct glamor_readback *readback = glamor_priv->readback_active;
+    int y;
+
+    if (!readback || readback->pixmap != pixmap ||
+        readback->stride != stride ||
+        box->x1 != readback->box.x1 || box->x2 != readback->box.x2 ||
+        box->y1 < readback->box.y1 || box->y2 > readback->box.y2)
+        return FALSE;
+
+    if (!readback->map) {
+        glamor_make_current(glamor_priv);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+        readback->map = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                         stride * (readback->box.y2 -
+                                                   readback->box.y1),
+                                         GL_MAP_READ_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (!readback->map) {
+            glamor_free_readback(glamor_priv, readback);
+            return FALSE;
+        }
+    }
+
+    y = box->y1 - readback->box.y1;
+    memcpy(d, readback->map + y * stride, stride * (box->y2 - box->y1));
+
+    /* DoGetImage reads the image in bands, top to bottom */
+    if (box->y2 == readback->box.y2)
+        glamor_free_readback(glamor_priv, readback);
+    return TRUE;
+}
+
+static void
+glamor_readback_client_state(CallbackListPtr *pcbl, void *closure,
+                             void *data)
+{
+    glamor_screen_private *glamor_priv = closure;
+    NewClientInfoRec *clientinfo = data;
+    ClientPtr client = clientinfo->client;
+    struct glamor_readback *readback, *tmp;
+
+    if (client->clientState != ClientStateRetained &&
+        client->clientState != ClientStateGone)
+        return;
+
+    xorg_list_for_each_entry_safe(readback, tmp, &glamor_priv->readbacks,
+                                  link)
+        if (readback->client == client)
+            glamor_free_readback(glamor_priv, readback);
+}
+
+void
+glamor_init_readbacks(ScreenPtr screen)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+
+    xorg_list_init(&glamor_priv->readbacks);
+    if (!glamor_priv->has_async_readback)
+        return;
+
+    if (!AddCallback(&ClientStateCallback, glamor_readback_client_state,
+                     glamor_priv))
+        return;
+
+    glamor_priv->saved_procs.start_get_image = screen->StartGetImage;
+    screen->StartGetImage = glamor_start_get_image;
+}
+
+void
+glamor_fini_readbacks(ScreenPtr screen)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    struct glamor_readback *readback, *tmp;
+
+    if (screen->StartGetImage != glamor_start_get_image)
+        return;
+
+    screen->StartGetImage = glamor_priv->saved_procs.start_get_image;
+    DeleteCallback(&ClientStateCallback, glamor_readback_client_state,
+                   glamor_priv);
+
+    xorg_list_for_each_entry_safe(readback, tmp, &glamor_priv->readbacks,
+                                  link)
+        glamor_free_readback(glamor_priv, readback);
+
+    if (glamor_priv->readback_pbo) {
+        glDeleteBuffers(1, &glamor_priv->readback_pbo);
+        glamor_priv->readback_pbo = 0;
+        glamor_priv->readback_pbo_size = 0;
+    }
+}
+
 static Bool
 glamor_get_image_gl(DrawablePtr drawable, int x, int y, int w, int h,
                     unsigned int format, unsigned long plane_mask, char *d)
@@ -120,14 +426,20 @@ glamor_get_image_gl(DrawablePtr drawable, int x, int y, int w, int h,
         goto bail;
 
     glamor_get_drawable_deltas(drawable, pixmap, &off_x, &off_y);
-    box.x1 = x;
-    box.x2 = x + w;
-    box.y1 = y;
-    box.y2 = y + h;
-    glamor_download_boxes(pixmap, &box, 1,
-                          drawable->x + off_x, drawable->y + off_y,
-                          -x, -y,
-                          (uint8_t *) d, byte_stride);
+    box.x1 = drawable->x + off_x + x;
+    box.x2 = box.x1 + w;
+    box.y1 = drawable->y + off_y + y;
+    box.y2 = box.y1 + h;
+    if (!glamor_get_image_readback(pixmap, &box, d, byte_stride)) {
+        box.x1 = x;
+        box.x2 = x + w;
+        box.y1 = y;
+        box.y2 = y + h;
+        glamor_download_boxes(pixmap, &box, 1,
+                              drawable->x + off_x, drawable->y + off_y,
+                              -x, -y,
+                              (uint8_t *) d, byte_stride);
+    }
 
     if (!glamor_pm_is_solid(drawable->depth, plane_mask)) {
         FbStip pm = fbReplicatePixel(plane_mask, drawable->bitsPerPixel);
@@ -31,7 +31,8 @@
  */
 
 static Bool
-glamor_prep_pixmap_box(PixmapPtr pixmap, glamor_access_t access, BoxPtr box)
+glamor_prep_pixmap_box(PixmapPtr pixmap, glamor_access_t access, BoxPtr box,
+                       const char *op)
 {
     ScreenPtr                   screen = pixmap->drawable.pScreen;
     glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
@@ -117,14 +118,27 @@ glamor_prep_pixmap_box(PixmapPtr pixmap, glamor_access_t access, BoxPtr box)
                 return FALSE;
         }
         priv->map_access = access;
+        priv->prepare_op = op;
     }
 
+    glamor_count_transfer(op, FALSE, glamor_region_bytes(pixmap, &region));
     glamor_download_boxes(pixmap, RegionRects(&region), RegionNumRects(&region),
                           0, 0, 0, 0, pixmap->devPrivate.ptr, pixmap->devKind);
 
     RegionUninit(&region);
 
-    if (priv->pbo) {
+    if (priv->pbo && glamor_priv->gl_flavor == GLAMOR_GL_ES2) {
+        /* GLES 3 has no glMapBuffer */
+        gl_access = GL_MAP_READ_BIT;
+        if (priv->map_access == GLAMOR_ACCESS_RW)
+            gl_access |= GL_MAP_WRITE_BIT;
+
+        pixmap->devPrivate.ptr =
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                             pixmap->devKind * pixmap->drawable.height,
+                             gl_access);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    } else if (priv->pbo) {
         if (priv->map_access == GLAMOR_ACCESS_RW)
             gl_access = GL_READ_WRITE;
         else
@@ -161,6 +175,9 @@ glamor_fini_pixmap(PixmapPtr pixmap)
     }
 
     if (priv->map_access == GLAMOR_ACCESS_RW) {
+        glamor_count_transfer(priv->prepare_op, TRUE,
+                              glamor_region_bytes(pixmap,
+                                                  &priv->prepare_region));
         glamor_upload_boxes(pixmap,
                             RegionRects(&priv->prepare_region),
                             RegionNumRects(&priv->prepare_region),
@@ -182,7 +199,8 @@ glamor_fini_pixmap(PixmapPtr pixmap)
 }
 
 Bool
-glamor_prepare_access(DrawablePtr drawable, glamor_access_t access)
+glamor_prepare_access_op(DrawablePtr drawable, glamor_access_t access,
+                         const char *op)
 {
     PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
     BoxRec box;
@@ -194,12 +212,12 @@ glamor_prepare_access(DrawablePtr drawable, glamor_access_t access)
     box.x2 = box.x1 + drawable->width;
     box.y1 = drawable->y + off_y;
     box.y2 = box.y1 + drawable->height;
-    return glamor_prep_pixmap_box(pixmap, access, &box);
+    return glamor_prep_pixmap_box(pixmap, access, &box, op);
 }
 
 Bool
-glamor_prepare_access_box(DrawablePtr drawable, glamor_access_t access,
-                         int x, int y, int w, int h)
+glamor_prepare_access_box_op(DrawablePtr drawable, glamor_access_t access,
+                             int x, int y, int w, int h, const char *op)
 {
     PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
     BoxRec box;
@@ -210,7 +228,7 @@ glamor_prepare_access_box(DrawablePtr drawable, glamor_access_t access,
     box.x2 = box.x1 + w;
     box.y1 = drawable->y + y + off_y;
     box.y2 = box.y1 + h;
-    return glamor_prep_pixmap_box(pixmap, access, &box);
+    return glamor_prep_pixmap_box(pixmap, access, &box, op);
 }
 
 void
@@ -224,17 +242,20 @@ glamor_finish_access(DrawablePtr drawable)
  */
 
 Bool
-glamor_prepare_access_picture(PicturePtr picture, glamor_access_t access)
+glamor_prepare_access_picture_op(PicturePtr picture, glamor_access_t access,
+                                 const char *op)
 {
     if (!picture || !picture->pDrawable)
         return TRUE;
 
-    return glamor_prepare_access(picture->pDrawable, access);
+    return glamor_prepare_access_op(picture->pDrawable, access, op);
 }
 
 Bool
-glamor_prepare_access_picture_box(PicturePtr picture, glamor_access_t access,
-                        int x, int y, int w, int h)
+glamor_prepare_access_picture_box_op(PicturePtr picture,
+                                     glamor_access_t access,
+                                     int x, int y, int w, int h,
+                                     const char *op)
 {
     if (!picture || !picture->pDrawable)
         return TRUE;
@@ -246,13 +267,13 @@ glamor_prepare_access_picture_box(PicturePtr picture, glamor_access_t access,
      * pixmaps at all.
      */
     if (picture->transform) {
-        return glamor_prepare_access_box(picture->pDrawable, access,
-                                         0, 0,
-                                         picture->pDrawable->width,
-                                         picture->pDrawable->height);
+        return glamor_prepare_access_box_op(picture->pDrawable, access,
+                                            0, 0,
+                                            picture->pDrawable->width,
+                                            picture->pDrawable->height, op);
     } else {
-        return glamor_prepare_access_box(picture->pDrawable, access,
-                                         x, y, w, h);
+        return glamor_prepare_access_box_op(picture->pDrawable, access,
+                                            x, y, w, h, op);
     }
 }
 
@@ -272,15 +293,16 @@ glamor_finish_access_picture(PicturePtr picture)
  */
 
 Bool
-glamor_prepare_access_gc(GCPtr gc)
+glamor_prepare_access_gc_op(GCPtr gc, const char *op)
 {
     switch (gc->fillStyle) {
     case FillTiled:
-        return glamor_prepare_access(&gc->tile.pixmap->drawable,
-                                     GLAMOR_ACCESS_RO);
+        return glamor_prepare_access_op(&gc->tile.pixmap->drawable,
+                                        GLAMOR_ACCESS_RO, op);
     case FillStippled:
     case FillOpaqueStippled:
-        return glamor_prepare_access(&gc->stipple->drawable, GLAMOR_ACCESS_RO);
+        return glamor_prepare_access_op(&gc->stipple->drawable,
+                                        GLAMOR_ACCESS_RO, op);
     }
     return TRUE;
 }
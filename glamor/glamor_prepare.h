@@ -23,28 +23,48 @@
 #ifndef _GLAMOR_PREPARE_H_
 #define _GLAMOR_PREPARE_H_
 
+/*
+ * The glamor_prepare_access*() calls pass the name of the function they
+ * are made from, which the transfers they cause are accounted to.
+ */
+
 Bool
-glamor_prepare_access(DrawablePtr drawable, glamor_access_t access);
+glamor_prepare_access_op(DrawablePtr drawable, glamor_access_t access,
+                         const char *op);
+#define glamor_prepare_access(drawable, access) \
+    glamor_prepare_access_op(drawable, access, __func__)
 
 Bool
-glamor_prepare_access_box(DrawablePtr drawable, glamor_access_t access,
-                         int x, int y, int w, int h);
+glamor_prepare_access_box_op(DrawablePtr drawable, glamor_access_t access,
+                             int x, int y, int w, int h, const char *op);
+#define glamor_prepare_access_box(drawable, access, x, y, w, h) \
+    glamor_prepare_access_box_op(drawable, access, x, y, w, h, __func__)
 
 void
 glamor_finish_access(DrawablePtr drawable);
 
 Bool
-glamor_prepare_access_picture(PicturePtr picture, glamor_access_t access);
+glamor_prepare_access_picture_op(PicturePtr picture, glamor_access_t access,
+                                 const char *op);
+#define glamor_prepare_access_picture(picture, access) \
+    glamor_prepare_access_picture_op(picture, access, __func__)
 
 Bool
-glamor_prepare_access_picture_box(PicturePtr picture, glamor_access_t access,
-                        int x, int y, int w, int h);
+glamor_prepare_access_picture_box_op(PicturePtr picture,
+                                     glamor_access_t access,
+                                     int x, int y, int w, int h,
+                                     const char *op);
+#define glamor_prepare_access_picture_box(picture, access, x, y, w, h) \
+    glamor_prepare_access_picture_box_op(picture, access, x, y, w, h, \
+                                         __func__)
 
 void
 glamor_finish_access_picture(PicturePtr picture);
 
 Bool
-glamor_prepare_access_gc(GCPtr gc);
+glamor_prepare_access_gc_op(GCPtr gc, const char *op);
+#define glamor_prepare_access_gc(gc) \
+    glamor_prepare_access_gc_op(gc, __func__)
 
 void
 glamor_finish_access_gc(GCPtr gc);
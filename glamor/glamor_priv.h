@@ -145,6 +145,15 @@ enum glamor_vertex_type {
     GLAMOR_VERTEX_MASK
 };
 
+/* Attribute names bound to each glamor_vertex_type, NULL if unused */
+typedef struct glamor_glsl_bindings {
+    const char *position;
+    const char *source;
+    const char *mask;
+    /* Whether color0 and color1 feed dual source blending */
+    Bool dual_blend;
+} glamor_glsl_bindings;
+
 enum gradient_shader {
     SHADER_GRADIENT_LINEAR,
     SHADER_GRADIENT_RADIAL,
@@ -178,12 +187,19 @@ struct glamor_saved_procs {
     BitmapToRegionProcPtr bitmap_to_region;
     TrianglesProcPtr triangles;
     AddTrapsProcPtr addtraps;
+    StartGetImageProcPtr start_get_image;
 #if XSYNC
     SyncScreenFuncsRec sync_screen_funcs;
 #endif
     ScreenBlockHandlerProcPtr block_handler;
 };
 
+/* Size classes of cached FBOs in each dimension, by power of two */
+#define GLAMOR_FBO_CACHE_CLASSES 16
+
+/* Parts of the upload buffer fenced separately, see glamor_transfer.c */
+#define GLAMOR_UPLOAD_SEGMENTS 4
+
 typedef struct glamor_screen_private {
     enum glamor_gl_flavor gl_flavor;
     int glsl_version;
@@ -197,6 +213,7 @@ typedef struct glamor_screen_private {
     Bool has_pack_subimage;
     Bool has_unpack_subimage;
     Bool has_rw_pbo;
+    Bool has_async_readback;
     Bool use_quads;
     Bool has_dual_blend;
     Bool has_texture_swizzle;
@@ -261,6 +278,15 @@ typedef struct glamor_screen_private {
     char *vb;
     int vb_stride;
 
+    /** Pixel unpack buffer staging glamor_upload_boxes() */
+    Bool has_upload_pbo;
+    GLuint upload_pbo;
+    size_t upload_offset;
+    /** Persistent mapping of the upload buffer, with buffer storage */
+    char *upload_map;
+    int upload_segment;
+    GLsync upload_fences[GLAMOR_UPLOAD_SEGMENTS];
+
     /** Cached index buffer for translating GL_QUADS to triangles. */
     GLuint ib;
     /** Index buffer type: GL_UNSIGNED_SHORT or GL_UNSIGNED_INT */
@@ -291,6 +317,37 @@ typedef struct glamor_screen_private {
     Bool logged_any_fbo_allocation_failure;
     Bool logged_any_pbo_allocation_failure;
 
+    /* FBOs of destroyed pixmaps, kept for reuse. See glamor_fbo.c */
+    struct xorg_list fbo_cache[GLAMOR_FBO_CACHE_CLASSES]
+        [GLAMOR_FBO_CACHE_CLASSES];
+    /** All cached FBOs, least recently cached first */
+    struct xorg_list fbo_cache_lru;
+    size_t fbo_cache_bytes;
+    OsTimerPtr fbo_cache_timer;
+    struct {
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long evictions;
+        unsigned long expirations;
+    } fbo_cache_stats;
+
+    /* GetImage readbacks in flight. See glamor_image.c */
+    struct xorg_list readbacks;
+    struct glamor_readback *readback_active;
+    /** PBO of a finished readback, kept for the next one */
+    GLuint readback_pbo;
+    size_t readback_pbo_size;
+
+    /* Linked program binaries on disk. See glamor_program_cache.c */
+    int program_cache_fd;
+    struct glamor_program_binary *program_cache;
+    int program_cache_count;
+    struct {
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long stores;
+    } program_cache_stats;
+
     /* xv */
     glamor_program xv_prog;
 
@@ -319,6 +376,10 @@ typedef struct glamor_pixmap_fbo {
     int height; /**< height in pixels */
     GLenum format; /**< GL format used to create the texture. */
     GLenum type; /**< GL type used to create the texture. */
+    Bool cacheable; /**< tex was created by glamor and can be reused */
+    struct xorg_list list; /**< in the FBO cache, its size class */
+    struct xorg_list lru; /**< in the FBO cache, by age */
+    CARD32 cached; /**< when it was put in the FBO cache */
 } glamor_pixmap_fbo;
 
 typedef struct glamor_pixmap_clipped_regions {
@@ -341,6 +402,8 @@ typedef struct glamor_pixmap_private {
     GLuint pbo;
     RegionRec prepare_region;
     Bool prepared;
+    /** the function that prepared the access, see glamor_stats.c */
+    const char *prepare_op;
 #ifdef GLAMOR_HAS_GBM
     EGLImageKHR image;
     Bool used_modifiers;
@@ -538,6 +601,9 @@ glamor_pixmap_fbo *glamor_create_fbo(glamor_screen_private *glamor_priv, int w,
 void glamor_destroy_fbo(glamor_screen_private *glamor_priv,
                         glamor_pixmap_fbo *fbo);
 void glamor_pixmap_destroy_fbo(PixmapPtr pixmap);
+void glamor_init_fbo_cache(glamor_screen_private *glamor_priv);
+void glamor_log_fbo_cache(glamor_screen_private *glamor_priv, int verb);
+void glamor_fini_fbo_cache(glamor_screen_private *glamor_priv);
 Bool glamor_pixmap_fbo_fixup(ScreenPtr screen, PixmapPtr pixmap);
 void glamor_pixmap_clear_fbo(glamor_screen_private *glamor_priv, glamor_pixmap_fbo *fbo);
 
@@ -582,6 +648,7 @@ Bool glamor_get_drawable_location(const DrawablePtr drawable);
 void glamor_get_drawable_deltas(DrawablePtr drawable, PixmapPtr pixmap,
                                 int *x, int *y);
 GLint glamor_compile_glsl_prog(GLenum type, const char *source);
+void glamor_bind_glsl_prog(GLint prog, const glamor_glsl_bindings *bindings);
 void glamor_link_glsl_prog(ScreenPtr screen, GLint prog,
                            const char *format, ...) _X_ATTRIBUTE_PRINTF(3,4);
 void glamor_get_color_4f_from_pixel(PixmapPtr pixmap,
@@ -673,6 +740,10 @@ glamor_get_vbo_space(ScreenPtr screen, unsigned size, char **vbo_offset);
 void
 glamor_put_vbo_space(ScreenPtr screen);
 
+/* glamor_transfer.c */
+void glamor_init_upload(ScreenPtr screen);
+void glamor_fini_upload(ScreenPtr screen);
+
 /**
  * According to the flag,
  * if the flag is GLAMOR_CREATE_FBO_NO_FBO then just ensure
@@ -759,6 +830,10 @@ void
 glamor_get_image(DrawablePtr pDrawable, int x, int y, int w, int h,
                  unsigned int format, unsigned long planeMask, char *d);
 
+void glamor_init_readbacks(ScreenPtr screen);
+void glamor_poll_readbacks(ScreenPtr screen, void *timeout);
+void glamor_fini_readbacks(ScreenPtr screen);
+
 /* glamor_dash.c */
 Bool
 glamor_poly_lines_dash_gl(DrawablePtr drawable, GCPtr gc,
@@ -853,6 +928,25 @@ void
 glamor_solid_boxes(PixmapPtr pixmap,
                    BoxPtr box, int nbox, unsigned long fg_pixel);
 
+/* glamor_program_cache.c */
+void glamor_init_program_cache(ScreenPtr screen);
+void glamor_fini_program_cache(glamor_screen_private *glamor_priv);
+Bool glamor_load_glsl_prog(ScreenPtr screen, GLint prog,
+                           const char *vs_source, const char *fs_source,
+                           const glamor_glsl_bindings *bindings);
+void glamor_save_glsl_prog(ScreenPtr screen, GLint prog,
+                           const char *vs_source, const char *fs_source,
+                           const glamor_glsl_bindings *bindings);
+
+/* glamor_stats.c */
+void
+glamor_stats_init(void);
+
+void
+glamor_count_transfer(const char *op, Bool upload, size_t bytes);
+
+size_t
+glamor_region_bytes(PixmapPtr pixmap, RegionPtr region);
 
 /* glamor_xv */
 typedef struct {
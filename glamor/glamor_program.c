@@ -262,6 +262,8 @@ glamor_build_program(ScreenPtr          screen,
     char                        *fs_prog_string;
 
     GLint                       fs_prog, vs_prog;
+    glamor_glsl_bindings        bindings = { 0 };
+    Bool                        cached;
 
     if (!fill)
         fill = &facet_null_fill;
@@ -327,29 +329,34 @@ glamor_build_program(ScreenPtr          screen,
     prog->fill_use = fill->use;
     prog->fill_use_render = fill->use_render;
 
-    vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, vs_prog_string);
-    fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, fs_prog_string);
-    free(vs_prog_string);
-    free(fs_prog_string);
-    glAttachShader(prog->prog, vs_prog);
-    glDeleteShader(vs_prog);
-    glAttachShader(prog->prog, fs_prog);
-    glDeleteShader(fs_prog);
-    glBindAttribLocation(prog->prog, GLAMOR_VERTEX_POS, "primitive");
-
-    if (prim->source_name) {
+    bindings.position = "primitive";
+    bindings.source = prim->source_name;
+    bindings.dual_blend = prog->alpha == glamor_program_alpha_dual_blend;
+
+    cached = glamor_load_glsl_prog(screen, prog->prog,
+                                   vs_prog_string, fs_prog_string, &bindings);
+    if (!cached) {
+        vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, vs_prog_string);
+        fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, fs_prog_string);
+        glAttachShader(prog->prog, vs_prog);
+        glDeleteShader(vs_prog);
+        glAttachShader(prog->prog, fs_prog);
+        glDeleteShader(fs_prog);
 #if DBG
-        ErrorF("Bind GLAMOR_VERTEX_SOURCE to %s\n", prim->source_name);
+        if (prim->source_name)
+            ErrorF("Bind GLAMOR_VERTEX_SOURCE to %s\n", prim->source_name);
 #endif
-        glBindAttribLocation(prog->prog, GLAMOR_VERTEX_SOURCE, prim->source_name);
-    }
-    if (prog->alpha == glamor_program_alpha_dual_blend) {
-        glBindFragDataLocationIndexed(prog->prog, 0, 0, "color0");
-        glBindFragDataLocationIndexed(prog->prog, 0, 1, "color1");
+        glamor_bind_glsl_prog(prog->prog, &bindings);
     }
 
     glamor_link_glsl_prog(screen, prog->prog, "%s_%s", prim->name, fill->name);
 
+    if (!cached)
+        glamor_save_glsl_prog(screen, prog->prog,
+                              vs_prog_string, fs_prog_string, &bindings);
+    free(vs_prog_string);
+    free(fs_prog_string);
+
     prog->matrix_uniform = glamor_get_uniform(prog, glamor_program_location_none, "v_matrix");
     prog->fg_uniform = glamor_get_uniform(prog, glamor_program_location_fg, "fg");
     prog->bg_uniform = glamor_get_uniform(prog, glamor_program_location_bg, "bg");
@@ -0,0 +1,474 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * On-disk cache of linked GLSL programs.
+ *
+ * Shaders are built the first time they are needed, and compiling and
+ * linking them takes tens of milliseconds on some drivers.  When the
+ * driver supports program binaries, every program glamor links is
+ * appended to a file in the cache directory, keyed by hashes of its
+ * sources and attribute bindings, and later servers load the binary
+ * instead of compiling.
+ *
+ * The file starts with the vendor, renderer and version strings of the
+ * driver that wrote it, the server version and glamor's attribute
+ * locations, and is emptied when they don't match the current ones.
+ * The entries are indexed when the screen is initialized; their
+ * binaries are only read when a program is built.  A binary the driver
+ * refuses is compiled again and stored again, and the last entry for a
+ * key wins.
+ *
+ * The directory is $GLAMOR_SHADER_CACHE_DIR, or glamor under
+ * $XDG_CACHE_HOME or $HOME/.cache.  Setting GLAMOR_SHADER_CACHE_DIR to
+ * an empty string disables the cache, as does running with elevated
+ * privileges.
+ */
+
+#include "glamor_priv.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define GLAMOR_PROGRAM_CACHE_MAGIC	"GLAMORPB"
+#define GLAMOR_PROGRAM_CACHE_VERSION	2
+#define GLAMOR_PROGRAM_CACHE_FILE	"programs.bin"
+
+/* The file is started over when it grows past this */
+#define GLAMOR_PROGRAM_CACHE_MAX_SIZE	(16 * 1024 * 1024)
+
+typedef struct glamor_program_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t driver_length;
+    /* followed by driver_length bytes of driver strings */
+} glamor_program_cache_header;
+
+typedef struct glamor_program_binary_header {
+    uint64_t vs_hash;
+    uint64_t fs_hash;
+    uint64_t bindings_hash;
+    uint32_t vs_length;
+    uint32_t fs_length;
+    uint32_t format;
+    uint32_t length;
+    uint32_t checksum;
+    uint32_t pad;
+    /* followed by length bytes of program binary */
+} glamor_program_binary_header;
+
+struct glamor_program_binary {
+    glamor_program_binary_header header;
+    off_t offset;
+};
+
+#define GLAMOR_PROGRAM_HASH_INIT	0xcbf29ce484222325ull
+
+static uint64_t
+glamor_program_hash_add(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *p = data;
+
+    while (length--)
+        hash = (hash ^ *p++) * 0x100000001b3ull;
+    return hash;
+}
+
+static uint64_t
+glamor_program_hash(const void *data, size_t length)
+{
+    return glamor_program_hash_add(GLAMOR_PROGRAM_HASH_INIT, data, length);
+}
+
+static uint64_t
+glamor_program_hash_binding(uint64_t hash, const char *name, int location)
+{
+    if (!name)
+        name = "";
+    hash = glamor_program_hash_add(hash, name, strlen(name) + 1);
+    return glamor_program_hash_add(hash, &location, sizeof(location));
+}
+
+static void
+glamor_program_key(glamor_program_binary_header *header,
+                   const char *vs_source, const char *fs_source,
+                   const glamor_glsl_bindings *bindings)
+{
+    uint64_t hash = GLAMOR_PROGRAM_HASH_INIT;
+
+    memset(header, 0, sizeof(*header));
+    header->vs_length = strlen(vs_source);
+    header->fs_length = strlen(fs_source);
+    header->vs_hash = glamor_program_hash(vs_source, header->vs_length);
+    header->fs_hash = glamor_program_hash(fs_source, header->fs_length);
+
+    hash = glamor_program_hash_binding(hash, bindings->position,
+                                       GLAMOR_VERTEX_POS);
+    hash = glamor_program_hash_binding(hash, bindings->source,
+                                       GLAMOR_VERTEX_SOURCE);
+    hash = glamor_program_hash_binding(hash, bindings->mask,
+                                       GLAMOR_VERTEX_MASK);
+    header->bindings_hash =
+        glamor_program_hash_add(hash, &bindings->dual_blend,
+                                sizeof(bindings->dual_blend));
+}
+
+static Bool
+glamor_program_key_equal(const glamor_program_binary_header *a,
+                         const glamor_program_binary_header *b)
+{
+    return a->vs_hash == b->vs_hash && a->fs_hash == b->fs_hash &&
+        a->bindings_hash == b->bindings_hash &&
+        a->vs_length == b->vs_length && a->fs_length == b->fs_length;
+}
+
+static char *
+glamor_program_cache_dir(void)
+{
+    const char *dir, *base;
+    char *path = NULL;
+
+    /* Don't let the caller pick the files root writes, or the binaries */
+    if (PrivsElevated())
+        return NULL;
+
+    dir = getenv("GLAMOR_SHADER_CACHE_DIR");
+    if (dir)
+        return *dir ? strdup(dir) : NULL;
+
+    base = getenv("XDG_CACHE_HOME");
+    if (base && *base) {
+        if (asprintf(&path, "%s/glamor", base) < 0)
+            return NULL;
+    }
+    else {
+        base = getenv("HOME");
+        if (!base || !*base)
+            return NULL;
+        if (asprintf(&path, "%s/.cache", base) < 0)
+            return NULL;
+        mkdir(path, 0700);
+        free(path);
+        if (asprintf(&path, "%s/.cache/glamor", base) < 0)
+            return NULL;
+    }
+    return path;
+}
+
+static char *
+glamor_program_cache_driver(void)
+{
+    char *driver;
+
+    if (asprintf(&driver, "%s\n%s\n%s\n%s\n%d %d %d %d",
+                 (const char *) glGetString(GL_VENDOR),
+                 (const char *) glGetString(GL_RENDERER),
+                 (const char *) glGetString(GL_VERSION),
+                 (const char *) glGetString(GL_SHADING_LANGUAGE_VERSION),
+                 XORG_VERSION_CURRENT, GLAMOR_VERTEX_POS,
+                 GLAMOR_VERTEX_SOURCE, GLAMOR_VERTEX_MASK) < 0)
+        return NULL;
+    return driver;
+}
+
+/* Indexes the entry whose binary starts at @offset */
+static Bool
+glamor_program_cache_add(glamor_screen_private *glamor_priv,
+                         const glamor_program_binary_header *header,
+                         off_t offset)
+{
+    struct glamor_program_binary *program_cache;
+
+    program_cache = reallocarray(glamor_priv->program_cache,
+                                 glamor_priv->program_cache_count + 1,
+                                 sizeof(*program_cache));
+    if (!program_cache)
+        return FALSE;
+    glamor_priv->program_cache = program_cache;
+
+    program_cache[glamor_priv->program_cache_count].header = *header;
+    program_cache[glamor_priv->program_cache_count].offset = offset;
+    glamor_priv->program_cache_count++;
+    return TRUE;
+}
+
+/**
+ * Checks that the file was written by this driver and indexes its
+ * entries, or empties it.  Called with the file locked.
+ */
+static void
+glamor_program_cache_index(glamor_screen_private *glamor_priv,
+                           const char *driver)
+{
+    int fd = glamor_priv->program_cache_fd;
+    glamor_program_cache_header header;
+    uint32_t driver_length = strlen(driver);
+    char *file_driver = NULL;
+    struct stat st;
+    off_t offset;
+
+    if (fstat(fd, &st) < 0 || st.st_size > GLAMOR_PROGRAM_CACHE_MAX_SIZE)
+        goto reset;
+
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, GLAMOR_PROGRAM_CACHE_MAGIC, 8) != 0 ||
+        header.version != GLAMOR_PROGRAM_CACHE_VERSION ||
+        header.driver_length != driver_length)
+        goto reset;
+
+    file_driver = malloc(driver_length);
+    if (!file_driver ||
+        pread(fd, file_driver, driver_length, sizeof(header)) != driver_length ||
+        memcmp(file_driver, driver, driver_length) != 0)
+        goto reset;
+    free(file_driver);
+    file_driver = NULL;
+
+    offset = sizeof(header) + driver_length;
+    while (offset < st.st_size) {
+        glamor_program_binary_header binary;
+
+        if (pread(fd, &binary, sizeof(binary), offset) != sizeof(binary) ||
+            binary.length > st.st_size - offset - sizeof(binary))
+            break;
+
+        if (!glamor_program_cache_add(glamor_priv, &binary,
+                                      offset + sizeof(binary)))
+            return;
+        offset += sizeof(binary) + binary.length;
+    }
+
+    /* Drop whatever a server that died while writing left at the end */
+    if (offset < st.st_size && ftruncate(fd, offset) < 0)
+        goto reset;
+    return;
+
+reset:
+    free(file_driver);
+    glamor_priv->program_cache_count = 0;
+
+    memcpy(header.magic, GLAMOR_PROGRAM_CACHE_MAGIC, 8);
+    header.version = GLAMOR_PROGRAM_CACHE_VERSION;
+    header.driver_length = driver_length;
+    if (ftruncate(fd, 0) < 0 ||
+        pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        pwrite(fd, driver, driver_length, sizeof(header)) != driver_length) {
+        close(fd);
+        glamor_priv->program_cache_fd = -1;
+    }
+}
+
+void
+glamor_init_program_cache(ScreenPtr screen)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    GLint formats = 0;
+    char *dir, *path, *driver;
+    int fd;
+
+    glamor_priv->program_cache_fd = -1;
+
+    if (glamor_priv->gl_flavor == GLAMOR_GL_DESKTOP) {
+        if (epoxy_gl_version() < 41 &&
+            !epoxy_has_gl_extension("GL_ARB_get_program_binary"))
+            return;
+    }
+    else {
+        if (epoxy_gl_version() < 30 &&
+            !epoxy_has_gl_extension("GL_OES_get_program_binary"))
+            return;
+    }
+
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0)
+        return;
+
+    dir = glamor_program_cache_dir();
+    if (!dir)
+        return;
+    mkdir(dir, 0700);
+
+    if (asprintf(&path, "%s/" GLAMOR_PROGRAM_CACHE_FILE, dir) < 0)
+        path = NULL;
+    free(dir);
+    if (!path)
+        return;
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LogMessage(X_WARNING, "glamor: cannot open shader cache %s: %s\n",
+                   path, strerror(errno));
+        free(path);
+        return;
+    }
+
+    driver = glamor_program_cache_driver();
+    if (!driver) {
+        close(fd);
+        free(path);
+        return;
+    }
+
+    glamor_priv->program_cache_fd = fd;
+    flock(fd, LOCK_EX);
+    glamor_program_cache_index(glamor_priv, driver);
+    flock(fd, LOCK_UN);
+
+    LogMessageVerb(X_INFO, 3, "glamor: %d programs in shader cache %s\n",
+                   glamor_priv->program_cache_count, path);
+    free(driver);
+    free(path);
+}
+
+void
+glamor_fini_program_cache(glamor_screen_private *glamor_priv)
+{
+    if (glamor_priv->program_cache_fd < 0)
+        return;
+
+    LogMessageVerb(X_INFO, 3,
+                   "glamor: shader cache hits %lu misses %lu stores %lu\n",
+                   glamor_priv->program_cache_stats.hits,
+                   glamor_priv->program_cache_stats.misses,
+                   glamor_priv->program_cache_stats.stores);
+
+    close(glamor_priv->program_cache_fd);
+    glamor_priv->program_cache_fd = -1;
+    free(glamor_priv->program_cache);
+    glamor_priv->program_cache = NULL;
+    glamor_priv->program_cache_count = 0;
+}
+
+/**
+ * Loads the program built from @vs_source and @fs_source with @bindings
+ * into @prog from the cache.  On success @prog is linked; otherwise the
+ * caller compiles, binds and links it as usual, and then calls
+ * glamor_save_glsl_prog().
+ */
+Bool
+glamor_load_glsl_prog(ScreenPtr screen, GLint prog,
+                      const char *vs_source, const char *fs_source,
+                      const glamor_glsl_bindings *bindings)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    glamor_program_binary_header key;
+    struct glamor_program_binary *binary = NULL;
+    void *data;
+    GLint ok = 0;
+    int i;
+
+    if (glamor_priv->program_cache_fd < 0)
+        return FALSE;
+
+    glamor_program_key(&key, vs_source, fs_source, bindings);
+    for (i = glamor_priv->program_cache_count - 1; i >= 0; i--) {
+        if (glamor_program_key_equal(&glamor_priv->program_cache[i].header,
+                                     &key)) {
+            binary = &glamor_priv->program_cache[i];
+            break;
+        }
+    }
+    if (!binary)
+        goto miss;
+
+    data = malloc(binary->header.length);
+    if (!data)
+        goto miss;
+
+    if (pread(glamor_priv->program_cache_fd, data, binary->header.length,
+              binary->offset) == binary->header.length &&
+        (uint32_t) glamor_program_hash(data, binary->header.length) ==
+        binary->header.checksum) {
+        glProgramBinary(prog, binary->header.format, data,
+                        binary->header.length);
+        glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+    }
+    free(data);
+
+    if (ok) {
+        glamor_priv->program_cache_stats.hits++;
+        return TRUE;
+    }
+
+miss:
+    glamor_priv->program_cache_stats.misses++;
+    /* Some drivers only keep the binary of programs linked with this */
+    if (glamor_priv->gl_flavor == GLAMOR_GL_DESKTOP || epoxy_gl_version() >= 30)
+        glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    return FALSE;
+}
+
+/**
+ * Appends the binary of the freshly linked @prog to the cache, and to
+ * the index.
+ */
+void
+glamor_save_glsl_prog(ScreenPtr screen, GLint prog,
+                      const char *vs_source, const char *fs_source,
+                      const glamor_glsl_bindings *bindings)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    int fd = glamor_priv->program_cache_fd;
+    glamor_program_binary_header *header;
+    GLint length = 0;
+    GLenum format;
+    off_t offset;
+    size_t size;
+
+    if (fd < 0)
+        return;
+
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    size = sizeof(*header) + length;
+    header = malloc(size);
+    if (!header)
+        return;
+
+    glGetProgramBinary(prog, length, &length, &format, header + 1);
+    if (length > 0) {
+        glamor_program_key(header, vs_source, fs_source, bindings);
+        header->format = format;
+        header->length = length;
+        header->checksum = (uint32_t) glamor_program_hash(header + 1, length);
+        size = sizeof(*header) + length;
+
+        flock(fd, LOCK_EX);
+        offset = lseek(fd, 0, SEEK_END);
+        if (offset >= 0 && offset + size <= GLAMOR_PROGRAM_CACHE_MAX_SIZE) {
+            if (write(fd, header, size) == size) {
+                glamor_priv->program_cache_stats.stores++;
+                glamor_program_cache_add(glamor_priv, header,
+                                         offset + sizeof(*header));
+            }
+            else if (ftruncate(fd, offset) < 0)
+                ErrorF("glamor: cannot repair shader cache: %s\n",
+                       strerror(errno));
+        }
+        flock(fd, LOCK_UN);
+    }
+    free(header);
+}
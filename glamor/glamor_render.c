@@ -60,7 +60,7 @@ static struct blendinfo composite_op_info[] = {
 };
 
 #define RepeatFix			10
-static GLuint
+static char *
 glamor_create_composite_fs(struct shader_key *key)
 {
     const char *repeat_define =
@@ -231,7 +231,6 @@ glamor_create_composite_fs(struct shader_key *key)
     const char *header;
     const char *header_norm = "";
     const char *dest_swizzle;
-    GLuint prog;
 
     switch (key->source) {
     case SHADER_SOURCE_SOLID:
@@ -304,13 +303,10 @@ glamor_create_composite_fs(struct shader_key *key)
                 "%s%s%s%s%s%s%s", header, repeat_define, relocate_texture,
                 rel_sampler, source_fetch, mask_fetch, dest_swizzle, in);
 
-    prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, source);
-    free(source);
-
-    return prog;
+    return source;
 }
 
-static GLuint
+static char *
 glamor_create_composite_vs(struct shader_key *key)
 {
     const char *main_opening =
@@ -328,7 +324,6 @@ glamor_create_composite_vs(struct shader_key *key)
     const char *source_coords_setup = "";
     const char *mask_coords_setup = "";
     char *source;
-    GLuint prog;
 
     if (key->source != SHADER_SOURCE_SOLID)
         source_coords_setup = source_coords;
@@ -341,10 +336,7 @@ glamor_create_composite_vs(struct shader_key *key)
                 main_opening,
                 source_coords_setup, mask_coords_setup, main_closing);
 
-    prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, source);
-    free(source);
-
-    return prog;
+    return source;
 }
 
 static void
@@ -354,29 +346,36 @@ glamor_create_composite_shader(ScreenPtr screen, struct shader_key *key,
     GLuint vs, fs, prog;
     GLint source_sampler_uniform_location, mask_sampler_uniform_location;
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    char *vs_source, *fs_source;
+    glamor_glsl_bindings bindings = {
+        .position = "v_position",
+        .source = "v_texcoord0",
+        .mask = "v_texcoord1",
+    };
+    Bool cached;
 
     glamor_make_current(glamor_priv);
-    vs = glamor_create_composite_vs(key);
-    if (vs == 0)
-        return;
-    fs = glamor_create_composite_fs(key);
-    if (fs == 0)
-        return;
+    vs_source = glamor_create_composite_vs(key);
+    fs_source = glamor_create_composite_fs(key);
 
     prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-
-    glBindAttribLocation(prog, GLAMOR_VERTEX_POS, "v_position");
-    glBindAttribLocation(prog, GLAMOR_VERTEX_SOURCE, "v_texcoord0");
-    glBindAttribLocation(prog, GLAMOR_VERTEX_MASK, "v_texcoord1");
-
-    if (key->in == glamor_program_alpha_dual_blend) {
-        glBindFragDataLocationIndexed(prog, 0, 0, "color0");
-        glBindFragDataLocationIndexed(prog, 0, 1, "color1");
+    bindings.dual_blend = key->in == glamor_program_alpha_dual_blend;
+    cached = glamor_load_glsl_prog(screen, prog, vs_source, fs_source,
+                                   &bindings);
+    if (!cached) {
+        vs = glamor_compile_glsl_prog(GL_VERTEX_SHADER, vs_source);
+        fs = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, fs_source);
+        glAttachShader(prog, vs);
+        glAttachShader(prog, fs);
+        glamor_bind_glsl_prog(prog, &bindings);
     }
     glamor_link_glsl_prog(screen, prog, "composite");
 
+    if (!cached)
+        glamor_save_glsl_prog(screen, prog, vs_source, fs_source, &bindings);
+    free(vs_source);
+    free(fs_source);
+
     shader->prog = prog;
 
     glUseProgram(prog);
@@ -0,0 +1,215 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Software fallback statistics.
+ *
+ * Every glamor_fallback() is counted by the function and the reason it
+ * gives, and the pixels moved between the GPU and the CPU for fb are
+ * counted by the function that prepared the access (see
+ * glamor_prepare.h).  Both are kept in small tables keyed by the string
+ * literals, so counting is a hash and a few increments, and are written
+ * to the log with the request statistics on SIGUSR2.
+ */
+
+#include "glamor_priv.h"
+#include "reqstats.h"
+
+/* Power of two; what doesn't fit in the tables is counted as "other" */
+#define GLAMOR_STATS_SLOTS	128
+
+typedef struct glamor_op_stats {
+    const char *op;
+    unsigned long fallbacks;
+    unsigned long downloads;
+    unsigned long uploads;
+    CARD64 bytes_down;
+    CARD64 bytes_up;
+} glamor_op_stats;
+
+typedef struct glamor_reason_stats {
+    const char *op;
+    const char *reason;
+    unsigned long count;
+} glamor_reason_stats;
+
+static glamor_op_stats op_stats[GLAMOR_STATS_SLOTS];
+static glamor_op_stats op_other = { .op = "other" };
+
+static glamor_reason_stats reason_stats[GLAMOR_STATS_SLOTS];
+static glamor_reason_stats reason_other = { .op = "other", .reason = "" };
+
+static unsigned long glamor_stats_generation;
+
+static unsigned int
+glamor_stats_hash(const void *a, const void *b)
+{
+    uintptr_t key = (uintptr_t) a ^ ((uintptr_t) b >> 4);
+
+    return ((key >> 3) * 2654435761u) & (GLAMOR_STATS_SLOTS - 1);
+}
+
+static glamor_op_stats *
+glamor_lookup_op(const char *op)
+{
+    unsigned int i, slot = glamor_stats_hash(op, NULL);
+
+    for (i = 0; i < GLAMOR_STATS_SLOTS; i++) {
+        glamor_op_stats *stats =
+            &op_stats[(slot + i) & (GLAMOR_STATS_SLOTS - 1)];
+
+        if (stats->op == op)
+            return stats;
+        if (!stats->op) {
+            stats->op = op;
+            return stats;
+        }
+    }
+    return &op_other;
+}
+
+void
+glamor_count_fallback(const char *op, const char *reason)
+{
+    unsigned int i, slot = glamor_stats_hash(op, reason);
+
+    for (i = 0; i < GLAMOR_STATS_SLOTS; i++) {
+        glamor_reason_stats *stats =
+            &reason_stats[(slot + i) & (GLAMOR_STATS_SLOTS - 1)];
+
+        if (stats->reason == reason && stats->op == op) {
+            stats->count++;
+            return;
+        }
+        if (!stats->reason) {
+            stats->op = op;
+            stats->reason = reason;
+            stats->count = 1;
+            return;
+        }
+    }
+    reason_other.count++;
+}
+
+/**
+ * Accounts @bytes downloaded for, or uploaded after, a software fallback
+ * in @op.
+ */
+void
+glamor_count_transfer(const char *op, Bool upload, size_t bytes)
+{
+    glamor_op_stats *stats;
+
+    if (!bytes)
+        return;
+
+    stats = glamor_lookup_op(op ? op : "unknown");
+    if (upload) {
+        stats->uploads++;
+        stats->bytes_up += bytes;
+    }
+    else {
+        stats->fallbacks++;
+        stats->downloads++;
+        stats->bytes_down += bytes;
+    }
+}
+
+size_t
+glamor_region_bytes(PixmapPtr pixmap, RegionPtr region)
+{
+    int cpp = pixmap->drawable.bitsPerPixel >> 3;
+    BoxPtr box = RegionRects(region);
+    int n = RegionNumRects(region);
+    size_t bytes = 0;
+
+    while (n--) {
+        bytes += (size_t) (box->x2 - box->x1) * (box->y2 - box->y1) * cpp;
+        box++;
+    }
+    return bytes;
+}
+
+static void
+glamor_log_op_stats(glamor_op_stats *stats)
+{
+    LogMessageVerb(X_NONE, 0, "%-40s %10lu %10lu %14llu %10lu %14llu\n",
+                   stats->op, stats->fallbacks, stats->downloads,
+                   (unsigned long long) stats->bytes_down, stats->uploads,
+                   (unsigned long long) stats->bytes_up);
+}
+
+static void
+glamor_log_reason_stats(glamor_reason_stats *stats)
+{
+    int len = strlen(stats->reason);
+
+    /* Reasons are the glamor_fallback() formats, without their arguments */
+    if (len && stats->reason[len - 1] == '\n')
+        len--;
+    LogMessageVerb(X_NONE, 0, "%10lu %s: %.*s\n",
+                   stats->count, stats->op, len, stats->reason);
+}
+
+static void
+glamor_stats_dump(CallbackListPtr *pcbl, void *closure, void *data)
+{
+    int i;
+
+    LogMessageVerb(X_INFO, 0, "glamor software fallbacks:\n");
+    LogMessageVerb(X_NONE, 0, "%-40s %10s %10s %14s %10s %14s\n",
+                   "function", "fallbacks", "downloads", "bytes down",
+                   "uploads", "bytes up");
+    for (i = 0; i < GLAMOR_STATS_SLOTS; i++)
+        if (op_stats[i].op)
+            glamor_log_op_stats(&op_stats[i]);
+    if (op_other.fallbacks || op_other.uploads)
+        glamor_log_op_stats(&op_other);
+
+    LogMessageVerb(X_INFO, 0, "glamor fallback reasons:\n");
+    for (i = 0; i < GLAMOR_STATS_SLOTS; i++)
+        if (reason_stats[i].reason)
+            glamor_log_reason_stats(&reason_stats[i]);
+    if (reason_other.count)
+        glamor_log_reason_stats(&reason_other);
+
+    for (i = 0; i < screenInfo.numScreens; i++) {
+        glamor_screen_private *glamor_priv =
+            glamor_get_screen_private(screenInfo.screens[i]);
+
+        if (glamor_priv)
+            glamor_log_fbo_cache(glamor_priv, 0);
+    }
+}
+
+/**
+ * Hooks the statistics up to the request statistics dump, once per
+ * server generation.
+ */
+void
+glamor_stats_init(void)
+{
+    if (glamor_stats_generation == serverGeneration)
+        return;
+
+    if (AddCallback(&ReqStatsDumpCallback, glamor_stats_dump, NULL))
+        glamor_stats_generation = serverGeneration;
+}
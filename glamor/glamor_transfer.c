@@ -55,6 +55,339 @@ glamor_format_for_pixmap(PixmapPtr pixmap, GLenum *format, GLenum *type)
     }
 }
 
+/*
+ * Uploads are staged through a pixel unpack buffer used as a ring.  The
+ * boxes are copied into it, and the texture updates are queued from
+ * there, so the GL neither copies the data on the spot nor waits for
+ * the texture to be idle.  With buffer storage the buffer stays mapped,
+ * and each segment of it is fenced when the ring moves past it, to be
+ * waited for before it is written again.  Otherwise every upload maps
+ * the range it needs, and the buffer is orphaned when the ring wraps.
+ * A segment the GL hasn't released after GLAMOR_UPLOAD_TIMEOUT switches
+ * the ring over to orphaning for good.
+ */
+
+#define GLAMOR_UPLOAD_SIZE		(4 * 1024 * 1024)
+#define GLAMOR_UPLOAD_SEGMENT_SIZE	(GLAMOR_UPLOAD_SIZE / GLAMOR_UPLOAD_SEGMENTS)
+
+#define GLAMOR_UPLOAD_TIMEOUT		1000000000	/* ns */
+
+#define GLAMOR_UPLOAD_MAP_BITS	(GL_MAP_WRITE_BIT |		\
+                                 GL_MAP_PERSISTENT_BIT |	\
+                                 GL_MAP_COHERENT_BIT)
+
+void
+glamor_init_upload(ScreenPtr screen)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+
+    if (!glamor_priv->has_upload_pbo)
+        return;
+
+    glamor_make_current(glamor_priv);
+
+    glGenBuffers(1, &glamor_priv->upload_pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, glamor_priv->upload_pbo);
+
+    if (glamor_priv->has_buffer_storage) {
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLAMOR_UPLOAD_SIZE, NULL,
+                        GLAMOR_UPLOAD_MAP_BITS);
+        if (glGetError() == GL_NO_ERROR)
+            glamor_priv->upload_map =
+                glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLAMOR_UPLOAD_SIZE,
+                                 GLAMOR_UPLOAD_MAP_BITS);
+
+        if (!glamor_priv->upload_map) {
+            /* Storage can't be respecified, start over without it */
+            glDeleteBuffers(1, &glamor_priv->upload_pbo);
+            glGenBuffers(1, &glamor_priv->upload_pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, glamor_priv->upload_pbo);
+        }
+    }
+
+    if (!glamor_priv->upload_map)
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, GLAMOR_UPLOAD_SIZE, NULL,
+                     GL_STREAM_DRAW);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+static void
+glamor_delete_upload_fences(glamor_screen_private *glamor_priv)
+{
+    int i;
+
+    for (i = 0; i < GLAMOR_UPLOAD_SEGMENTS; i++) {
+        if (glamor_priv->upload_fences[i]) {
+            glDeleteSync(glamor_priv->upload_fences[i]);
+            glamor_priv->upload_fences[i] = NULL;
+        }
+    }
+}
+
+void
+glamor_fini_upload(ScreenPtr screen)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+
+    if (!glamor_priv->upload_pbo)
+        return;
+
+    glamor_make_current(glamor_priv);
+
+    glamor_delete_upload_fences(glamor_priv);
+    glDeleteBuffers(1, &glamor_priv->upload_pbo);
+    glamor_priv->upload_pbo = 0;
+    glamor_priv->upload_map = NULL;
+}
+
+/*
+ * Replaces the persistently mapped upload buffer with one that is
+ * orphaned when the ring wraps, once waiting for a segment of it took
+ * too long.  Storage can't be respecified, so it takes a new buffer.
+ */
+static void
+glamor_unmap_upload(glamor_screen_private *glamor_priv)
+{
+    LogMessage(X_WARNING,
+               "glamor%d: upload buffer busy for too long, "
+               "no longer keeping it mapped\n", glamor_priv->screen->myNum);
+
+    glamor_delete_upload_fences(glamor_priv);
+    glDeleteBuffers(1, &glamor_priv->upload_pbo);
+    glGenBuffers(1, &glamor_priv->upload_pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, glamor_priv->upload_pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, GLAMOR_UPLOAD_SIZE, NULL,
+                 GL_STREAM_DRAW);
+    glamor_priv->upload_map = NULL;
+    glamor_priv->upload_segment = 0;
+}
+
+/**
+ * Returns a pointer to @size bytes of the upload buffer, which the GL
+ * reads at @offset, or NULL.  The buffer is left bound, and
+ * glamor_put_upload_space() must be called before the GL reads it.
+ */
+static char *
+glamor_get_upload_space(glamor_screen_private *glamor_priv, size_t size,
+                        size_t *offset)
+{
+    size_t start = ALIGN(glamor_priv->upload_offset, 64);
+    int segment;
+
+    if (size > GLAMOR_UPLOAD_SEGMENT_SIZE)
+        return NULL;
+
+    if (start + size > GLAMOR_UPLOAD_SIZE)
+        start = 0;
+    *offset = start;
+    glamor_priv->upload_offset = start + size;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, glamor_priv->upload_pbo);
+
+    if (glamor_priv->upload_map) {
+        segment = (start + size - 1) / GLAMOR_UPLOAD_SEGMENT_SIZE;
+        while (glamor_priv->upload_segment != segment) {
+            GLsync *fence;
+            GLenum status;
+
+            glamor_priv->upload_fences[glamor_priv->upload_segment] =
+                glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glamor_priv->upload_segment =
+                (glamor_priv->upload_segment + 1) % GLAMOR_UPLOAD_SEGMENTS;
+
+            fence = &glamor_priv->upload_fences[glamor_priv->upload_segment];
+            if (*fence) {
+                status = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                          GLAMOR_UPLOAD_TIMEOUT);
+                glDeleteSync(*fence);
+                *fence = NULL;
+                if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+                    glamor_unmap_upload(glamor_priv);
+                    break;
+                }
+            }
+        }
+        if (glamor_priv->upload_map)
+            return glamor_priv->upload_map + start;
+    }
+
+    if (start == 0)
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, GLAMOR_UPLOAD_SIZE, NULL,
+                     GL_STREAM_DRAW);
+    return glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, start, size,
+                            GL_MAP_WRITE_BIT |
+                            GL_MAP_UNSYNCHRONIZED_BIT |
+                            GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+static void
+glamor_put_upload_space(glamor_screen_private *glamor_priv)
+{
+    if (!glamor_priv->upload_map)
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+}
+
+/* Staged rows are packed to GL_UNPACK_ALIGNMENT */
+static inline size_t
+glamor_upload_stride(BoxPtr box, int bytes_per_pixel)
+{
+    return ALIGN((box->x2 - box->x1) * bytes_per_pixel, 4);
+}
+
+/*
+ * Clips the boxes, moved by dx/dy, to the FBO box, and joins those that
+ * share a whole edge with the one before.
+ */
+static int
+glamor_upload_clip_boxes(BoxPtr box, BoxPtr in_boxes, int in_nbox,
+                         int dx, int dy, BoxPtr boxes)
+{
+    int nbox = 0;
+
+    while (in_nbox--) {
+        BoxRec b;
+
+        b.x1 = MAX(in_boxes->x1 + dx, box->x1);
+        b.x2 = MIN(in_boxes->x2 + dx, box->x2);
+        b.y1 = MAX(in_boxes->y1 + dy, box->y1);
+        b.y2 = MIN(in_boxes->y2 + dy, box->y2);
+        in_boxes++;
+
+        if (b.x2 <= b.x1 || b.y2 <= b.y1)
+            continue;
+
+        if (nbox) {
+            BoxPtr last = &boxes[nbox - 1];
+
+            if (last->y1 == b.y1 && last->y2 == b.y2 && last->x2 == b.x1) {
+                last->x2 = b.x2;
+                continue;
+            }
+            if (last->x1 == b.x1 && last->x2 == b.x2 && last->y2 == b.y1) {
+                last->y2 = b.y2;
+                continue;
+            }
+        }
+        boxes[nbox++] = b;
+    }
+    return nbox;
+}
+
+/*
+ * Uploads a box (in pixmap coordinates) straight from memory
+ */
+static void
+glamor_upload_box_direct(glamor_screen_private *glamor_priv, BoxPtr box,
+                         BoxPtr b, int dx, int dy,
+                         uint8_t *bits, uint32_t byte_stride,
+                         int bytes_per_pixel, GLenum format, GLenum type)
+{
+    int x1 = b->x1, x2 = b->x2, y1 = b->y1, y2 = b->y2;
+    size_t ofs = (y1 + dy) * byte_stride + (x1 + dx) * bytes_per_pixel;
+
+    if (glamor_priv->has_unpack_subimage ||
+        x2 - x1 == byte_stride / bytes_per_pixel) {
+        if (glamor_priv->has_unpack_subimage)
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, byte_stride / bytes_per_pixel);
+        glTexSubImage2D(GL_TEXTURE_2D, 0,
+                        x1 - box->x1, y1 - box->y1,
+                        x2 - x1, y2 - y1,
+                        format, type,
+                        bits + ofs);
+        if (glamor_priv->has_unpack_subimage)
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    } else {
+        for (; y1 < y2; y1++, ofs += byte_stride)
+            glTexSubImage2D(GL_TEXTURE_2D, 0,
+                            x1 - box->x1, y1 - box->y1,
+                            x2 - x1, 1,
+                            format, type,
+                            bits + ofs);
+    }
+}
+
+/*
+ * Copies the boxes into the upload buffer, all at once when they fit in
+ * a segment and a band at a time otherwise, and uploads them from there.
+ */
+static void
+glamor_upload_boxes_staged(glamor_screen_private *glamor_priv, BoxPtr box,
+                           BoxPtr boxes, int nbox, int dx, int dy,
+                           uint8_t *bits, uint32_t byte_stride,
+                           int bytes_per_pixel, GLenum format, GLenum type)
+{
+    size_t total = 0, offset, pos;
+    char *data = NULL;
+    int i, y, rows;
+
+    for (i = 0; i < nbox; i++)
+        total += glamor_upload_stride(&boxes[i], bytes_per_pixel) *
+            (boxes[i].y2 - boxes[i].y1);
+
+    if (total <= GLAMOR_UPLOAD_SEGMENT_SIZE)
+        data = glamor_get_upload_space(glamor_priv, total, &offset);
+
+    if (data) {
+        for (i = 0, pos = 0; i < nbox; i++) {
+            BoxPtr b = &boxes[i];
+            size_t stride = glamor_upload_stride(b, bytes_per_pixel);
+            uint8_t *src = bits + (b->y1 + dy) * byte_stride +
+                (b->x1 + dx) * bytes_per_pixel;
+
+            for (y = b->y1; y < b->y2; y++, src += byte_stride, pos += stride)
+                memcpy(data + pos, src, (b->x2 - b->x1) * bytes_per_pixel);
+        }
+        glamor_put_upload_space(glamor_priv);
+
+        for (i = 0, pos = offset; i < nbox; i++) {
+            BoxPtr b = &boxes[i];
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0,
+                            b->x1 - box->x1, b->y1 - box->y1,
+                            b->x2 - b->x1, b->y2 - b->y1,
+                            format, type, (void *) (uintptr_t) pos);
+            pos += glamor_upload_stride(b, bytes_per_pixel) * (b->y2 - b->y1);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    for (i = 0; i < nbox; i++) {
+        BoxRec band = boxes[i];
+        size_t stride = glamor_upload_stride(&band, bytes_per_pixel);
+
+        rows = MAX(GLAMOR_UPLOAD_SEGMENT_SIZE / stride, 1);
+        for (; band.y1 < boxes[i].y2; band.y1 = band.y2) {
+            uint8_t *src = bits + (band.y1 + dy) * byte_stride +
+                (band.x1 + dx) * bytes_per_pixel;
+
+            band.y2 = MIN(band.y1 + rows, boxes[i].y2);
+            data = glamor_get_upload_space(glamor_priv,
+                                           stride * (band.y2 - band.y1),
+                                           &offset);
+            if (!data) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                glamor_upload_box_direct(glamor_priv, box, &band, dx, dy,
+                                         bits, byte_stride, bytes_per_pixel,
+                                         format, type);
+                continue;
+            }
+
+            for (pos = 0, y = band.y1; y < band.y2;
+                 y++, src += byte_stride, pos += stride)
+                memcpy(data + pos, src, (band.x2 - band.x1) * bytes_per_pixel);
+            glamor_put_upload_space(glamor_priv);
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0,
+                            band.x1 - box->x1, band.y1 - box->y1,
+                            band.x2 - band.x1, band.y2 - band.y1,
+                            format, type, (void *) (uintptr_t) offset);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+}
+
 /*
  * Write a region of bits into a pixmap
  */
@@ -71,6 +404,11 @@ glamor_upload_boxes(PixmapPtr pixmap, BoxPtr in_boxes, int in_nbox,
     int                         bytes_per_pixel = pixmap->drawable.bitsPerPixel >> 3;
     GLenum                      type;
     GLenum                      format;
+    BoxRec                      stack_boxes[16];
+    BoxPtr                      boxes = stack_boxes;
+    int                         chunk = in_nbox;
+    int                         first, nbox, i;
+    Bool                        staged;
 
     glamor_format_for_pixmap(pixmap, &format, &type);
 
@@ -78,53 +416,49 @@ glamor_upload_boxes(PixmapPtr pixmap, BoxPtr in_boxes, int in_nbox,
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-    if (glamor_priv->has_unpack_subimage)
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, byte_stride / bytes_per_pixel);
+    /* glamor_fini_pixmap() uploads from the pixmap's own PBO */
+    staged = glamor_priv->upload_pbo && !priv->pbo;
+
+    if (in_nbox > ARRAY_SIZE(stack_boxes)) {
+        boxes = xallocarray(in_nbox, sizeof(BoxRec));
+        /* Without the memory, clip the boxes a stack full at a time */
+        if (!boxes) {
+            boxes = stack_boxes;
+            chunk = ARRAY_SIZE(stack_boxes);
+        }
+    }
 
     glamor_pixmap_loop(priv, box_index) {
         BoxPtr                  box = glamor_pixmap_box_at(priv, box_index);
         glamor_pixmap_fbo       *fbo = glamor_pixmap_fbo_at(priv, box_index);
-        BoxPtr                  boxes = in_boxes;
-        int                     nbox = in_nbox;
 
-        glamor_bind_texture(glamor_priv, GL_TEXTURE0, fbo, TRUE);
-
-        while (nbox--) {
-
-            /* compute drawable coordinates */
-            int x1 = MAX(boxes->x1 + dx_dst, box->x1);
-            int x2 = MIN(boxes->x2 + dx_dst, box->x2);
-            int y1 = MAX(boxes->y1 + dy_dst, box->y1);
-            int y2 = MIN(boxes->y2 + dy_dst, box->y2);
-
-            size_t ofs = (y1 - dy_dst + dy_src) * byte_stride;
-            ofs += (x1 - dx_dst + dx_src) * bytes_per_pixel;
+        for (first = 0; first < in_nbox; first += chunk) {
+            nbox = glamor_upload_clip_boxes(box, in_boxes + first,
+                                            min(chunk, in_nbox - first),
+                                            dx_dst, dy_dst, boxes);
+            if (!nbox)
+                continue;
 
-            boxes++;
+            glamor_bind_texture(glamor_priv, GL_TEXTURE0, fbo, TRUE);
 
-            if (x2 <= x1 || y2 <= y1)
+            if (staged) {
+                glamor_upload_boxes_staged(glamor_priv, box, boxes, nbox,
+                                           dx_src - dx_dst, dy_src - dy_dst,
+                                           bits, byte_stride, bytes_per_pixel,
+                                           format, type);
                 continue;
-
-            if (glamor_priv->has_unpack_subimage ||
-                x2 - x1 == byte_stride / bytes_per_pixel) {
-                glTexSubImage2D(GL_TEXTURE_2D, 0,
-                                x1 - box->x1, y1 - box->y1,
-                                x2 - x1, y2 - y1,
-                                format, type,
-                                bits + ofs);
-            } else {
-                for (; y1 < y2; y1++, ofs += byte_stride)
-                    glTexSubImage2D(GL_TEXTURE_2D, 0,
-                                    x1 - box->x1, y1 - box->y1,
-                                    x2 - x1, 1,
-                                    format, type,
-                                    bits + ofs);
             }
+
+            for (i = 0; i < nbox; i++)
+                glamor_upload_box_direct(glamor_priv, box, &boxes[i],
+                                         dx_src - dx_dst, dy_src - dy_dst,
+                                         bits, byte_stride, bytes_per_pixel,
+                                         format, type);
         }
     }
 
-    if (glamor_priv->has_unpack_subimage)
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (boxes != stack_boxes)
+        free(boxes);
 }
 
 /*
@@ -42,6 +42,16 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 
+#if __ANDROID_API__ >= 29
+#include <android/hardware_buffer.h>
+#include <android/surface_control.h>
+#include <pthread.h>
+#define XBOAT_SHARED_FB 1
+#include <android/choreographer.h>
+#include <android/looper.h>
+#define XBOAT_CHOREOGRAPHER 1
+#endif
+
 #ifdef GLAMOR
 #include <epoxy/gl.h>
 #include "glamor.h"
@@ -49,9 +59,15 @@
 #endif
 #include "xboatlog.h"
 #include "xboat.h"
+#include "xboat_convert.h"
 
 typedef uint32_t pixel32_t;
 
+#ifdef XBOAT_SHARED_FB
+/* One being rendered to, one shown and one on its way back */
+#define XBOAT_SHARED_BUFFERS 3
+#endif
+
 typedef struct xboat_image_t {
     // Width in pixels, excluding pads etc.
     uint16_t           width;
@@ -69,6 +85,19 @@ typedef struct xboat_image_t {
     // Bytes per image row.
     uint32_t           stride;
     uint8_t *          data;
+#ifdef XBOAT_SHARED_FB
+    // Shared with the compositor.  The server renders straight into the
+    // one mapped at data while the compositor shows the others.
+    AHardwareBuffer *  hwbuf[XBOAT_SHARED_BUFFERS];
+    // The buffer mapped at data.
+    int                hwbuf_current;
+    // The buffer last handed to the compositor, -1 if none.
+    int                hwbuf_front;
+    // Extents of the updates each buffer has missed.
+    BoxRec             hwbuf_stale[XBOAT_SHARED_BUFFERS];
+    // Extents of the updates to the current buffer not shown yet.
+    BoxRec             hwbuf_unshown;
+#endif
 } xboat_image_t;
 
 static xboat_image_t* xboat_image_create(uint16_t width, uint16_t height) {
@@ -79,44 +108,208 @@ static xboat_image_t* xboat_image_create(uint16_t width, uint16_t height) {
     image->depth = 24;
     image->bpp = 32;
     image->stride = width * sizeof(pixel32_t);
+    image->data = NULL;
+#ifdef XBOAT_SHARED_FB
+    memset(image->hwbuf, 0, sizeof(image->hwbuf));
+#endif
     return image;
 }
 
-static void xboat_image_destroy(xboat_image_t *image) {
-    free(image);
+#ifdef XBOAT_SHARED_FB
+static void hostboat_reset_shared(void);
+static void hostboat_free_shared(xboat_image_t *image);
+
+/*
+ * Replace the image data with a set of hardware buffers the compositor
+ * can scan out or sample from directly.  The server renders into the one
+ * mapped at data, which is handed over as is on the next update, and
+ * switches to another (see hostboat_post_shared()).
+ */
+static Bool xboat_image_alloc_shared(xboat_image_t *image) {
+    AHardwareBuffer_Desc desc = {
+        .width = image->width,
+        .height = image->height,
+        .layers = 1,
+        .format = AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM,
+        .usage = AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN |
+                 AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN |
+                 AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE |
+                 AHARDWAREBUFFER_USAGE_COMPOSER_OVERLAY,
+    };
+    void *bits;
+    int i;
+
+    for (i = 0; i < XBOAT_SHARED_BUFFERS; i++) {
+        if (AHardwareBuffer_allocate(&desc, &image->hwbuf[i]) != 0) {
+            image->hwbuf[i] = NULL;
+            goto bail;
+        }
+        image->hwbuf_stale[i].x1 = 0;
+        image->hwbuf_stale[i].y1 = 0;
+        image->hwbuf_stale[i].x2 = image->width;
+        image->hwbuf_stale[i].y2 = image->height;
+    }
+
+    if (AHardwareBuffer_lock(image->hwbuf[0],
+                             AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN |
+                             AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN,
+                             -1, NULL, &bits) != 0)
+        goto bail;
+
+    AHardwareBuffer_describe(image->hwbuf[0], &desc);
+    image->stride = desc.stride * sizeof(pixel32_t);
+    image->data = bits;
+    image->hwbuf_current = 0;
+    image->hwbuf_front = -1;
+    image->hwbuf_stale[0].x2 = image->hwbuf_stale[0].y2 = 0;
+    image->hwbuf_unshown = image->hwbuf_stale[0];
+    hostboat_reset_shared();
+    return TRUE;
+
+bail:
+    for (i = 0; i < XBOAT_SHARED_BUFFERS; i++) {
+        if (image->hwbuf[i])
+            AHardwareBuffer_release(image->hwbuf[i]);
+        image->hwbuf[i] = NULL;
+    }
+    return FALSE;
 }
+#endif
 
-static void xboat_image_put_pixel(xboat_image_t *image, uint32_t x, uint32_t y, uint32_t pixel) {
-    uint8_t* row = image->data + (y * image->stride);
-    row[x << 2] = pixel;
-    row[(x << 2) + 1] = pixel >> 8;
-    row[(x << 2) + 2] = pixel >> 16;
-    row[(x << 2) + 3] = pixel >> 24;
+static void xboat_image_free_data(xboat_image_t *image) {
+#ifdef XBOAT_SHARED_FB
+    if (image->hwbuf[0])
+        hostboat_free_shared(image);
+#endif
+    free(image->data);
+    image->data = NULL;
 }
 
-static void xboat_image_put(xboat_image_t *image, ANativeWindow* window,
-                            uint32_t src_x, uint32_t src_y,
-                            uint32_t dst_x, uint32_t dst_y,
-                            uint32_t width, uint32_t height) {
-    ANativeWindow_Buffer buffer;
-    ARect rect;
-    rect.left = dst_x;
-    rect.top = dst_y;
-    rect.right = dst_x + width;
-    rect.bottom = dst_y + height;
-    ANativeWindow_lock(window, &buffer, &rect);
-    uint32_t dst_stride = buffer.stride * sizeof(pixel32_t);
+static void xboat_image_destroy(xboat_image_t *image) {
+    free(image);
+}
+
+static void xboat_image_copy_box(xboat_image_t *image, ANativeWindow_Buffer *buffer,
+                                 int src_x, int src_y,
+                                 int dst_x, int dst_y,
+                                 int width, int height) {
+    uint32_t dst_stride = buffer->stride * sizeof(pixel32_t);
     uint32_t src_stride = image->stride;
-    uint8_t* dst_line = (uint8_t*)buffer.bits + dst_y * dst_stride;
+    uint8_t* dst_line = (uint8_t*)buffer->bits + dst_y * dst_stride;
     uint8_t* src_line = image->data + src_y * src_stride;
     uint32_t bytes_per_line = width * sizeof(pixel32_t);
     dst_line += dst_x * sizeof(pixel32_t);
     src_line += src_x * sizeof(pixel32_t);
-    for (uint32_t i = 0; i < height; i++) {
+    for (int i = 0; i < height; i++) {
         memcpy(dst_line, src_line, bytes_per_line);
         dst_line += dst_stride;
         src_line += src_stride;
     }
+}
+
+/*
+ * Like xboat_image_copy_box, but converting from the server framebuffer
+ * ( fb_data ) when its depth does not match the host, straight into the
+ * locked window buffer.
+ */
+static void hostboat_copy_box(XboatScrPriv *scrpriv, ANativeWindow_Buffer *buffer,
+                              int src_x, int src_y,
+                              int dst_x, int dst_y,
+                              int width, int height) {
+    xboat_convert_row_proc convert;
+    int bytes_per_pixel = scrpriv->server_depth >> 3;
+    int src_stride = (scrpriv->win_width * bytes_per_pixel + 0x3) & ~0x3;
+    uint32_t* dst_line;
+    uint8_t* src_line;
+
+    switch (scrpriv->server_depth) {
+    case 16:
+        convert = xboat_convert_rgb565_row;
+        break;
+    case 8:
+        convert = xboat_convert_pal8_row;
+        break;
+    default:
+        xboat_image_copy_box(scrpriv->ximg, buffer, src_x, src_y,
+                             dst_x, dst_y, width, height);
+        return;
+    }
+
+    dst_line = (uint32_t*)buffer->bits + dst_y * buffer->stride + dst_x;
+    src_line = scrpriv->fb_data + src_y * src_stride + src_x * bytes_per_pixel;
+    for (int i = 0; i < height; i++) {
+        convert(dst_line, src_line, width, scrpriv->cmap);
+        dst_line += buffer->stride;
+        src_line += src_stride;
+    }
+}
+
+#ifdef XBOAT_SHARED_FB
+static void hostboat_post_shared(XboatScrPriv *scrpriv, const BoxRec *extents,
+                                 const BoxRec *boxes, int nbox);
+#endif
+
+/*
+ * Copy every box (in window coordinates, offset by src_dx/src_dy into
+ * the screen image) onto the window, locking the window once with the
+ * bounding rectangle and posting a single frame for all of them.
+ */
+static void hostboat_put_boxes(XboatScrPriv *scrpriv,
+                               int src_dx, int src_dy,
+                               const BoxRec *extents,
+                               const BoxRec *boxes, int nbox) {
+    xboat_image_t *image = scrpriv->ximg;
+    ANativeWindow* window = scrpriv->win;
+    ANativeWindow_Buffer buffer;
+    ARect rect;
+    int width, height;
+    int x1, y1, x2, y2;
+
+#ifdef XBOAT_SHARED_FB
+    if (image->hwbuf[0]) {
+        hostboat_post_shared(scrpriv, extents, boxes, nbox);
+        return;
+    }
+#endif
+
+    rect.left = extents->x1;
+    rect.top = extents->y1;
+    rect.right = extents->x2;
+    rect.bottom = extents->y2;
+    if (ANativeWindow_lock(window, &buffer, &rect) != 0)
+        return;
+
+    width = min((int) image->width + src_dx, buffer.width);
+    height = min((int) image->height + src_dy, buffer.height);
+
+    /* The host grows the dirty rectangle when it could not preserve the
+     * contents of the previous buffer, all of it has to be repainted then.
+     */
+    if (rect.left < extents->x1 || rect.top < extents->y1 ||
+        rect.right > extents->x2 || rect.bottom > extents->y2) {
+        boxes = NULL;
+        nbox = 1;
+    }
+
+    while (nbox--) {
+        if (boxes) {
+            x1 = boxes->x1; y1 = boxes->y1;
+            x2 = boxes->x2; y2 = boxes->y2;
+            boxes++;
+        } else {
+            x1 = rect.left; y1 = rect.top;
+            x2 = rect.right; y2 = rect.bottom;
+        }
+        x1 = max(x1, max(src_dx, 0));
+        y1 = max(y1, max(src_dy, 0));
+        x2 = min(x2, width);
+        y2 = min(y2, height);
+        if (x1 >= x2 || y1 >= y2)
+            continue;
+        hostboat_copy_box(scrpriv, &buffer, x1 - src_dx, y1 - src_dy,
+                          x1, y1, x2 - x1, y2 - y1);
+    }
+
     ANativeWindow_unlockAndPost(window);
 }
 
@@ -157,14 +350,24 @@ static xboat_visualtype_t xboat_default_visual = {
     .blue_mask = 0x00ff0000,
 };
 
+/* Host events read ahead of processing, must be a power of two */
+#define HOSTBOAT_EVENT_RING_SIZE 256
+
 struct XboatHostBoatVars {
     char *server_dpy_name;
     xboat_visualtype_t *visual;
     ANativeWindow* winroot;
-    BoatEvent *saved_event;
+
+    /* Events read from Boat but not handed out yet */
+    BoatEvent events[HOSTBOAT_EVENT_RING_SIZE];
+    unsigned int events_head, events_tail;
     int depth;
     Bool use_sw_cursor;
     Bool use_fullscreen;
+    Bool use_shared_fb;
+#ifdef XBOAT_SHARED_FB
+    ASurfaceControl *surface;
+#endif
 
     int n_screens;
     KdScreenInfo **screens;
@@ -188,6 +391,266 @@ extern Bool xboat_glamor_skip_present;
 
 #define host_depth_matches_server(_vars) (HostBoat.depth == (_vars)->server_depth)
 
+#ifdef XBOAT_SHARED_FB
+#define XBOAT_MAX_DAMAGE_RECTS 16
+/* How long an update waits for the compositor to release a buffer, ms */
+#define XBOAT_RELEASE_TIMEOUT 100
+/* In shared_release_fences[], for a buffer the compositor holds */
+#define XBOAT_BUFFER_HELD -2
+/* Transaction callbacks are tagged with the generation and the buffer */
+#define XBOAT_BUFFER_INDEX_BITS 2
+
+/*
+ * The release fences of the shared buffers, set from the transaction
+ * callbacks on a binder thread.  Callbacks carry the generation they were
+ * made for, so that those for buffers already freed are ignored.
+ */
+static pthread_mutex_t shared_release_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shared_release_cond = PTHREAD_COND_INITIALIZER;
+static int shared_release_fences[XBOAT_SHARED_BUFFERS] = { -1, -1, -1 };
+static unsigned int shared_generation;
+
+static void hostboat_reset_shared(void) {
+    int i;
+
+    pthread_mutex_lock(&shared_release_lock);
+    shared_generation++;
+    for (i = 0; i < XBOAT_SHARED_BUFFERS; i++) {
+        if (shared_release_fences[i] >= 0)
+            close(shared_release_fences[i]);
+        shared_release_fences[i] = -1;
+    }
+    pthread_mutex_unlock(&shared_release_lock);
+}
+
+/*
+ * Called once the transaction that replaced the buffer in the context
+ * has been applied, with the fence signalled when the compositor is done
+ * reading that buffer.
+ */
+static void hostboat_shared_complete(void *context,
+                                     ASurfaceTransactionStats *stats) {
+    uintptr_t tag = (uintptr_t) context;
+    int index = tag & ((1 << XBOAT_BUFFER_INDEX_BITS) - 1);
+    ASurfaceControl **controls;
+    size_t count;
+    int fence = -1;
+
+    ASurfaceTransactionStats_getASurfaceControls(stats, &controls, &count);
+    if (count > 0)
+        fence = ASurfaceTransactionStats_getPreviousReleaseFenceFd(stats,
+                                                                   controls[0]);
+    ASurfaceTransactionStats_releaseASurfaceControls(controls);
+
+    pthread_mutex_lock(&shared_release_lock);
+    if ((tag >> XBOAT_BUFFER_INDEX_BITS) == shared_generation &&
+        shared_release_fences[index] == XBOAT_BUFFER_HELD) {
+        shared_release_fences[index] = fence;
+        fence = -1;
+        pthread_cond_broadcast(&shared_release_cond);
+    }
+    pthread_mutex_unlock(&shared_release_lock);
+
+    if (fence >= 0)
+        close(fence);
+}
+
+/*
+ * Wait for the compositor to release a buffer other than 'current', and
+ * return it in 'index' along with the fence to wait on before writing to
+ * it in 'fence'.
+ */
+static Bool hostboat_shared_acquire(int current, int *index, int *fence) {
+    struct timespec deadline;
+    int i, found = -1;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += XBOAT_RELEASE_TIMEOUT * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&shared_release_lock);
+    for (;;) {
+        for (i = 0; i < XBOAT_SHARED_BUFFERS; i++) {
+            if (i != current &&
+                shared_release_fences[i] != XBOAT_BUFFER_HELD) {
+                found = i;
+                break;
+            }
+        }
+        if (found >= 0 ||
+            pthread_cond_timedwait(&shared_release_cond, &shared_release_lock,
+                                   &deadline) != 0)
+            break;
+    }
+    if (found >= 0) {
+        *index = found;
+        *fence = shared_release_fences[found];
+        shared_release_fences[found] = -1;
+    }
+    pthread_mutex_unlock(&shared_release_lock);
+
+    return found >= 0;
+}
+
+static void hostboat_box_union(BoxRec *dst, const BoxRec *box) {
+    if (dst->x1 >= dst->x2 || dst->y1 >= dst->y2) {
+        *dst = *box;
+        return;
+    }
+    dst->x1 = min(dst->x1, box->x1);
+    dst->y1 = min(dst->y1, box->y1);
+    dst->x2 = max(dst->x2, box->x2);
+    dst->y2 = max(dst->y2, box->y2);
+}
+
+static void hostboat_shared_copy_box(xboat_image_t *image,
+                                     ANativeWindow_Buffer *buffer,
+                                     const BoxRec *box) {
+    int x1 = max(box->x1, 0), y1 = max(box->y1, 0);
+    int x2 = min(box->x2, (int) image->width);
+    int y2 = min(box->y2, (int) image->height);
+
+    if (x1 < x2 && y1 < y2)
+        xboat_image_copy_box(image, buffer, x1, y1, x1, y1, x2 - x1, y2 - y1);
+}
+
+/*
+ * Hand the buffer the server has been rendering into to the compositor,
+ * with the boxes as the damaged area, and point the screen at another
+ * one.
+ *
+ * The next buffer is taken once the compositor has released it, and only
+ * the updates it missed since it was last rendered into are copied from
+ * the current one, before the CPU lock on that is dropped.  When no
+ * buffer is released in time, the server keeps rendering into the current
+ * one, and the boxes are shown with the next update.
+ */
+static void hostboat_post_shared(XboatScrPriv *scrpriv, const BoxRec *extents,
+                                 const BoxRec *boxes, int nbox) {
+    xboat_image_t *image = scrpriv->ximg;
+    ASurfaceTransaction *transaction;
+    ANativeWindow_Buffer buffer;
+    ARect rects[XBOAT_MAX_DAMAGE_RECTS];
+    int current = image->hwbuf_current;
+    int next, fence, i;
+    void *bits;
+
+    /* The other buffers miss these boxes in any case */
+    for (i = 0; i < XBOAT_SHARED_BUFFERS; i++) {
+        if (i != current)
+            hostboat_box_union(&image->hwbuf_stale[i], extents);
+    }
+    hostboat_box_union(&image->hwbuf_unshown, extents);
+
+    if (!HostBoat.surface) {
+        HostBoat.surface = ASurfaceControl_createFromWindow(HostBoat.winroot,
+                                                            "Xboat");
+        if (!HostBoat.surface)
+            return;
+    }
+
+    transaction = ASurfaceTransaction_create();
+    if (!transaction)
+        return;
+
+    if (!hostboat_shared_acquire(current, &next, &fence) ||
+        AHardwareBuffer_lock(image->hwbuf[next],
+                             AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN |
+                             AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN,
+                             fence, NULL, &bits) != 0) {
+        ASurfaceTransaction_delete(transaction);
+        return;
+    }
+
+    buffer.bits = bits;
+    buffer.stride = image->stride / sizeof(pixel32_t);
+    hostboat_shared_copy_box(image, &buffer, &image->hwbuf_stale[next]);
+    image->hwbuf_stale[next].x1 = image->hwbuf_stale[next].x2 = 0;
+    image->hwbuf_stale[next].y1 = image->hwbuf_stale[next].y2 = 0;
+
+    fence = -1;
+    AHardwareBuffer_unlock(image->hwbuf[current], &fence);
+
+    /* Updates left from skipped frames, or too many boxes to describe
+     * individually, are damaged as a whole */
+    if (image->hwbuf_unshown.x1 < extents->x1 ||
+        image->hwbuf_unshown.y1 < extents->y1 ||
+        image->hwbuf_unshown.x2 > extents->x2 ||
+        image->hwbuf_unshown.y2 > extents->y2 ||
+        nbox > XBOAT_MAX_DAMAGE_RECTS) {
+        boxes = &image->hwbuf_unshown;
+        nbox = 1;
+    }
+
+    for (i = 0; i < nbox; i++) {
+        rects[i].left = boxes[i].x1;
+        rects[i].top = boxes[i].y1;
+        rects[i].right = boxes[i].x2;
+        rects[i].bottom = boxes[i].y2;
+    }
+
+    ASurfaceTransaction_setBuffer(transaction, HostBoat.surface,
+                                  image->hwbuf[current], fence);
+    ASurfaceTransaction_setBufferTransparency(transaction, HostBoat.surface,
+                                              ASURFACE_TRANSACTION_TRANSPARENCY_OPAQUE);
+    ASurfaceTransaction_setDamageRegion(transaction, HostBoat.surface,
+                                        rects, nbox);
+    if (image->hwbuf_front >= 0)
+        ASurfaceTransaction_setOnComplete(transaction,
+                                          (void *) (uintptr_t)
+                                          (shared_generation <<
+                                           XBOAT_BUFFER_INDEX_BITS |
+                                           image->hwbuf_front),
+                                          hostboat_shared_complete);
+
+    pthread_mutex_lock(&shared_release_lock);
+    shared_release_fences[current] = XBOAT_BUFFER_HELD;
+    pthread_mutex_unlock(&shared_release_lock);
+
+    ASurfaceTransaction_apply(transaction);
+    ASurfaceTransaction_delete(transaction);
+
+    image->hwbuf_front = current;
+    image->hwbuf_current = next;
+    image->hwbuf_unshown.x1 = image->hwbuf_unshown.x2 = 0;
+    image->hwbuf_unshown.y1 = image->hwbuf_unshown.y2 = 0;
+    image->data = bits;
+    xboatSetFramebuffer(scrpriv->screen, bits);
+}
+
+/*
+ * Take the shared buffers off the screen and drop them, along with the
+ * surface showing them.
+ */
+static void hostboat_free_shared(xboat_image_t *image) {
+    ASurfaceTransaction *transaction;
+    int i;
+
+    if (HostBoat.surface) {
+        transaction = ASurfaceTransaction_create();
+        if (transaction) {
+            ASurfaceTransaction_reparent(transaction, HostBoat.surface, NULL);
+            ASurfaceTransaction_apply(transaction);
+            ASurfaceTransaction_delete(transaction);
+        }
+        ASurfaceControl_release(HostBoat.surface);
+        HostBoat.surface = NULL;
+    }
+
+    hostboat_reset_shared();
+
+    AHardwareBuffer_unlock(image->hwbuf[image->hwbuf_current], NULL);
+    image->data = NULL;
+    for (i = 0; i < XBOAT_SHARED_BUFFERS; i++) {
+        AHardwareBuffer_release(image->hwbuf[i]);
+        image->hwbuf[i] = NULL;
+    }
+}
+#endif
+
 int
 hostboat_want_screen_geometry(KdScreenInfo *screen, int *width, int *height, int *x, int *y)
 {
@@ -268,6 +731,12 @@ hostboat_use_fullscreen(void)
     HostBoat.use_fullscreen = TRUE;
 }
 
+void
+hostboat_use_shared_fb(void)
+{
+    HostBoat.use_shared_fb = TRUE;
+}
+
 int
 hostboat_want_fullscreen(void)
 {
@@ -303,6 +772,8 @@ hostboat_init(void)
         xboat_glamor_connect();
 #endif
 
+    xboat_convert_init();
+
     HostBoat.winroot = boatGetNativeWindow();
     HostBoat.depth = 24; // only support 32bit-RGBA8888
 #ifdef GLAMOR
@@ -360,6 +831,98 @@ hostboat_get_depth(void)
     return HostBoat.depth;
 }
 
+/* Assumed when the refresh rate of the display cannot be measured */
+#define XBOAT_DEFAULT_REFRESH_RATE 60
+
+#ifdef XBOAT_CHOREOGRAPHER
+/* Frames timed to measure the refresh rate */
+#define XBOAT_RATE_FRAMES 10
+/* How long measuring the refresh rate may take, ms */
+#define XBOAT_RATE_TIMEOUT 500
+
+struct hostboat_rate_probe {
+    AChoreographer *choreographer;
+    ALooper *looper;
+    int64_t first, last;
+    int frames;
+};
+
+static void hostboat_rate_frame(int64_t frame_time_nanos, void *data) {
+    struct hostboat_rate_probe *probe = data;
+
+    if (probe->frames++ == 0)
+        probe->first = frame_time_nanos;
+    probe->last = frame_time_nanos;
+
+    if (probe->frames < XBOAT_RATE_FRAMES)
+        AChoreographer_postFrameCallback64(probe->choreographer,
+                                           hostboat_rate_frame, probe);
+    else
+        ALooper_wake(probe->looper);
+}
+
+/*
+ * Time the choreographer's frame callbacks, which are delivered through
+ * the looper of the thread that asked for them.  This runs on a thread
+ * of its own so that the server thread does not get a looper.
+ */
+static void *hostboat_rate_thread(void *data) {
+    struct hostboat_rate_probe *probe = data;
+    CARD32 deadline = GetTimeInMillis() + XBOAT_RATE_TIMEOUT;
+    int timeout;
+
+    probe->looper = ALooper_prepare(ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
+    probe->choreographer = AChoreographer_getInstance();
+    if (!probe->choreographer)
+        return NULL;
+
+    AChoreographer_postFrameCallback64(probe->choreographer,
+                                       hostboat_rate_frame, probe);
+    while (probe->frames < XBOAT_RATE_FRAMES) {
+        timeout = (int) (deadline - GetTimeInMillis());
+        if (timeout <= 0)
+            break;
+        ALooper_pollOnce(timeout, NULL, NULL, NULL);
+    }
+    return NULL;
+}
+
+static int hostboat_measure_refresh_rate(void) {
+    struct hostboat_rate_probe probe = { 0 };
+    pthread_t thread;
+    int64_t elapsed;
+
+    if (pthread_create(&thread, NULL, hostboat_rate_thread, &probe) != 0)
+        return 0;
+    pthread_join(thread, NULL);
+
+    elapsed = probe.last - probe.first;
+    if (probe.frames < 2 || elapsed <= 0)
+        return 0;
+    return (int) (((int64_t) (probe.frames - 1) * 1000000000LL +
+                   elapsed / 2) / elapsed);
+}
+#endif
+
+int
+hostboat_get_refresh_rate(void)
+{
+    static int rate;
+
+    /* Boat does not tell us the refresh rate of the display, it is
+     * measured from the frame callbacks once, where available.
+     */
+    if (!rate) {
+#ifdef XBOAT_CHOREOGRAPHER
+        rate = hostboat_measure_refresh_rate();
+#endif
+        if (rate <= 0)
+            rate = XBOAT_DEFAULT_REFRESH_RATE;
+        XBOAT_LOG("host refresh rate: %d Hz", rate);
+    }
+    return rate;
+}
+
 int
 hostboat_get_server_depth(KdScreenInfo *screen)
 {
@@ -434,9 +997,10 @@ hostboat_set_cmap_entry(ScreenPtr pScreen, unsigned char idx,
         gshift = hostboat_calculate_color_shift(HostBoat.visual->green_mask);
         bshift = hostboat_calculate_color_shift(HostBoat.visual->blue_mask);
     }
+    /* The host window has alpha, entries have to be opaque */
     scrpriv->cmap[idx] = ((r << rshift) & HostBoat.visual->red_mask) |
         ((g << gshift) & HostBoat.visual->green_mask) |
-        ((b << bshift) & HostBoat.visual->blue_mask);
+        ((b << bshift) & HostBoat.visual->blue_mask) | 0xff000000;
 }
 
 /**
@@ -473,9 +1037,7 @@ hostboat_screen_init(KdScreenInfo *screen,
          */
 
         {
-            free(scrpriv->ximg->data);
-            scrpriv->ximg->data = NULL;
-
+            xboat_image_free_data(scrpriv->ximg);
             xboat_image_destroy(scrpriv->ximg);
         }
     }
@@ -491,8 +1053,21 @@ hostboat_screen_init(KdScreenInfo *screen,
         if (host_depth_matches_server(scrpriv))
             scrpriv->ximg->byte_order = IMAGE_BYTE_ORDER;
 
-        scrpriv->ximg->data =
-            xallocarray(scrpriv->ximg->stride, buffer_height);
+        /* Otherwise the server renders into fb_data, which is converted
+         * straight into the window buffer and needs no image data. */
+        if (host_depth_matches_server(scrpriv)) {
+#ifdef XBOAT_SHARED_FB
+            /* The compositor shows the whole buffer, so there is no room
+             * for fakexa's offscreen memory in it. */
+            if (HostBoat.use_shared_fb && buffer_height == height &&
+                !xboat_image_alloc_shared(scrpriv->ximg))
+                XBOAT_LOG("Could not allocate a shared framebuffer, "
+                          "falling back to copying");
+#endif
+            if (!scrpriv->ximg->data)
+                scrpriv->ximg->data =
+                    xallocarray(scrpriv->ximg->stride, buffer_height);
+        }
     }
 
     if (!HostBoat.size_set_from_configure)
@@ -548,19 +1123,19 @@ hostboat_paint_rect(KdScreenInfo *screen,
                  int sx, int sy, int dx, int dy, int width, int height)
 {
     XboatScrPriv *scrpriv = screen->driver;
+    BoxRec box;
 
     XBOAT_DBG("painting in screen %d\n", scrpriv->mynum);
 
+    box.x1 = dx;
+    box.y1 = dy;
+    box.x2 = dx + width;
+    box.y2 = dy + height;
+
 #ifdef GLAMOR
     if (xboat_glamor) {
-        BoxRec box;
         RegionRec region;
 
-        box.x1 = dx;
-        box.y1 = dy;
-        box.x2 = dx + width;
-        box.y2 = dy + height;
-
         RegionInit(&region, &box, 1);
         xboat_glamor_damage_redisplay(scrpriv->glamor, &region);
         RegionUninit(&region);
@@ -577,59 +1152,45 @@ hostboat_paint_rect(KdScreenInfo *screen,
         hostboat_paint_debug_rect(screen, dx, dy, width, height);
     }
 
-    /*
-     * If the depth of the xboat server is less than that of the host,
-     * the kdrive fb does not point to the ximage data but to a buffer
-     * ( fb_data ), we shift the various bits from this onto the XImage
-     * so they match the host.
-     *
-     * Note, This code is pretty new ( and simple ) so may break on
-     *       endian issues, 32 bpp host etc.
-     *       Not sure if 8bpp case is right either.
-     *       ... and it will be slower than the matching depth case.
-     */
+    hostboat_put_boxes(scrpriv, dx - sx, dy - sy, &box, &box, 1);
+}
 
-    if (!host_depth_matches_server(scrpriv)) {
-        int x, y, idx, bytes_per_pixel = (scrpriv->server_depth >> 3);
-        int stride = (scrpriv->win_width * bytes_per_pixel + 0x3) & ~0x3;
-        unsigned char r, g, b;
-        unsigned long host_pixel;
-
-        XBOAT_DBG("Unmatched host depth scrpriv=%p\n", scrpriv);
-        for (y = sy; y < sy + height; y++)
-            for (x = sx; x < sx + width; x++) {
-                idx = y * stride + x * bytes_per_pixel;
-
-                switch (scrpriv->server_depth) {
-                case 16:
-                {
-                    unsigned short pixel =
-                        *(unsigned short *) (scrpriv->fb_data + idx);
-
-                    r = ((pixel & 0xf800) >> 8);
-                    g = ((pixel & 0x07e0) >> 3);
-                    b = ((pixel & 0x001f) << 3);
-
-                    host_pixel = (r << 16) | (g << 8) | (b);
-
-                    xboat_image_put_pixel(scrpriv->ximg, x, y, host_pixel);
-                    break;
-                }
-                case 8:
-                {
-                    unsigned char pixel =
-                        *(unsigned char *) (scrpriv->fb_data + idx);
-                    xboat_image_put_pixel(scrpriv->ximg, x, y,
-                                        scrpriv->cmap[pixel]);
-                    break;
-                }
-                default:
-                    break;
-                }
-            }
+/**
+ * hostboat_paint_region copies every box of @region from the screen image
+ * onto the host window, posting one frame for the whole region instead of
+ * one per box.
+ */
+void
+hostboat_paint_region(KdScreenInfo *screen, RegionPtr region)
+{
+    XboatScrPriv *scrpriv = screen->driver;
+    int nbox = RegionNumRects(region);
+    BoxPtr pbox = RegionRects(region);
+    int i;
+
+    XBOAT_DBG("painting %d boxes in screen %d\n", nbox, scrpriv->mynum);
+
+    if (!nbox)
+        return;
+
+#ifdef GLAMOR
+    if (xboat_glamor) {
+        xboat_glamor_damage_redisplay(scrpriv->glamor, region);
+        return;
+    }
+#endif
+
+    if (HostBoatWantDamageDebug) {
+        for (i = 0; i < nbox; i++)
+            hostboat_paint_debug_rect(screen, pbox[i].x1, pbox[i].y1,
+                                      pbox[i].x2 - pbox[i].x1,
+                                      pbox[i].y2 - pbox[i].y1);
     }
 
-    xboat_image_put(scrpriv->ximg, scrpriv->win, sx, sy, dx, dy, width, height);
+    /* When the depth does not match, the boxes get converted from
+     * fb_data while being copied to the window.
+     */
+    hostboat_put_boxes(scrpriv, 0, 0, RegionExtents(region), pbox, nbox);
 }
 
 static void
@@ -678,34 +1239,63 @@ hostboat_size_set_from_configure(Bool ss)
     HostBoat.size_set_from_configure = ss;
 }
 
-BoatEvent *
-hostboat_get_event(Bool queued_only)
+#define hostboat_event_count() (HostBoat.events_tail - HostBoat.events_head)
+#define hostboat_event_at(_i) \
+    (&HostBoat.events[(_i) & (HOSTBOAT_EVENT_RING_SIZE - 1)])
+
+/*
+ * Reads every event Boat has pending into the ring, in one pass and
+ * without allocating.  A motion event following another one still in
+ * the ring with the same button state replaces it, so a backlog of
+ * motion collapses into the last position.
+ */
+static void
+hostboat_read_events(void)
 {
-    BoatEvent *xev = NULL;
+    BoatEvent *last = NULL;
 
-    if (HostBoat.saved_event) {
-        xev = HostBoat.saved_event;
-        HostBoat.saved_event = NULL;
-    } else {
-        if (queued_only) {
-            xev = NULL; // xcb_poll_for_queued_event(HostBoat.conn);
-        } else {
-            xev = malloc(sizeof(BoatEvent));
-            if (!boatWaitForEvent(0) || !boatPollEvent(xev)) {
-                free(xev);
-                xev = NULL;
-            }
+    if (hostboat_event_count())
+        last = hostboat_event_at(HostBoat.events_tail - 1);
+
+    while (hostboat_event_count() < HOSTBOAT_EVENT_RING_SIZE &&
+           boatWaitForEvent(0)) {
+        BoatEvent *xev = hostboat_event_at(HostBoat.events_tail);
+
+        if (!boatPollEvent(xev))
+            break;
+
+        if (xev->type == MotionNotify && last &&
+            last->type == MotionNotify && last->state == xev->state) {
+            *last = *xev;
+            continue;
         }
+
+        HostBoat.events_tail++;
+        last = xev;
     }
-    return xev;
+}
+
+/**
+ * Returns the next host event, or NULL if there is none.  The event is
+ * only valid until the next call.  With @queued_only, Boat is not asked
+ * for new events.
+ */
+BoatEvent *
+hostboat_get_event(Bool queued_only)
+{
+    if (!hostboat_event_count() && !queued_only)
+        hostboat_read_events();
+
+    if (!hostboat_event_count())
+        return NULL;
+
+    return hostboat_event_at(HostBoat.events_head++);
 }
 
 Bool
 hostboat_has_queued_event(void)
 {
-    if (!HostBoat.saved_event)
-        HostBoat.saved_event = NULL; // xcb_poll_for_queued_event(HostBoat.conn);
-    return HostBoat.saved_event != NULL;
+    return hostboat_event_count() != 0;
 }
 
 int
@@ -790,6 +1380,8 @@ xboat_glamor_create_screen_resources(ScreenPtr pScreen)
         return FALSE;
 
     xboat_glamor_set_texture(scrpriv->glamor, tex);
+    xboat_glamor_set_rotation(scrpriv->glamor, scrpriv->randr,
+                              pScreen->width, pScreen->height);
 
     return TRUE;
 }
@@ -58,6 +58,9 @@ void
 void
  hostboat_use_fullscreen(void);
 
+void
+ hostboat_use_shared_fb(void);
+
 int
  hostboat_want_fullscreen(void);
 
@@ -82,6 +85,9 @@ hostboat_set_win_title(KdScreenInfo *screen, const char *extra_text);
 int
  hostboat_get_depth(void);
 
+int
+ hostboat_get_refresh_rate(void);
+
 int
 hostboat_get_server_depth(KdScreenInfo *screen);
 
@@ -102,6 +108,9 @@ void
 hostboat_paint_rect(KdScreenInfo *screen,
                  int sx, int sy, int dx, int dy, int width, int height);
 
+void
+hostboat_paint_region(KdScreenInfo *screen, RegionPtr region);
+
 Bool
 hostboat_load_keymap(KeySymsPtr keySyms, CARD8 *modmap, XkbControlsPtr controls);
 
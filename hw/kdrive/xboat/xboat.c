@@ -58,6 +58,12 @@ Bool XboatWantGrayScale = 0;
 Bool XboatWantResize = 0;
 Bool XboatWantNoHostGrab = 0;
 
+/* Length of a host frame in microseconds, 0 to update the host window
+ * whenever the server goes idle.  Negative until set from -present-rate
+ * or the host refresh rate.
+ */
+static int xboatPresentInterval = -1;
+
 Bool
 xboatInitialize(KdCardInfo * card, XboatPriv * priv)
 {
@@ -228,7 +234,11 @@ xboatMapFramebuffer(KdScreenInfo * screen)
                           screen->width, screen->height, buffer_height,
                           &priv->bytes_per_line, &screen->fb.bitsPerPixel);
 
-    if ((scrpriv->randr & RR_Rotate_0) && !(scrpriv->randr & RR_Reflect_All)) {
+    /* glamor rotates and reflects while presenting the screen pixmap,
+     * see xboat_glamor_set_rotation().
+     */
+    if (xboat_glamor ||
+        ((scrpriv->randr & RR_Rotate_0) && !(scrpriv->randr & RR_Reflect_All))) {
         scrpriv->shadow = FALSE;
 
         screen->fb.byteStride = priv->bytes_per_line;
@@ -248,6 +258,29 @@ xboatMapFramebuffer(KdScreenInfo * screen)
     return TRUE;
 }
 
+/**
+ * Point the screen at another framebuffer of the same layout, for hosts
+ * that flip between buffers shared with the compositor.
+ */
+void
+xboatSetFramebuffer(KdScreenInfo * screen, void *base)
+{
+    XboatScrPriv *scrpriv = screen->driver;
+    XboatPriv *priv = screen->card->driver;
+    ScreenPtr pScreen = screen->pScreen;
+
+    priv->base = base;
+
+    /* The shadow update writes to priv->base */
+    if (scrpriv->shadow)
+        return;
+
+    screen->fb.frameBuffer = (CARD8 *) base;
+    if (pScreen)
+        (*pScreen->ModifyPixmapHeader) (fbGetScreenPixmap(pScreen),
+                                        0, 0, 0, 0, 0, base);
+}
+
 void
 xboatSetScreenSizes(ScreenPtr pScreen)
 {
@@ -282,20 +315,210 @@ xboatUnmapFramebuffer(KdScreenInfo * screen)
     return TRUE;
 }
 
+/* Rotated copies are done in square tiles of this many pixels, so that
+ * the shadow lines read for the 90/270 cases stay in the cache while
+ * the framebuffer is written one row at a time.
+ */
+#define XBOAT_ROTATE_TILE 32
+
+/* Walking directions, as in shrotate.c */
+#define LEFT_TO_RIGHT	1
+#define RIGHT_TO_LEFT	-1
+#define TOP_TO_BOTTOM	2
+#define BOTTOM_TO_TOP	-2
+
+#define XBOAT_ROTATE_BOX(name, type)                                    \
+static void                                                             \
+name(type *dst, FbStride dstStride, const type *src,                    \
+     FbStride srcStepX, FbStride srcStepY, int w, int h)                \
+{                                                                       \
+    int tx, ty, x, y, tw, th;                                           \
+                                                                        \
+    for (ty = 0; ty < h; ty += XBOAT_ROTATE_TILE) {                     \
+        th = min(h - ty, XBOAT_ROTATE_TILE);                            \
+        for (tx = 0; tx < w; tx += XBOAT_ROTATE_TILE) {                 \
+            tw = min(w - tx, XBOAT_ROTATE_TILE);                        \
+            for (y = ty; y < ty + th; y++) {                            \
+                type *d = dst + y * dstStride + tx;                     \
+                const type *s = src + y * srcStepY + tx * srcStepX;     \
+                                                                        \
+                for (x = 0; x < tw; x++, s += srcStepX)                 \
+                    d[x] = *s;                                          \
+            }                                                           \
+        }                                                               \
+    }                                                                   \
+}
+
+XBOAT_ROTATE_BOX(xboatRotateBox8, CARD8)
+XBOAT_ROTATE_BOX(xboatRotateBox16, CARD16)
+XBOAT_ROTATE_BOX(xboatRotateBox32, CARD32)
+
+/*
+ * Maps a box of the shadow onto the framebuffer following the rotation
+ * and reflection in 'randr', the same way shadowUpdateRotatePacked walks
+ * it.  Returns the shadow pixel shown at the framebuffer box origin and
+ * the shadow steps, in pixels, for one framebuffer pixel right and down.
+ */
+static void
+xboatRotateBoxCoords(int randr, int shaWidth, int shaHeight,
+                     FbStride shaStride, const BoxRec *sha, BoxPtr scr,
+                     FbStride *origin, FbStride *stepX, FbStride *stepY)
+{
+    int x_dir = LEFT_TO_RIGHT, y_dir = TOP_TO_BOTTOM;
+    int o_x_dir = LEFT_TO_RIGHT, o_y_dir = TOP_TO_BOTTOM;
+    int sha_x = 0, sha_y = 0;
+
+    if (randr & RR_Reflect_X)
+        o_x_dir = -o_x_dir;
+    if (randr & RR_Reflect_Y)
+        o_y_dir = -o_y_dir;
+    switch (randr & RR_Rotate_All) {
+    case RR_Rotate_0:
+    default:
+        x_dir = o_x_dir;
+        y_dir = o_y_dir;
+        break;
+    case RR_Rotate_90:
+        x_dir = o_y_dir;
+        y_dir = -o_x_dir;
+        break;
+    case RR_Rotate_180:
+        x_dir = -o_x_dir;
+        y_dir = -o_y_dir;
+        break;
+    case RR_Rotate_270:
+        x_dir = -o_y_dir;
+        y_dir = o_x_dir;
+        break;
+    }
+
+    switch (x_dir) {
+    case LEFT_TO_RIGHT:
+        scr->x1 = sha->x1;
+        scr->x2 = sha->x2;
+        sha_x = sha->x1;
+        *stepX = 1;
+        break;
+    case TOP_TO_BOTTOM:
+        scr->x1 = sha->y1;
+        scr->x2 = sha->y2;
+        sha_y = sha->y1;
+        *stepX = shaStride;
+        break;
+    case RIGHT_TO_LEFT:
+        scr->x1 = shaWidth - sha->x2;
+        scr->x2 = shaWidth - sha->x1;
+        sha_x = sha->x2 - 1;
+        *stepX = -1;
+        break;
+    case BOTTOM_TO_TOP:
+        scr->x1 = shaHeight - sha->y2;
+        scr->x2 = shaHeight - sha->y1;
+        sha_y = sha->y2 - 1;
+        *stepX = -shaStride;
+        break;
+    }
+    switch (y_dir) {
+    case TOP_TO_BOTTOM:
+        scr->y1 = sha->y1;
+        scr->y2 = sha->y2;
+        sha_y = sha->y1;
+        *stepY = shaStride;
+        break;
+    case RIGHT_TO_LEFT:
+        scr->y1 = shaWidth - sha->x2;
+        scr->y2 = shaWidth - sha->x1;
+        sha_x = sha->x2 - 1;
+        *stepY = -1;
+        break;
+    case BOTTOM_TO_TOP:
+        scr->y1 = shaHeight - sha->y2;
+        scr->y2 = shaHeight - sha->y1;
+        sha_y = sha->y2 - 1;
+        *stepY = -shaStride;
+        break;
+    case LEFT_TO_RIGHT:
+        scr->y1 = sha->x1;
+        scr->y2 = sha->x2;
+        sha_x = sha->x1;
+        *stepY = 1;
+        break;
+    }
+
+    *origin = sha_y * shaStride + sha_x;
+}
+
 void
 xboatShadowUpdate(ScreenPtr pScreen, shadowBufPtr pBuf)
 {
     KdScreenPriv(pScreen);
     KdScreenInfo *screen = pScreenPriv->screen;
+    XboatPriv *priv = screen->card->driver;
+    RegionPtr damage = DamageRegion(pBuf->pDamage);
+    PixmapPtr pShadow = pBuf->pPixmap;
+    int nbox = RegionNumRects(damage);
+    BoxPtr pbox = RegionRects(damage);
+    FbBits *shaBits;
+    FbStride shaStride, dstStride, origin, stepX, stepY;
+    int shaBpp;
+    _X_UNUSED int shaXoff, shaYoff;
+    RegionRec region, boxRegion;
+    BoxRec box;
+    CARD8 *dst;
+    int i;
 
-    XBOAT_LOG("slow paint");
+    fbGetDrawable(&pShadow->drawable, shaBits, shaStride, shaBpp, shaXoff,
+                  shaYoff);
+
+    if (shaBpp != 8 && shaBpp != 16 && shaBpp != 32) {
+        XBOAT_LOG("slow paint");
+        shadowUpdateRotatePacked(pScreen, pBuf);
+        hostboat_paint_rect(screen, 0, 0, 0, 0, screen->width, screen->height);
+        return;
+    }
 
-    /* FIXME: Slow Rotated/Reflected updates could be much
-     * much faster efficiently updating via tranforming
-     * pBuf->pDamage  regions
+    /* Rotate only the damaged boxes, straight into the framebuffer, and
+     * post their rotated counterparts to the host.
      */
-    shadowUpdateRotatePacked(pScreen, pBuf);
-    hostboat_paint_rect(screen, 0, 0, 0, 0, screen->width, screen->height);
+    shaStride = shaStride * (FB_UNIT / shaBpp);
+    dstStride = priv->bytes_per_line / (shaBpp >> 3);
+    RegionNull(&region);
+
+    for (i = 0; i < nbox; i++) {
+        xboatRotateBoxCoords(pBuf->randr,
+                             pShadow->drawable.width, pShadow->drawable.height,
+                             shaStride, &pbox[i], &box,
+                             &origin, &stepX, &stepY);
+        if (box.x1 >= box.x2 || box.y1 >= box.y2)
+            continue;
+
+        dst = priv->base + box.y1 * priv->bytes_per_line +
+            box.x1 * (shaBpp >> 3);
+        switch (shaBpp) {
+        case 8:
+            xboatRotateBox8((CARD8 *) dst, dstStride,
+                            (CARD8 *) shaBits + origin, stepX, stepY,
+                            box.x2 - box.x1, box.y2 - box.y1);
+            break;
+        case 16:
+            xboatRotateBox16((CARD16 *) dst, dstStride,
+                             (CARD16 *) shaBits + origin, stepX, stepY,
+                             box.x2 - box.x1, box.y2 - box.y1);
+            break;
+        case 32:
+            xboatRotateBox32((CARD32 *) dst, dstStride,
+                             (CARD32 *) shaBits + origin, stepX, stepY,
+                             box.x2 - box.x1, box.y2 - box.y1);
+            break;
+        }
+
+        RegionInit(&boxRegion, &box, 1);
+        RegionUnion(&region, &region, &boxRegion);
+        RegionUninit(&boxRegion);
+    }
+
+    hostboat_paint_region(screen, &region);
+    RegionUninit(&region);
 }
 
 static void
@@ -312,34 +535,96 @@ xboatInternalDamageRedisplay(ScreenPtr pScreen)
     pRegion = DamageRegion(scrpriv->pDamage);
 
     if (RegionNotEmpty(pRegion)) {
-        int nbox;
-        BoxPtr pbox;
-
-        if (xboat_glamor) {
-            xboat_glamor_damage_redisplay(scrpriv->glamor, pRegion);
-        } else {
-            nbox = RegionNumRects(pRegion);
-            pbox = RegionRects(pRegion);
-
-            while (nbox--) {
-                hostboat_paint_rect(screen,
-                                 pbox->x1, pbox->y1,
-                                 pbox->x1, pbox->y1,
-                                 pbox->x2 - pbox->x1, pbox->y2 - pbox->y1);
-                pbox++;
-            }
-        }
+        hostboat_paint_region(screen, pRegion);
         DamageEmpty(scrpriv->pDamage);
     }
 }
 
+void
+xboatSetPresentRate(int rate)
+{
+    xboatPresentInterval = rate > 0 ? 1000000 / rate : 0;
+}
+
+/**
+ * Returns the length of a host frame in microseconds.  Frames tick at
+ * the presentation rate, or at the host refresh rate when host window
+ * updates are not paced.
+ */
+CARD64
+xboatFrameInterval(void)
+{
+    if (xboatPresentInterval < 0)
+        xboatSetPresentRate(hostboat_get_refresh_rate());
+
+    if (xboatPresentInterval > 0)
+        return xboatPresentInterval;
+
+    return 1000000 / hostboat_get_refresh_rate();
+}
+
+/**
+ * Returns the current host frame counter, and the time that frame
+ * started at.
+ */
+void
+xboatGetUstMsc(uint64_t *ust, uint64_t *msc)
+{
+    CARD64 interval = xboatFrameInterval();
+
+    *msc = GetTimeInMicros() / interval;
+    *ust = *msc * interval;
+}
+
+/**
+ * Flushes the accumulated damage to the host window, at most once per
+ * host frame.  Damage arriving sooner is coalesced and the server is
+ * woken up again when the next frame starts, unless an immediate update
+ * was requested through present_urgent.
+ */
 static void
-xboatBoatProcessEvents(Bool queued_only);
+xboatSchedulePresent(ScreenPtr pScreen, void *timeout)
+{
+    KdScreenPriv(pScreen);
+    KdScreenInfo *screen = pScreenPriv->screen;
+    XboatScrPriv *scrpriv = screen->driver;
+    uint64_t ust, msc;
+    Bool urgent;
+
+    if (!RegionNotEmpty(DamageRegion(scrpriv->pDamage)))
+        return;
+
+    /* Set from the input thread as well */
+    input_lock();
+    urgent = scrpriv->present_urgent;
+    scrpriv->present_urgent = FALSE;
+    input_unlock();
+
+    xboatGetUstMsc(&ust, &msc);
+
+    if (urgent || xboatPresentInterval == 0 ||
+        msc != scrpriv->last_present_msc) {
+        xboatInternalDamageRedisplay(pScreen);
+        scrpriv->last_present_msc = msc;
+        xboatPresentFrameDone(pScreen, ust, msc);
+    }
+    else {
+        CARD64 next = ust + xboatFrameInterval();
+
+        AdjustWaitForDelay(timeout, (next - GetTimeInMicros() + 999) / 1000);
+    }
+}
+
+static Bool
+xboatHasMainEvents(void);
+
+static void
+xboatProcessMainEvents(void);
 
 static Bool
 xboatEventWorkProc(ClientPtr client, void *closure)
 {
-    xboatBoatProcessEvents(TRUE);
+    xboatProcessMainEvents();
     return TRUE;
 }
 
@@ -356,9 +641,9 @@ xboatScreenBlockHandler(ScreenPtr pScreen, void *timeout)
     pScreen->BlockHandler = xboatScreenBlockHandler;
 
     if (scrpriv->pDamage)
-        xboatInternalDamageRedisplay(pScreen);
+        xboatSchedulePresent(pScreen, timeout);
 
-    if (hostboat_has_queued_event()) {
+    if (xboatHasMainEvents()) {
         if (!QueueWorkProc(xboatEventWorkProc, NULL, NULL))
             FatalError("cannot queue event processing in xboat block handler");
         AdjustWaitForDelay(timeout, 0);
@@ -691,6 +976,11 @@ xboatFinishInitScreen(ScreenPtr pScreen)
         return FALSE;
 #endif
 
+#ifdef PRESENT
+    if (!xboatPresentInit(pScreen))
+        return FALSE;
+#endif
+
     scrpriv->BlockHandler = pScreen->BlockHandler;
     pScreen->BlockHandler = xboatScreenBlockHandler;
 
@@ -743,6 +1033,9 @@ void
 xboatCloseScreen(ScreenPtr pScreen)
 {
     xboatUnsetInternalDamage(pScreen);
+#ifdef PRESENT
+    xboatPresentFini(pScreen);
+#endif
 }
 
 /*
@@ -862,6 +1155,9 @@ xboatProcessExpose(BoatEvent *xev)
 {
 }
 
+static void
+xboatQueueMainEvent(BoatEvent *xev);
+
 static void
 xboatProcessMouseMotion(BoatEvent *xev)
 {
@@ -879,8 +1175,8 @@ xboatProcessMouseMotion(BoatEvent *xev)
                   "cur_screen:%d, motion_screen:%d\n",
                   xboatCursorScreen ? xboatCursorScreen->myNum : -1,
                   screen->pScreen->myNum);
-        xboatWarpCursor(inputInfo.pointer, screen->pScreen,
-                        motion->x, motion->y);
+        /* Warping moves the sprite, that's up to the main thread */
+        xboatQueueMainEvent(motion);
     }
     else {
         int x = 0, y = 0;
@@ -896,10 +1192,27 @@ xboatProcessMouseMotion(BoatEvent *xev)
         x += screen->pScreen->x;
         y += screen->pScreen->y;
 
+        /* Don't hold back the cursor movement until the next frame */
+        input_lock();
+        ((XboatScrPriv *) screen->driver)->present_urgent = TRUE;
+        input_unlock();
+
         KdEnqueuePointerEvent(xboatMouse, mouseState | KD_POINTER_DESKTOP, x, y, 0);
     }
 }
 
+/* Warps the cursor to the screen the motion happened on, see
+ * xboatProcessMouseMotion().
+ */
+static void
+xboatProcessWarp(BoatEvent *xev)
+{
+    KdScreenInfo *screen = screen_from_window(boatGetNativeWindow());
+
+    if (xboatCursorScreen != screen->pScreen)
+        xboatWarpCursor(inputInfo.pointer, screen->pScreen, xev->x, xev->y);
+}
+
 static void
 xboatProcessButtonPress(BoatEvent *xev)
 {
@@ -956,34 +1269,42 @@ xboatProcessKeyPress(BoatEvent *xev)
     KdEnqueueKeyboardEvent(xboatKbd, key->keycode, FALSE);
 }
 
+/* Grabbing talks to Boat, so it runs on the main thread, see
+ * xboatProcessMainEvents().
+ */
+static void
+xboatProcessGrabKey(BoatEvent *xev)
+{
+    static int grabbed_screen = -1;
+    KdScreenInfo *screen = screen_from_window(boatGetNativeWindow());
+    XboatScrPriv *scrpriv = screen->driver;
+
+    if (grabbed_screen != -1) {
+        // ungrabbing keyboard not really supported
+        boatSetCursorMode(CursorEnabled);
+        grabbed_screen = -1;
+        hostboat_set_win_title(screen,
+                            "(touch Grab to grab mouse and keyboard)");
+    }
+    else {
+        // grabbing keyboard not really supported
+        boatSetCursorMode(CursorDisabled);
+        grabbed_screen = scrpriv->mynum;
+        hostboat_set_win_title
+            (screen,
+             "(touch Grab to release mouse and keyboard)");
+    }
+}
+
 static void
 xboatProcessKeyRelease(BoatEvent *xev)
 {
     BoatEvent *key = xev;
-    static int grabbed_screen = -1;
 
     // xboat: KEY_MENU is hardly ever used,
     //        so we take it as grab mode trigger
-    if (!XboatWantNoHostGrab && key->keycode == KEY_MENU) {
-        KdScreenInfo *screen = screen_from_window(boatGetNativeWindow());
-        XboatScrPriv *scrpriv = screen->driver;
-
-        if (grabbed_screen != -1) {
-            // ungrabbing keyboard not really supported
-            boatSetCursorMode(CursorEnabled);
-            grabbed_screen = -1;
-            hostboat_set_win_title(screen,
-                                "(touch Grab to grab mouse and keyboard)");
-        }
-        else {
-            // grabbing keyboard not really supported
-            boatSetCursorMode(CursorDisabled);
-            grabbed_screen = scrpriv->mynum;
-            hostboat_set_win_title
-                (screen,
-                 "(touch Grab to release mouse and keyboard)");
-        }
-    }
+    if (!XboatWantNoHostGrab && key->keycode == KEY_MENU)
+        xboatQueueMainEvent(xev);
 
     if (!xboatKbd ||
         !((XboatKbdPrivate *) xboatKbd->driverPrivate)->enabled) {
@@ -1027,18 +1348,121 @@ xboatProcessBoatMessage(BoatEvent *xev)
     }
 }
 
+/* Host events that have to be handled on the main thread, queued by
+ * xboatBoatNotify() and protected by the input lock.  The queue grows
+ * while the main thread is busy, so nothing is dropped.
+ */
+#define XBOAT_MAIN_EVENTS 16
+
+static BoatEvent *xboatMainEvents;
+static int xboatNumMainEvents;
+static int xboatMainEventsSize;
+
 static void
-xboatBoatProcessEvents(Bool queued_only)
+xboatQueueMainEvent(BoatEvent *xev)
 {
-    BoatEvent *configure = NULL;
+    int i;
+
+    /* Only the last size of the window and the last warp matter */
+    if (xev->type == ConfigureNotify || xev->type == MotionNotify) {
+        for (i = 0; i < xboatNumMainEvents; i++) {
+            if (xboatMainEvents[i].type == xev->type) {
+                xboatMainEvents[i] = *xev;
+                return;
+            }
+        }
+    }
 
-    while (TRUE) {
-        BoatEvent *xev = hostboat_get_event(queued_only);
+    if (xboatNumMainEvents == xboatMainEventsSize) {
+        int size = xboatMainEventsSize ?
+            2 * xboatMainEventsSize : XBOAT_MAIN_EVENTS;
+        BoatEvent *events = reallocarray(xboatMainEvents, size,
+                                         sizeof(BoatEvent));
+
+        if (!events) {
+            ErrorF("Xboat: out of memory, dropping host event %d\n",
+                   xev->type);
+            return;
+        }
+        xboatMainEvents = events;
+        xboatMainEventsSize = size;
+    }
+
+    xboatMainEvents[xboatNumMainEvents++] = *xev;
+}
+
+static Bool
+xboatHasMainEvents(void)
+{
+    Bool pending;
+
+    input_lock();
+    pending = xboatNumMainEvents != 0;
+    input_unlock();
 
-        if (!xev) {
+    return pending;
+}
+
+static void
+xboatProcessMainEvents(void)
+{
+    BoatEvent *events;
+    int i, n, size;
+
+    /* Take the queue, so the input thread can go on queueing while the
+     * events are processed, and hand the buffer back afterwards.
+     */
+    input_lock();
+    events = xboatMainEvents;
+    n = xboatNumMainEvents;
+    size = xboatMainEventsSize;
+    xboatMainEvents = NULL;
+    xboatNumMainEvents = xboatMainEventsSize = 0;
+    input_unlock();
+
+    for (i = 0; i < n; i++) {
+        switch (events[i].type) {
+        case MotionNotify:
+            xboatProcessWarp(&events[i]);
+            break;
+
+        case KeyRelease:
+            xboatProcessGrabKey(&events[i]);
+            break;
+
+        case ConfigureNotify:
+            xboatProcessConfigureNotify(&events[i]);
+            break;
+
+        case BoatMessage:
+            xboatProcessBoatMessage(&events[i]);
             break;
         }
+    }
+
+    input_lock();
+    if (!xboatMainEvents) {
+        xboatMainEvents = events;
+        xboatMainEventsSize = size;
+        events = NULL;
+    }
+    input_unlock();
+    free(events);
+}
+
+/*
+ * Reads the host events.  This runs on the input thread when there is
+ * one, so input is delivered while the main thread is busy with clients;
+ * everything else is queued for the main thread.
+ */
+static void
+xboatBoatNotify(int fd, int ready, void *data)
+{
+    BoatEvent *xev;
+
+    input_lock();
 
+    while ((xev = hostboat_get_event(FALSE))) {
         switch (xev->type) {
         case -1:
             xboatProcessErrorEvent(xev);
@@ -1064,32 +1488,13 @@ xboatBoatProcessEvents(Bool queued_only)
             xboatProcessButtonRelease(xev);
             break;
 
-        case ConfigureNotify:
-            free(configure);
-            configure = xev;
-            xev = NULL;
+        default:
+            xboatQueueMainEvent(xev);
             break;
-
-        case BoatMessage:
-            xboatProcessBoatMessage(xev);
-            break;
-        }
-
-        if (xev) {
-            free(xev);
         }
     }
 
-    if (configure) {
-        xboatProcessConfigureNotify(configure);
-        free(configure);
-    }
-}
-
-static void
-xboatBoatNotify(int fd, int ready, void *data)
-{
-    xboatBoatProcessEvents(FALSE);
+    input_unlock();
 }
 
 void
@@ -1183,7 +1588,7 @@ static Status
 MouseEnable(KdPointerInfo * pi)
 {
     ((XboatPointerPrivate *) pi->driverPrivate)->enabled = TRUE;
-    SetNotifyFd(hostboat_get_fd(), xboatBoatNotify, X_NOTIFY_READ, NULL);
+    InputThreadRegisterDev(hostboat_get_fd(), xboatBoatNotify, NULL);
     return Success;
 }
 
@@ -1191,7 +1596,7 @@ static void
 MouseDisable(KdPointerInfo * pi)
 {
     ((XboatPointerPrivate *) pi->driverPrivate)->enabled = FALSE;
-    RemoveNotifyFd(hostboat_get_fd());
+    InputThreadUnregisterDev(hostboat_get_fd());
     return;
 }
 
@@ -77,10 +77,20 @@ typedef struct _xboatScrPriv {
 
     KdScreenInfo *screen;
     int mynum;                  /* Screen number */
-    unsigned long cmap[256];
+    uint32_t cmap[256];         /* RGBA8888 host pixels, for 8bpp servers */
 
     ScreenBlockHandlerProcPtr   BlockHandler;
 
+    /* Frame pacing of the host window updates */
+    uint64_t last_present_msc;  /* host frame of the last update */
+    Bool present_urgent;        /* update on the next block handler,
+                                 * under input_lock() */
+
+    /**
+     * Per-screen Present extension state (private to xboat_present.c)
+     */
+    struct xboat_present *present;
+
     /**
      * Per-screen EGL-using state for glamor (private to
      * xboat_glamor_egl.c)
@@ -145,6 +155,9 @@ void
 Bool
  xboatMapFramebuffer(KdScreenInfo * screen);
 
+void
+ xboatSetFramebuffer(KdScreenInfo * screen, void *base);
+
 void *xboatWindowLinear(ScreenPtr pScreen,
                         CARD32 row,
                         CARD32 offset, int mode, CARD32 *size, void *closure);
@@ -183,6 +196,15 @@ void
 void
  xboatUpdateModifierState(unsigned int state);
 
+void
+ xboatSetPresentRate(int rate);
+
+CARD64
+ xboatFrameInterval(void);
+
+void
+ xboatGetUstMsc(uint64_t *ust, uint64_t *msc);
+
 extern KdPointerDriver XboatMouseDriver;
 
 extern KdKeyboardDriver XboatKeyboardDriver;
@@ -211,6 +233,18 @@ void xboat_glamor_disable(ScreenPtr pScreen);
 void xboat_glamor_fini(ScreenPtr pScreen);
 void xboat_glamor_host_paint_rect(ScreenPtr pScreen);
 
+/* xboat_present.c */
+#ifdef PRESENT
+Bool xboatPresentInit(ScreenPtr pScreen);
+void xboatPresentFini(ScreenPtr pScreen);
+void xboatPresentFrameDone(ScreenPtr pScreen, uint64_t ust, uint64_t msc);
+#else /* !PRESENT */
+static inline void
+xboatPresentFrameDone(ScreenPtr pScreen, uint64_t ust, uint64_t msc)
+{
+}
+#endif /* !PRESENT */
+
 /* xboat_glamor_xv.c */
 #ifdef GLAMOR
 void xboat_glamor_xv_init(ScreenPtr screen);
@@ -0,0 +1,234 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file xboat_convert.c
+ *
+ * Pixel format conversion from the server framebuffer to the host
+ * window, one row at a time.  The SIMD variants are compiled with
+ * per-function target attributes and selected at runtime on x86, and at
+ * build time on ARM where NEON is part of the target.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define XBOAT_CONVERT_X86 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define XBOAT_CONVERT_NEON 1
+#endif
+
+#include "xboat_convert.h"
+
+/* The host window is RGBA8888, i.e. R in the lowest byte on little
+ * endian hosts, which is all Android runs on.
+ */
+static inline uint32_t
+xboat_convert_rgb565_pixel(uint16_t p)
+{
+    uint32_t r = ((p >> 8) & 0xf8) | (p >> 13);
+    uint32_t g = ((p >> 3) & 0xfc) | ((p >> 9) & 0x03);
+    uint32_t b = ((p << 3) & 0xf8) | ((p >> 2) & 0x07);
+
+    return r | (g << 8) | (b << 16) | 0xff000000;
+}
+
+static void
+xboat_convert_rgb565_row_c(uint32_t *dst, const void *src, int width,
+                           const uint32_t *cmap)
+{
+    const uint16_t *s = src;
+    int i;
+
+    for (i = 0; i < width; i++)
+        dst[i] = xboat_convert_rgb565_pixel(s[i]);
+}
+
+static void
+xboat_convert_pal8_row_c(uint32_t *dst, const void *src, int width,
+                         const uint32_t *cmap)
+{
+    const uint8_t *s = src;
+    int i;
+
+    for (i = 0; i + 4 <= width; i += 4) {
+        dst[i + 0] = cmap[s[i + 0]];
+        dst[i + 1] = cmap[s[i + 1]];
+        dst[i + 2] = cmap[s[i + 2]];
+        dst[i + 3] = cmap[s[i + 3]];
+    }
+    for (; i < width; i++)
+        dst[i] = cmap[s[i]];
+}
+
+#ifdef XBOAT_CONVERT_X86
+__attribute__((target("sse2")))
+static void
+xboat_convert_rgb565_row_sse2(uint32_t *dst, const void *src, int width,
+                              const uint32_t *cmap)
+{
+    const uint16_t *s = src;
+    const __m128i mask_f8 = _mm_set1_epi16(0xf8);
+    const __m128i mask_fc = _mm_set1_epi16(0xfc);
+    const __m128i mask_07 = _mm_set1_epi16(0x07);
+    const __m128i mask_03 = _mm_set1_epi16(0x03);
+    const __m128i alpha = _mm_set1_epi16((short) 0xff00);
+    int i;
+
+    for (i = 0; i + 8 <= width; i += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i *) (s + i));
+        __m128i r, g, b, rg, ba;
+
+        r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 8), mask_f8),
+                         _mm_srli_epi16(p, 13));
+        g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 3), mask_fc),
+                         _mm_and_si128(_mm_srli_epi16(p, 9), mask_03));
+        b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(p, 3), mask_f8),
+                         _mm_and_si128(_mm_srli_epi16(p, 2), mask_07));
+
+        rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        ba = _mm_or_si128(b, alpha);
+
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+    }
+
+    xboat_convert_rgb565_row_c(dst + i, s + i, width - i, cmap);
+}
+
+__attribute__((target("avx2")))
+static void
+xboat_convert_rgb565_row_avx2(uint32_t *dst, const void *src, int width,
+                              const uint32_t *cmap)
+{
+    const uint16_t *s = src;
+    const __m256i mask_f8 = _mm256_set1_epi16(0xf8);
+    const __m256i mask_fc = _mm256_set1_epi16(0xfc);
+    const __m256i mask_07 = _mm256_set1_epi16(0x07);
+    const __m256i mask_03 = _mm256_set1_epi16(0x03);
+    const __m256i alpha = _mm256_set1_epi16((short) 0xff00);
+    int i;
+
+    for (i = 0; i + 16 <= width; i += 16) {
+        __m256i p = _mm256_loadu_si256((const __m256i *) (s + i));
+        __m256i r, g, b, rg, ba, lo, hi;
+
+        r = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(p, 8), mask_f8),
+                            _mm256_srli_epi16(p, 13));
+        g = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(p, 3), mask_fc),
+                            _mm256_and_si256(_mm256_srli_epi16(p, 9), mask_03));
+        b = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(p, 3), mask_f8),
+                            _mm256_and_si256(_mm256_srli_epi16(p, 2), mask_07));
+
+        rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+        ba = _mm256_or_si256(b, alpha);
+
+        /* unpack works within 128 bit lanes: lo holds pixels 0-3 and
+         * 8-11, hi holds 4-7 and 12-15.
+         */
+        lo = _mm256_unpacklo_epi16(rg, ba);
+        hi = _mm256_unpackhi_epi16(rg, ba);
+
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) (dst + i + 8),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    xboat_convert_rgb565_row_sse2(dst + i, s + i, width - i, cmap);
+}
+
+__attribute__((target("avx2")))
+static void
+xboat_convert_pal8_row_avx2(uint32_t *dst, const void *src, int width,
+                            const uint32_t *cmap)
+{
+    const uint8_t *s = src;
+    int i;
+
+    for (i = 0; i + 8 <= width; i += 8) {
+        __m256i idx =
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (s + i)));
+
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                            _mm256_i32gather_epi32((const int *) cmap, idx, 4));
+    }
+
+    xboat_convert_pal8_row_c(dst + i, s + i, width - i, cmap);
+}
+#endif /* XBOAT_CONVERT_X86 */
+
+#ifdef XBOAT_CONVERT_NEON
+static void
+xboat_convert_rgb565_row_neon(uint32_t *dst, const void *src, int width,
+                              const uint32_t *cmap)
+{
+    const uint16_t *s = src;
+    const uint16x8_t mask_f8 = vdupq_n_u16(0xf8);
+    const uint16x8_t mask_fc = vdupq_n_u16(0xfc);
+    const uint16x8_t mask_07 = vdupq_n_u16(0x07);
+    const uint16x8_t mask_03 = vdupq_n_u16(0x03);
+    int i;
+
+    for (i = 0; i + 8 <= width; i += 8) {
+        uint16x8_t p = vld1q_u16(s + i);
+        uint8x8x4_t out;
+
+        out.val[0] = vmovn_u16(vorrq_u16(vandq_u16(vshrq_n_u16(p, 8), mask_f8),
+                                         vshrq_n_u16(p, 13)));
+        out.val[1] = vmovn_u16(vorrq_u16(vandq_u16(vshrq_n_u16(p, 3), mask_fc),
+                                         vandq_u16(vshrq_n_u16(p, 9), mask_03)));
+        out.val[2] = vmovn_u16(vorrq_u16(vandq_u16(vshlq_n_u16(p, 3), mask_f8),
+                                         vandq_u16(vshrq_n_u16(p, 2), mask_07)));
+        out.val[3] = vdup_n_u8(0xff);
+
+        /* interleaving store, giving R, G, B, A bytes per pixel */
+        vst4_u8((uint8_t *) (dst + i), out);
+    }
+
+    xboat_convert_rgb565_row_c(dst + i, s + i, width - i, cmap);
+}
+#endif /* XBOAT_CONVERT_NEON */
+
+xboat_convert_row_proc xboat_convert_rgb565_row = xboat_convert_rgb565_row_c;
+xboat_convert_row_proc xboat_convert_pal8_row = xboat_convert_pal8_row_c;
+
+void
+xboat_convert_init(void)
+{
+#ifdef XBOAT_CONVERT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        xboat_convert_rgb565_row = xboat_convert_rgb565_row_avx2;
+        xboat_convert_pal8_row = xboat_convert_pal8_row_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        xboat_convert_rgb565_row = xboat_convert_rgb565_row_sse2;
+    }
+#endif
+#ifdef XBOAT_CONVERT_NEON
+    xboat_convert_rgb565_row = xboat_convert_rgb565_row_neon;
+#endif
+}
@@ -0,0 +1,54 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * xboat_convert.h
+ *
+ * Row converters from the server framebuffer formats to the RGBA8888
+ * host window format, used when the server depth does not match the
+ * host.  Prototypes exposed by xboat_convert.c, without including any
+ * server headers.
+ */
+
+#ifndef _XBOAT_CONVERT_H_
+#define _XBOAT_CONVERT_H_
+
+#include <stdint.h>
+
+/**
+ * Converts 'width' pixels from 'src' to RGBA8888 pixels in 'dst'.
+ * 'cmap' is only used by the indexed formats.
+ */
+typedef void (*xboat_convert_row_proc)(uint32_t *dst, const void *src,
+                                       int width, const uint32_t *cmap);
+
+/* R5G6B5, with the components expanded to full 8 bit range */
+extern xboat_convert_row_proc xboat_convert_rgb565_row;
+/* 8 bit colormap indices */
+extern xboat_convert_row_proc xboat_convert_pal8_row;
+
+/**
+ * Picks the fastest converters the CPU supports.
+ */
+void
+xboat_convert_init(void);
+
+#endif /* _XBOAT_CONVERT_H_ */
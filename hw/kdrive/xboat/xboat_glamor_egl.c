@@ -31,6 +31,7 @@
 #include <boat.h>
 #include <pixman.h>
 #include <epoxy/egl.h>
+#include <X11/extensions/randr.h>
 #include "xboat_glamor_egl.h"
 #include "os.h"
 
@@ -38,6 +39,11 @@
 /* Xboat has it's own copy of this for build reasons */
 #define GLAMOR_GL_CORE_VER_MAJOR 3
 #define GLAMOR_GL_CORE_VER_MINOR 1
+
+/* Number of previous frames' damage kept for EGL_EXT_buffer_age. Older
+ * back buffers are repainted completely.
+ */
+#define XBOAT_GLAMOR_DAMAGE_HISTORY 4
 /** @{
  *
  * global state for Xboat with glamor.
@@ -67,7 +73,29 @@ struct xboat_glamor {
     /* Size of the window that we're rendering to. */
     unsigned width, height;
 
+    /* RandR rotation and reflection of the screen pixmap in the window,
+     * and the pixmap size.
+     */
+    unsigned rotation;
+    unsigned pixmap_width, pixmap_height;
+
     GLuint vao, vbo;
+
+    /* Partial presentation support of the EGL surface. */
+    Bool has_buffer_age;
+    Bool has_partial_update;
+    Bool has_swap_with_damage_khr;
+    Bool has_swap_with_damage_ext;
+
+    /* Damage of the last frames, newest at damage_history[damage_index]. */
+    pixman_region16_t damage_history[XBOAT_GLAMOR_DAMAGE_HISTORY];
+    int damage_index;
+    /* Number of valid entries in damage_history. */
+    int damage_frames;
+
+    /* Rectangles handed to EGL, in GL window coordinates. */
+    EGLint *rects;
+    int rects_size;
 };
 
 static GLint
@@ -175,10 +203,200 @@ xboat_glamor_connect(void)
     eglInitialize(dpy, NULL, NULL);
 }
 
+static void
+xboat_glamor_reset_damage_history(struct xboat_glamor *glamor)
+{
+    glamor->damage_frames = 0;
+}
+
 void
 xboat_glamor_set_texture(struct xboat_glamor *glamor, uint32_t tex)
 {
     glamor->tex = tex;
+    xboat_glamor_reset_damage_history(glamor);
+}
+
+/* Walking directions through the screen pixmap, as in shrotate.c */
+#define LEFT_TO_RIGHT	1
+#define RIGHT_TO_LEFT	-1
+#define TOP_TO_BOTTOM	2
+#define BOTTOM_TO_TOP	-2
+
+/*
+ * Computes in which direction the screen pixmap is walked when moving
+ * right (@x_dir) and down (@y_dir) in the window.
+ */
+static void
+xboat_glamor_rotation_dirs(unsigned rotation, int *x_dir, int *y_dir)
+{
+    int o_x_dir = LEFT_TO_RIGHT, o_y_dir = TOP_TO_BOTTOM;
+
+    if (rotation & RR_Reflect_X)
+        o_x_dir = -o_x_dir;
+    if (rotation & RR_Reflect_Y)
+        o_y_dir = -o_y_dir;
+
+    switch (rotation & (RR_Rotate_0 | RR_Rotate_90 |
+                        RR_Rotate_180 | RR_Rotate_270)) {
+    case RR_Rotate_0:
+    default:
+        *x_dir = o_x_dir;
+        *y_dir = o_y_dir;
+        break;
+    case RR_Rotate_90:
+        *x_dir = o_y_dir;
+        *y_dir = -o_x_dir;
+        break;
+    case RR_Rotate_180:
+        *x_dir = -o_x_dir;
+        *y_dir = -o_y_dir;
+        break;
+    case RR_Rotate_270:
+        *x_dir = -o_y_dir;
+        *y_dir = o_x_dir;
+        break;
+    }
+}
+
+/*
+ * Sets the pixmap coordinate (@u, @v) for a position @w along the
+ * window axis walking the pixmap in direction @dir.  All of them are
+ * normalized to [0, 1].
+ */
+static void
+xboat_glamor_walk(int dir, float w, float *u, float *v)
+{
+    switch (dir) {
+    case LEFT_TO_RIGHT:
+        *u = w;
+        break;
+    case RIGHT_TO_LEFT:
+        *u = 1 - w;
+        break;
+    case TOP_TO_BOTTOM:
+        *v = w;
+        break;
+    case BOTTOM_TO_TOP:
+        *v = 1 - w;
+        break;
+    }
+}
+
+/*
+ * Same as xboat_glamor_walk(), for a span [@p1, @p2) of pixmap
+ * coordinates, giving the span [@w1, @w2) of window coordinates.
+ */
+static void
+xboat_glamor_walk_box(int dir, const pixman_box16_t *box,
+                      unsigned width, unsigned height, int16_t *w1, int16_t *w2)
+{
+    switch (dir) {
+    case LEFT_TO_RIGHT:
+        *w1 = box->x1;
+        *w2 = box->x2;
+        break;
+    case RIGHT_TO_LEFT:
+        *w1 = width - box->x2;
+        *w2 = width - box->x1;
+        break;
+    case TOP_TO_BOTTOM:
+        *w1 = box->y1;
+        *w2 = box->y2;
+        break;
+    case BOTTOM_TO_TOP:
+        *w1 = height - box->y2;
+        *w2 = height - box->y1;
+        break;
+    }
+}
+
+/**
+ * Maps @damage from screen pixmap coordinates to window coordinates
+ * into @window_damage, which must have been initialized.
+ */
+static void
+xboat_glamor_window_damage(struct xboat_glamor *glamor,
+                           pixman_region16_t *damage,
+                           pixman_region16_t *window_damage)
+{
+    pixman_box16_t *boxes, *window_boxes;
+    int x_dir, y_dir;
+    int nbox, i;
+
+    if (glamor->rotation == RR_Rotate_0) {
+        pixman_region_copy(window_damage, damage);
+        return;
+    }
+
+    boxes = pixman_region_rectangles(damage, &nbox);
+    window_boxes = xallocarray(nbox, sizeof(pixman_box16_t));
+    if (!window_boxes) {
+        /* Repaint everything rather than something wrong */
+        pixman_region_fini(window_damage);
+        pixman_region_init_rect(window_damage, 0, 0,
+                                glamor->width, glamor->height);
+        return;
+    }
+
+    xboat_glamor_rotation_dirs(glamor->rotation, &x_dir, &y_dir);
+    for (i = 0; i < nbox; i++) {
+        xboat_glamor_walk_box(x_dir, &boxes[i],
+                              glamor->pixmap_width, glamor->pixmap_height,
+                              &window_boxes[i].x1, &window_boxes[i].x2);
+        xboat_glamor_walk_box(y_dir, &boxes[i],
+                              glamor->pixmap_width, glamor->pixmap_height,
+                              &window_boxes[i].y1, &window_boxes[i].y2);
+    }
+
+    pixman_region_fini(window_damage);
+    pixman_region_init_rects(window_damage, window_boxes, nbox);
+    free(window_boxes);
+}
+
+void
+xboat_glamor_set_rotation(struct xboat_glamor *glamor, unsigned rotation,
+                          unsigned pixmap_width, unsigned pixmap_height)
+{
+    /* Window corners in the order of the position vertices, with a
+     * top-left origin.
+     */
+    static const float corners[] = {
+        0, 1,
+        1, 1,
+        1, 0,
+        0, 0,
+    };
+    float texcoords[8];
+    GLint old_vao;
+    int x_dir, y_dir;
+    int i;
+
+    if (!glamor)
+        return;
+
+    glamor->rotation = rotation;
+    glamor->pixmap_width = pixmap_width;
+    glamor->pixmap_height = pixmap_height;
+    xboat_glamor_reset_damage_history(glamor);
+
+    /* Rotate and reflect by sampling the screen pixmap with transformed
+     * texture coordinates while presenting.
+     */
+    xboat_glamor_rotation_dirs(rotation, &x_dir, &y_dir);
+    for (i = 0; i < 4; i++) {
+        float *u = &texcoords[i * 2], *v = &texcoords[i * 2 + 1];
+
+        xboat_glamor_walk(x_dir, corners[i * 2], u, v);
+        xboat_glamor_walk(y_dir, corners[i * 2 + 1], u, v);
+    }
+
+    eglMakeCurrent(dpy, glamor->egl_surf, glamor->egl_surf, glamor->ctx);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+    glBindVertexArray(glamor->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, glamor->vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof (float) * 8,
+                    sizeof (texcoords), texcoords);
+    glBindVertexArray(old_vao);
 }
 
 static void
@@ -193,11 +411,103 @@ xboat_glamor_set_vertices(struct xboat_glamor *glamor)
     glEnableVertexAttribArray(glamor->texture_shader_texcoord_loc);
 }
 
+/**
+ * Converts the boxes of @region to EGL rectangles (x, y, width, height
+ * with a bottom-left origin), clipped to the window.  Returns the number
+ * of rectangles stored in glamor->rects.
+ */
+static int
+xboat_glamor_region_to_rects(struct xboat_glamor *glamor,
+                             pixman_region16_t *region)
+{
+    pixman_box16_t *box;
+    int nbox, i, n = 0;
+
+    box = pixman_region_rectangles(region, &nbox);
+    if (nbox * 4 > glamor->rects_size) {
+        EGLint *rects = reallocarray(glamor->rects, nbox, 4 * sizeof(EGLint));
+
+        if (!rects)
+            return -1;
+        glamor->rects = rects;
+        glamor->rects_size = nbox * 4;
+    }
+
+    for (i = 0; i < nbox; i++) {
+        int x1 = max(box[i].x1, 0);
+        int y1 = max(box[i].y1, 0);
+        int x2 = min(box[i].x2, (int) glamor->width);
+        int y2 = min(box[i].y2, (int) glamor->height);
+
+        if (x1 >= x2 || y1 >= y2)
+            continue;
+
+        glamor->rects[n * 4 + 0] = x1;
+        glamor->rects[n * 4 + 1] = glamor->height - y2;
+        glamor->rects[n * 4 + 2] = x2 - x1;
+        glamor->rects[n * 4 + 3] = y2 - y1;
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * Computes the part of the back buffer that has to be repainted: the
+ * new damage, plus whatever changed since the back buffer was last
+ * presented.  Returns FALSE if the whole window needs repainting.
+ */
+static Bool
+xboat_glamor_repaint_region(struct xboat_glamor *glamor,
+                            pixman_region16_t *damage,
+                            pixman_region16_t *repaint)
+{
+    EGLint age = 0;
+    int i;
+
+    if (!glamor->has_buffer_age && !glamor->has_partial_update)
+        return FALSE;
+
+    if (!eglQuerySurface(dpy, glamor->egl_surf, EGL_BUFFER_AGE_EXT, &age))
+        return FALSE;
+
+    /* age 0 means the buffer content is undefined, and a buffer older
+     * than our history is missing damage we no longer know about.
+     */
+    if (age <= 0 || age > glamor->damage_frames + 1)
+        return FALSE;
+
+    pixman_region_copy(repaint, damage);
+    for (i = 1; i < age; i++) {
+        int index = (glamor->damage_index - i + 1 +
+                     XBOAT_GLAMOR_DAMAGE_HISTORY) % XBOAT_GLAMOR_DAMAGE_HISTORY;
+
+        pixman_region_union(repaint, repaint, &glamor->damage_history[index]);
+    }
+
+    return TRUE;
+}
+
+static void
+xboat_glamor_push_damage(struct xboat_glamor *glamor,
+                         pixman_region16_t *damage)
+{
+    glamor->damage_index = (glamor->damage_index + 1) %
+        XBOAT_GLAMOR_DAMAGE_HISTORY;
+    pixman_region_copy(&glamor->damage_history[glamor->damage_index], damage);
+    if (glamor->damage_frames < XBOAT_GLAMOR_DAMAGE_HISTORY)
+        glamor->damage_frames++;
+}
+
 void
 xboat_glamor_damage_redisplay(struct xboat_glamor *glamor,
-                              struct pixman_region16 *damage)
+                              struct pixman_region16 *screen_damage)
 {
+    pixman_region16_t repaint, window_damage;
+    pixman_region16_t *damage = &window_damage;
+    Bool partial;
     GLint old_vao;
+    int nrects, i;
 
     /* Skip presenting the output in this mode.  Presentation is
      * expensive, and if we're just running the X Test suite headless,
@@ -208,6 +518,20 @@ xboat_glamor_damage_redisplay(struct xboat_glamor *glamor,
 
     eglMakeCurrent(dpy, glamor->egl_surf, glamor->egl_surf, glamor->ctx);
 
+    pixman_region_init(&window_damage);
+    xboat_glamor_window_damage(glamor, screen_damage, &window_damage);
+
+    pixman_region_init(&repaint);
+    partial = xboat_glamor_repaint_region(glamor, damage, &repaint);
+    if (partial) {
+        nrects = xboat_glamor_region_to_rects(glamor, &repaint);
+        if (nrects < 0)
+            partial = FALSE;
+        else if (glamor->has_partial_update)
+            eglSetDamageRegionKHR(dpy, glamor->egl_surf,
+                                  glamor->rects, nrects);
+    }
+
     glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
     glBindVertexArray(glamor->vao);
 
@@ -219,11 +543,40 @@ xboat_glamor_damage_redisplay(struct xboat_glamor *glamor,
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, glamor->tex);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    if (partial) {
+        /* Only touch the pixels that are out of date in this buffer. */
+        glEnable(GL_SCISSOR_TEST);
+        for (i = 0; i < nrects; i++) {
+            glScissor(glamor->rects[i * 4 + 0], glamor->rects[i * 4 + 1],
+                      glamor->rects[i * 4 + 2], glamor->rects[i * 4 + 3]);
+            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        }
+        glDisable(GL_SCISSOR_TEST);
+    } else {
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    }
 
     glBindVertexArray(old_vao);
 
-    eglSwapBuffers(dpy, glamor->egl_surf);
+    xboat_glamor_push_damage(glamor, damage);
+    pixman_region_fini(&repaint);
+
+    /* The compositor only needs to know about this frame's damage,
+     * whatever we had to repaint for the buffer age.
+     */
+    nrects = -1;
+    if (glamor->has_swap_with_damage_khr || glamor->has_swap_with_damage_ext)
+        nrects = xboat_glamor_region_to_rects(glamor, damage);
+    pixman_region_fini(&window_damage);
+
+    if (nrects >= 0 && glamor->has_swap_with_damage_khr)
+        eglSwapBuffersWithDamageKHR(dpy, glamor->egl_surf,
+                                    glamor->rects, nrects);
+    else if (nrects >= 0)
+        eglSwapBuffersWithDamageEXT(dpy, glamor->egl_surf,
+                                    glamor->rects, nrects);
+    else
+        eglSwapBuffers(dpy, glamor->egl_surf);
 }
 
 struct xboat_glamor *
@@ -244,6 +597,7 @@ xboat_glamor_egl_screen_init(ANativeWindow* win)
     EGLContext ctx;
     struct xboat_glamor *glamor;
     EGLSurface egl_surf;
+    int i;
 
     glamor = calloc(1, sizeof(struct xboat_glamor));
     if (!glamor) {
@@ -288,9 +642,22 @@ xboat_glamor_egl_screen_init(ANativeWindow* win)
 
     glamor->ctx = ctx;
     glamor->win = win;
+    glamor->rotation = RR_Rotate_0;
     glamor->egl_surf = egl_surf;
     xboat_glamor_setup_texturing_shader(glamor);
 
+    glamor->has_buffer_age =
+        epoxy_has_egl_extension(dpy, "EGL_EXT_buffer_age");
+    glamor->has_partial_update =
+        epoxy_has_egl_extension(dpy, "EGL_KHR_partial_update");
+    glamor->has_swap_with_damage_khr =
+        epoxy_has_egl_extension(dpy, "EGL_KHR_swap_buffers_with_damage");
+    glamor->has_swap_with_damage_ext =
+        epoxy_has_egl_extension(dpy, "EGL_EXT_swap_buffers_with_damage");
+    for (i = 0; i < XBOAT_GLAMOR_DAMAGE_HISTORY; i++)
+        pixman_region_init(&glamor->damage_history[i]);
+    xboat_glamor_reset_damage_history(glamor);
+
     glGenVertexArrays(1, &glamor->vao);
     glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
     glBindVertexArray(glamor->vao);
@@ -309,10 +676,15 @@ xboat_glamor_egl_screen_init(ANativeWindow* win)
 void
 xboat_glamor_egl_screen_fini(struct xboat_glamor *glamor)
 {
+    int i;
+
     eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglDestroyContext(dpy, glamor->ctx);
     eglDestroySurface(dpy, glamor->egl_surf);
 
+    for (i = 0; i < XBOAT_GLAMOR_DAMAGE_HISTORY; i++)
+        pixman_region_fini(&glamor->damage_history[i]);
+    free(glamor->rects);
     free(glamor);
 }
 
@@ -347,4 +719,5 @@ xboat_glamor_set_window_size(struct xboat_glamor *glamor,
 
     glamor->width = width;
     glamor->height = height;
+    xboat_glamor_reset_damage_history(glamor);
 }
@@ -54,6 +54,10 @@ void
 xboat_glamor_set_window_size(struct xboat_glamor *glamor,
                              unsigned width, unsigned height);
 
+void
+xboat_glamor_set_rotation(struct xboat_glamor *glamor, unsigned rotation,
+                          unsigned pixmap_width, unsigned pixmap_height);
+
 void
 xboat_glamor_damage_redisplay(struct xboat_glamor *glamor,
                               struct pixman_region16 *damage);
@@ -66,6 +70,12 @@ xboat_glamor_set_window_size(struct xboat_glamor *glamor,
 {
 }
 
+static inline void
+xboat_glamor_set_rotation(struct xboat_glamor *glamor, unsigned rotation,
+                          unsigned pixmap_width, unsigned pixmap_height)
+{
+}
+
 static inline void
 xboat_glamor_damage_redisplay(struct xboat_glamor *glamor,
                               struct pixman_region16 *damage)
@@ -0,0 +1,397 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file xboat_present.c
+ *
+ * Present extension backend for Xboat.
+ *
+ * Vblanks are the host frames of the paced host window updates (see
+ * xboatSchedulePresent()), so clients get UST/MSC values matching what
+ * is actually shown.  With glamor, fullscreen windows are flipped by
+ * texturing the window pixmap straight into the host window.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include "xboat.h"
+#include "xboatlog.h"
+#include "list.h"
+#include "present.h"
+
+#ifdef GLAMOR
+#include "glamor.h"
+#endif
+#include "xboat_glamor_egl.h"
+
+extern Bool xboat_glamor;
+
+#if 0
+#define DebugPresent(x) ErrorF x
+#else
+#define DebugPresent(x)
+#endif
+
+struct xboat_present_vblank {
+    struct xorg_list list;
+    uint64_t event_id;
+    uint64_t msc;
+};
+
+/**
+ * Per-screen state for the Xboat Present backend.
+ */
+struct xboat_present {
+    ScreenPtr screen;
+    present_screen_info_rec info;
+
+    /* The RandR 1.0 CRTC, once it has been created */
+    RRCrtcPtr crtc;
+
+    /* Pending vblank events, in no particular order */
+    struct xorg_list vblank_queue;
+    OsTimerPtr vblank_timer;
+
+    /* Flip or unflip waiting for the next host window update */
+    Bool flip_pending;
+    uint64_t flip_event_id;
+};
+
+static struct xboat_present *
+xboat_present_priv(ScreenPtr screen)
+{
+    KdScreenPriv(screen);
+    XboatScrPriv *scrpriv = pScreenPriv->screen->driver;
+
+    return scrpriv->present;
+}
+
+static RRCrtcPtr
+xboat_present_get_crtc(WindowPtr window)
+{
+    ScreenPtr screen = window->drawable.pScreen;
+    struct xboat_present *present = xboat_present_priv(screen);
+    rrScrPrivPtr pScrPriv = rrGetScrPriv(screen);
+
+    if (present->crtc)
+        return present->crtc;
+
+    /* Xboat uses the RandR 1.0 interface, whose CRTC only gets created
+     * once the configuration has been queried.  It stays for the life
+     * of the screen after that.
+     */
+    if (pScrPriv && !pScrPriv->numCrtcs && !RRGetInfo(screen, FALSE))
+        return NULL;
+
+    present->crtc = RRFirstEnabledCrtc(screen);
+    return present->crtc;
+}
+
+static int
+xboat_present_get_ust_msc(RRCrtcPtr crtc, uint64_t *ust, uint64_t *msc)
+{
+    xboatGetUstMsc(ust, msc);
+    return Success;
+}
+
+/*
+ * Returns the delay in milliseconds until the earliest queued vblank is
+ * due, at least 1 so that the timer fires, or 0 if none is queued.
+ */
+static CARD32
+xboat_present_next_delay(struct xboat_present *present)
+{
+    struct xboat_present_vblank *vblank;
+    uint64_t next_msc = 0;
+    int64_t delay;
+
+    xorg_list_for_each_entry(vblank, &present->vblank_queue, list) {
+        if (!next_msc || vblank->msc < next_msc)
+            next_msc = vblank->msc;
+    }
+
+    if (!next_msc)
+        return 0;
+
+    delay = ((int64_t) (next_msc * xboatFrameInterval() -
+                        GetTimeInMicros()) + 999) / 1000;
+    return delay > 0 ? delay : 1;
+}
+
+/*
+ * Notifies the extension of every queued vblank whose MSC has passed.
+ * The walk starts over after each notification, as the extension may
+ * queue or abort vblanks from it.
+ */
+static CARD32
+xboat_present_vblank_timer(OsTimerPtr timer, CARD32 time, void *arg)
+{
+    struct xboat_present *present = arg;
+    struct xboat_present_vblank *vblank;
+    uint64_t ust, msc;
+
+    xboatGetUstMsc(&ust, &msc);
+
+again:
+    xorg_list_for_each_entry(vblank, &present->vblank_queue, list) {
+        if (vblank->msc <= msc) {
+            DebugPresent(("\t\txv %lld msc %llu\n",
+                          (long long) vblank->event_id, (long long) msc));
+            xorg_list_del(&vblank->list);
+            present_event_notify(vblank->event_id, ust, msc);
+            free(vblank);
+            goto again;
+        }
+    }
+
+    return xboat_present_next_delay(present);
+}
+
+/*
+ * Queue an event to report back to the Present extension when the specified
+ * MSC has passed.  The event is always delivered from the timer, never
+ * before this returns.
+ */
+static int
+xboat_present_queue_vblank(RRCrtcPtr crtc, uint64_t event_id, uint64_t msc)
+{
+    struct xboat_present *present = xboat_present_priv(crtc->pScreen);
+    struct xboat_present_vblank *vblank;
+
+    vblank = calloc(1, sizeof(struct xboat_present_vblank));
+    if (!vblank)
+        return BadAlloc;
+
+    vblank->event_id = event_id;
+    vblank->msc = msc;
+    xorg_list_add(&vblank->list, &present->vblank_queue);
+
+    DebugPresent(("\t\txq %lld msc %llu\n",
+                  (long long) event_id, (long long) msc));
+
+    present->vblank_timer = TimerSet(present->vblank_timer, 0,
+                                     xboat_present_next_delay(present),
+                                     xboat_present_vblank_timer, present);
+    if (!present->vblank_timer) {
+        xorg_list_del(&vblank->list);
+        free(vblank);
+        return BadAlloc;
+    }
+
+    return Success;
+}
+
+static void
+xboat_present_abort_vblank(RRCrtcPtr crtc, uint64_t event_id, uint64_t msc)
+{
+    struct xboat_present *present = xboat_present_priv(crtc->pScreen);
+    struct xboat_present_vblank *vblank, *tmp;
+
+    xorg_list_for_each_entry_safe(vblank, tmp, &present->vblank_queue, list) {
+        if (vblank->event_id == event_id) {
+            xorg_list_del(&vblank->list);
+            free(vblank);
+            break;
+        }
+    }
+}
+
+static void
+xboat_present_flush(WindowPtr window)
+{
+#ifdef GLAMOR
+    if (xboat_glamor)
+        glamor_block_handler(window->drawable.pScreen);
+#endif
+}
+
+#ifdef GLAMOR
+/*
+ * Redisplays the whole screen on the next host frame, completing the
+ * flip or unflip to 'event_id' then.
+ */
+static void
+xboat_present_queue_flip(ScreenPtr screen, uint64_t event_id, Bool sync_flip)
+{
+    KdScreenPriv(screen);
+    XboatScrPriv *scrpriv = pScreenPriv->screen->driver;
+    struct xboat_present *present = scrpriv->present;
+    BoxRec box;
+    RegionRec region;
+
+    present->flip_pending = TRUE;
+    present->flip_event_id = event_id;
+
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = screen->width;
+    box.y2 = screen->height;
+    RegionInit(&region, &box, 1);
+    DamageReportDamage(scrpriv->pDamage, &region);
+    RegionUninit(&region);
+
+    if (!sync_flip) {
+        input_lock();
+        scrpriv->present_urgent = TRUE;
+        input_unlock();
+    }
+}
+
+static Bool
+xboat_present_check_flip(RRCrtcPtr crtc, WindowPtr window,
+                         PixmapPtr pixmap, Bool sync_flip)
+{
+    ScreenPtr screen = window->drawable.pScreen;
+    KdScreenPriv(screen);
+    XboatScrPriv *scrpriv = pScreenPriv->screen->driver;
+
+    if (!xboat_glamor || scrpriv->shadow || !scrpriv->pDamage)
+        return FALSE;
+
+    if (pixmap->drawable.depth != screen->rootDepth ||
+        pixmap->drawable.width != screen->width ||
+        pixmap->drawable.height != screen->height)
+        return FALSE;
+
+    /* The pixmap has to be a single texture we can present from */
+    return glamor_get_pixmap_texture(pixmap) != 0;
+}
+
+static Bool
+xboat_present_flip(RRCrtcPtr crtc, uint64_t event_id, uint64_t target_msc,
+                   PixmapPtr pixmap, Bool sync_flip)
+{
+    ScreenPtr screen = crtc->pScreen;
+    KdScreenPriv(screen);
+    XboatScrPriv *scrpriv = pScreenPriv->screen->driver;
+
+    if (!xboat_present_check_flip(crtc, screen->root, pixmap, sync_flip))
+        return FALSE;
+
+    DebugPresent(("\t\txf %lld msc %llu\n",
+                  (long long) event_id, (long long) target_msc));
+
+    glamor_block_handler(screen);
+    xboat_glamor_set_texture(scrpriv->glamor,
+                             glamor_get_pixmap_texture(pixmap));
+    xboat_present_queue_flip(screen, event_id, sync_flip);
+
+    return TRUE;
+}
+
+static void
+xboat_present_unflip(ScreenPtr screen, uint64_t event_id)
+{
+    KdScreenPriv(screen);
+    XboatScrPriv *scrpriv = pScreenPriv->screen->driver;
+    PixmapPtr pixmap = screen->GetScreenPixmap(screen);
+
+    DebugPresent(("\t\txu %lld\n", (long long) event_id));
+
+    xboat_glamor_set_texture(scrpriv->glamor,
+                             glamor_get_pixmap_texture(pixmap));
+    if (scrpriv->pDamage) {
+        xboat_present_queue_flip(screen, event_id, FALSE);
+        return;
+    }
+
+    present_event_notify(event_id, 0, 0);
+}
+#endif /* GLAMOR */
+
+/**
+ * Called after the host window has been updated for host frame 'msc',
+ * completes a pending flip.
+ */
+void
+xboatPresentFrameDone(ScreenPtr pScreen, uint64_t ust, uint64_t msc)
+{
+    struct xboat_present *present = xboat_present_priv(pScreen);
+
+    if (!present || !present->flip_pending)
+        return;
+
+    present->flip_pending = FALSE;
+    present_event_notify(present->flip_event_id, ust, msc);
+}
+
+static const present_screen_info_rec xboat_present_screen_info = {
+    .version = PRESENT_SCREEN_INFO_VERSION,
+
+    .get_crtc = xboat_present_get_crtc,
+    .get_ust_msc = xboat_present_get_ust_msc,
+    .queue_vblank = xboat_present_queue_vblank,
+    .abort_vblank = xboat_present_abort_vblank,
+    .flush = xboat_present_flush,
+
+    .capabilities = PresentCapabilityNone,
+#ifdef GLAMOR
+    .check_flip = xboat_present_check_flip,
+    .flip = xboat_present_flip,
+    .unflip = xboat_present_unflip,
+#endif
+};
+
+Bool
+xboatPresentInit(ScreenPtr pScreen)
+{
+    KdScreenPriv(pScreen);
+    XboatScrPriv *scrpriv = pScreenPriv->screen->driver;
+    struct xboat_present *present;
+
+    present = calloc(1, sizeof(struct xboat_present));
+    if (!present)
+        return FALSE;
+
+    present->screen = pScreen;
+    present->info = xboat_present_screen_info;
+    xorg_list_init(&present->vblank_queue);
+    scrpriv->present = present;
+
+#ifdef GLAMOR
+    if (xboat_glamor)
+        present->info.capabilities |= PresentCapabilityAsync;
+#endif
+
+    return present_screen_init(pScreen, &present->info);
+}
+
+void
+xboatPresentFini(ScreenPtr pScreen)
+{
+    KdScreenPriv(pScreen);
+    XboatScrPriv *scrpriv = pScreenPriv->screen->driver;
+    struct xboat_present *present = scrpriv->present;
+    struct xboat_present_vblank *vblank, *tmp;
+
+    if (!present)
+        return;
+
+    TimerFree(present->vblank_timer);
+    xorg_list_for_each_entry_safe(vblank, tmp, &present->vblank_queue, list) {
+        xorg_list_del(&vblank->list);
+        free(vblank);
+    }
+
+    free(present);
+    scrpriv->present = NULL;
+}
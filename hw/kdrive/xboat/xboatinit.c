@@ -120,8 +120,12 @@ ddxUseMsg(void)
     ErrorF("\nXboat Option Usage:\n");
     ErrorF("-sw-cursor           Render cursors in software in Xboat\n");
     ErrorF("-fullscreen          Attempt to run Xboat fullscreen\n");
+    ErrorF("-shared-fb           Share the framebuffer with the host compositor\n");
+    ErrorF("                     instead of copying updates (Android 10 and later)\n");
     ErrorF("-grayscale           Simulate 8bit grayscale\n");
     ErrorF("-resizeable          Make Xboat windows resizeable\n");
+    ErrorF("-present-rate <hz>   Update the host window at most <hz> times per second\n");
+    ErrorF("                     (default: host refresh rate, 0: no limit)\n");
 #ifdef GLAMOR
     ErrorF("-glamor              Enable 2D acceleration using glamor\n");
     ErrorF("-glamor_gles2        Enable 2D acceleration using glamor (with GLES2 only)\n");
@@ -182,6 +186,10 @@ ddxProcessArgument(int argc, char **argv, int i)
         hostboat_use_fullscreen();
         return 1;
     }
+    else if (!strcmp(argv[i], "-shared-fb")) {
+        hostboat_use_shared_fb();
+        return 1;
+    }
     else if (!strcmp(argv[i], "-grayscale")) {
         XboatWantGrayScale = 1;
         return 1;
@@ -190,6 +198,16 @@ ddxProcessArgument(int argc, char **argv, int i)
         XboatWantResize = 1;
         return 1;
     }
+    else if (!strcmp(argv[i], "-present-rate")) {
+        if (i + 1 < argc && argv[i + 1][0] != '-') {
+            xboatSetPresentRate(atoi(argv[i + 1]));
+            return 2;
+        }
+        else {
+            UseMsg();
+            exit(1);
+        }
+    }
 #ifdef GLAMOR
     else if (!strcmp (argv[i], "-glamor")) {
         xboat_glamor = TRUE;
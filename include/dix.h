@@ -275,6 +275,16 @@ extern _X_EXPORT void ClientWakeup(ClientPtr /*client */ );
 
 extern _X_EXPORT Bool ClientIsAsleep(ClientPtr /*client */ );
 
+extern _X_EXPORT Bool DoStartGetImage(ClientPtr /*client */ ,
+                                      DrawablePtr /*pDraw */ ,
+                                      int /*x */ ,
+                                      int /*y */ ,
+                                      int /*width */ ,
+                                      int /*height */ ,
+                                      unsigned int /*format */ ,
+                                      unsigned long /*planemask */ ,
+                                      RegionPtr * /*ppVisibleRegion */ );
+
 extern _X_EXPORT void SendGraphicsExpose(ClientPtr /*client */ ,
                                          RegionPtr /*pRgn */ ,
                                          XID /*drawable */ ,
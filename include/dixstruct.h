@@ -107,10 +107,13 @@ typedef struct _Client {
 
     int smart_start_tick;
     int smart_stop_tick;
+    int smart_input_tick;       /* when input events were last sent */
+    int smart_ready_tick;       /* when it last started waiting to run */
 
     DeviceIntPtr clientPtr;
     ClientIdPtr clientIds;
     int req_fds;
+    struct _GetImageClip *getImageClip; /* see DoStartGetImage() */
 } ClientRec;
 
 static inline void
@@ -127,6 +130,7 @@ extern long SmartScheduleTime;
 extern long SmartScheduleInterval;
 extern long SmartScheduleSlice;
 extern long SmartScheduleMaxSlice;
+extern long SmartScheduleBoost;
 #ifdef HAVE_SETITIMER
 extern Bool SmartScheduleSignalEnable;
 #else
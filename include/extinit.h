@@ -76,6 +76,9 @@ extern void DPMSExtensionInit(void);
 extern Bool noGEExtension;
 extern void GEExtensionInit(void);
 
+extern _X_EXPORT Bool noReqStatsExtension;
+extern void ReqStatsExtensionInit(void);
+
 #ifdef GLXEXT
 extern _X_EXPORT Bool noGlxExtension;
 extern void GlxExtensionInit(void);
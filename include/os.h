@@ -106,6 +106,8 @@ extern _X_EXPORT Bool WaitForSomething(Bool clients_are_ready);
 
 extern _X_EXPORT int ReadRequestFromClient(ClientPtr /*client */ );
 
+extern _X_EXPORT int ReadBufferedRequestFromClient(ClientPtr /*client */ );
+
 extern _X_EXPORT int ReadFdFromClient(ClientPtr client);
 
 extern _X_EXPORT int WriteFdToClient(ClientPtr client, int fd, Bool do_close);
@@ -125,6 +127,11 @@ extern _X_EXPORT void SetCriticalOutputPending(void);
 extern _X_EXPORT int WriteToClient(ClientPtr /*who */ , int /*count */ ,
                                    const void * /*buf */ );
 
+extern _X_EXPORT int WriteBufferToClient(ClientPtr /*who */ , int /*count */ ,
+                                         const void * /*buf */ ,
+                                         void (* /*release */ ) (void *),
+                                         void * /*closure */ );
+
 extern _X_EXPORT void ResetOsBuffers(void);
 
 extern _X_EXPORT void InitConnectionLimits(void);
@@ -0,0 +1,107 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef REQSTATS_H
+#define REQSTATS_H
+
+#include "misc.h"
+#include "dixstruct.h"
+
+/*
+ * Request statistics, collected by Dispatch for every request.
+ *
+ * Service times are in microseconds and also recorded in a histogram
+ * of power of two buckets: bucket 0 counts requests that took less than
+ * a microsecond, bucket n those that took [2^(n-1), 2^n) microseconds.
+ */
+#define REQSTATS_BUCKETS	32
+
+typedef struct _ReqStats {
+    CARD64 count;
+    CARD64 time;
+    CARD64 bytesIn;
+    CARD64 bytesOut;
+    CARD32 histogram[REQSTATS_BUCKETS];
+} ReqStatsRec, *ReqStatsPtr;
+
+/*
+ * The requests read from clients, and the system calls it took to read
+ * them and to write replies and events.
+ */
+typedef struct _IOStats {
+    CARD64 requests;
+    CARD64 reads;
+    CARD64 writes;
+} IOStatsRec;
+
+extern IOStatsRec ioStats;
+
+/*
+ * How often the scheduler picked a client, how often it was boosted as
+ * interactive, and how long it waited to run since it became ready, in
+ * microseconds and with the same histogram buckets as service times.
+ * Waits are taken from the scheduler's clock, so they are whole
+ * milliseconds.
+ */
+typedef struct _SchedStats {
+    CARD64 turns;
+    CARD64 boosted;
+    CARD64 wait;
+    CARD64 maxWait;
+    CARD32 histogram[REQSTATS_BUCKETS];
+} SchedStatsRec, *SchedStatsPtr;
+
+/* Extension minor opcodes above this share the last slot */
+#define REQSTATS_MAX_MINOR	255
+
+extern void ReqStatsInit(void);
+
+extern void ReqStatsStart(ClientPtr client);
+
+extern void ReqStatsContinue(ClientPtr client);
+
+extern void ReqStatsDone(ClientPtr client, int bytes);
+
+extern void ReqStatsWrite(ClientPtr client, int bytes);
+
+extern void ReqStatsSchedule(ClientPtr client, Bool boosted);
+
+extern ReqStatsPtr ReqStatsLookup(int major, int minor);
+
+extern ReqStatsPtr ReqStatsClient(ClientPtr client);
+
+extern SchedStatsPtr ReqStatsClientSchedule(ClientPtr client);
+
+extern CARD32 ReqStatsPercentile(ReqStatsPtr stats, int percent);
+
+extern CARD32 ReqStatsHistogramPercentile(const CARD32 *histogram,
+                                          int percent);
+
+extern void ReqStatsReset(void);
+
+extern void ReqStatsDump(void);
+
+extern volatile char reqStatsDumpPending;
+
+/* Called at the end of ReqStatsDump(), to log more statistics */
+extern _X_EXPORT CallbackListPtr ReqStatsDumpCallback;
+
+#endif                          /* REQSTATS_H */
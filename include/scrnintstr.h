@@ -402,6 +402,14 @@ typedef int (*NameWindowPixmapProcPtr)(WindowPtr, PixmapPtr, CARD32);
 
 typedef void (*DPMSProcPtr)(ScreenPtr pScreen, int level);
 
+/* Starts reading back an image that @client is about to get.  Returns TRUE
+ * when the client has been put to sleep until the data is ready, in which
+ * case the request is executed again once the client is woken up. */
+typedef Bool (*StartGetImageProcPtr)(DrawablePtr pDrawable, int sx, int sy,
+                                     int w, int h, unsigned int format,
+                                     unsigned long planeMask,
+                                     ClientPtr client);
+
 /* Wrapping Screen procedures
 
    There are a few modules in the X server which dynamically add and
@@ -660,6 +668,7 @@ typedef struct _Screen {
     ReplaceScanoutPixmapProcPtr ReplaceScanoutPixmap;
     XYToWindowProcPtr XYToWindow;
     DPMSProcPtr DPMS;
+    StartGetImageProcPtr StartGetImage;
 } ScreenRec;
 
 static inline RegionPtr
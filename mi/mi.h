@@ -484,6 +484,10 @@ extern _X_EXPORT void miMarkUnrealizedWindow(WindowPtr /*pChild */ ,
 
 extern _X_EXPORT WindowPtr miSpriteTrace(SpritePtr pSprite, int x, int y);
 
+extern _X_EXPORT Bool miSpriteIndexInit(ScreenPtr pScreen);
+
+extern _X_EXPORT void miSpriteIndexInvalidate(WindowPtr pParent);
+
 extern _X_EXPORT WindowPtr miXYToWindow(ScreenPtr pScreen, SpritePtr pSprite, int x, int y);
 
 /* mizerarc.c */
@@ -728,6 +728,8 @@ miOverlayValidateTree(WindowPtr pParent, WindowPtr pChild,      /* first child e
     Bool overlap;
     WindowPtr newParent;
 
+    miSpriteIndexInvalidate(pParent);
+
     if (!pPriv->underlayMarked)
         goto SKIP_UNDERLAY;
 
@@ -282,6 +282,9 @@ miScreenInit(ScreenPtr pScreen, void *pbits,  /* pointer to screen bits */
 
     miSetZeroLineBias(pScreen, DEFAULTZEROLINEBIAS);
 
+    if (!miSpriteIndexInit(pScreen))
+        return FALSE;
+
     return miScreenDevPrivateInit(pScreen, width, pbits);
 }
 
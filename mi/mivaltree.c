@@ -571,6 +571,8 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
     if (pChild == NullWindow)
         pChild = pParent->firstChild;
 
+    miSpriteIndexInvalidate(pParent);
+
     RegionNull(&childClip);
     RegionNull(&exposed);
 
@@ -745,42 +745,270 @@ miMarkUnrealizedWindow(WindowPtr pChild, WindowPtr pWin, Bool fromConfigure)
     }
 }
 
+/*
+ * Hit testing walks the children of each window the sprite is in, in
+ * stacking order.  The root window of a desktop can have hundreds of
+ * children, so screens keep a grid over the root window that lists, for
+ * each cell, the mapped children whose border overlaps it, topmost
+ * first.  Only those need to be tested; the result is the same.
+ *
+ * The grid is thrown away whenever the children of the root window are
+ * validated, which every map, unmap, configure and restack of a top
+ * level window does.  It is rebuilt once the sprite has been traced
+ * some times without changes, so that dragging a window around does not
+ * rebuild it on every motion.
+ */
+#define SPRITE_INDEX_GRID	16
+#define SPRITE_INDEX_MIN_WINDOWS	32
+#define SPRITE_INDEX_REBUILD	8
+
+typedef struct _miSpriteIndex {
+    CloseScreenProcPtr CloseScreen;
+    WindowPtr root;
+    Bool valid;
+    int traces;
+    int cellWidth;
+    int cellHeight;
+    int start[SPRITE_INDEX_GRID * SPRITE_INDEX_GRID + 1];
+    WindowPtr *windows;
+    int size;
+} miSpriteIndexRec, *miSpriteIndexPtr;
+
+static DevPrivateKeyRec miSpriteIndexKeyRec;
+
+#define miSpriteIndexKey (&miSpriteIndexKeyRec)
+#define GetSpriteIndex(s) \
+    ((miSpriteIndexPtr) dixLookupPrivate(&(s)->devPrivates, miSpriteIndexKey))
+
+static Bool
+miSpriteIndexCloseScreen(ScreenPtr pScreen)
+{
+    miSpriteIndexPtr pIndex = GetSpriteIndex(pScreen);
+
+    pScreen->CloseScreen = pIndex->CloseScreen;
+    free(pIndex->windows);
+    free(pIndex);
+    if (pScreen->CloseScreen)
+        return (*pScreen->CloseScreen) (pScreen);
+    return TRUE;
+}
+
+Bool
+miSpriteIndexInit(ScreenPtr pScreen)
+{
+    miSpriteIndexPtr pIndex;
+
+    if (!dixRegisterPrivateKey(miSpriteIndexKey, PRIVATE_SCREEN, 0))
+        return FALSE;
+
+    pIndex = calloc(1, sizeof(miSpriteIndexRec));
+    if (!pIndex)
+        return FALSE;
+    pIndex->CloseScreen = pScreen->CloseScreen;
+    pScreen->CloseScreen = miSpriteIndexCloseScreen;
+    dixSetPrivate(&pScreen->devPrivates, miSpriteIndexKey, pIndex);
+    return TRUE;
+}
+
+/**
+ * Called when the children of @pParent are validated, which is before
+ * they can be traced again after a change.
+ */
+void
+miSpriteIndexInvalidate(WindowPtr pParent)
+{
+    miSpriteIndexPtr pIndex;
+
+    if (pParent->parent || !dixPrivateKeyRegistered(miSpriteIndexKey))
+        return;
+
+    pIndex = GetSpriteIndex(pParent->drawable.pScreen);
+    if (pIndex) {
+        pIndex->valid = FALSE;
+        pIndex->traces = 0;
+    }
+}
+
+/* Whether the sprite at x/y is in pWin, see miSpriteTrace() */
+static Bool
+miSpriteHit(WindowPtr pWin, int x, int y)
+{
+    BoxRec box;
+
+    return (pWin->mapped) &&
+        (x >= pWin->drawable.x - wBorderWidth(pWin)) &&
+        (x < pWin->drawable.x + (int) pWin->drawable.width +
+         wBorderWidth(pWin)) &&
+        (y >= pWin->drawable.y - wBorderWidth(pWin)) &&
+        (y < pWin->drawable.y + (int) pWin->drawable.height +
+         wBorderWidth(pWin))
+        /* When a window is shaped, a further check
+         * is made to see if the point is inside
+         * borderSize
+         */
+        && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
+        && (!wInputShape(pWin) ||
+            RegionContainsPoint(wInputShape(pWin),
+                                x - pWin->drawable.x,
+                                y - pWin->drawable.y, &box))
+        /* In rootless mode windows may be offscreen, even when
+         * they're in X's stack. (E.g. if the native window system
+         * implements some form of virtual desktop system).
+         */
+        && !pWin->unhittable;
+}
+
+/*
+ * Computes the cells the border of pWin overlaps, returning FALSE if
+ * there are none.
+ */
+static Bool
+miSpriteIndexCells(miSpriteIndexPtr pIndex, WindowPtr pWin, BoxPtr cells)
+{
+    WindowPtr pRoot = pIndex->root;
+    int bw = wBorderWidth(pWin);
+    int x1 = pWin->drawable.x - bw - pRoot->drawable.x;
+    int y1 = pWin->drawable.y - bw - pRoot->drawable.y;
+    int x2 = x1 + (int) pWin->drawable.width + 2 * bw;
+    int y2 = y1 + (int) pWin->drawable.height + 2 * bw;
+
+    if (!pWin->mapped || x2 <= 0 || y2 <= 0 ||
+        x1 >= pRoot->drawable.width || y1 >= pRoot->drawable.height)
+        return FALSE;
+
+    cells->x1 = max(x1, 0) / pIndex->cellWidth;
+    cells->y1 = max(y1, 0) / pIndex->cellHeight;
+    cells->x2 = (min(x2, pRoot->drawable.width) - 1) / pIndex->cellWidth;
+    cells->y2 = (min(y2, pRoot->drawable.height) - 1) / pIndex->cellHeight;
+    return TRUE;
+}
+
+static Bool
+miSpriteIndexBuild(miSpriteIndexPtr pIndex, WindowPtr pRoot)
+{
+    int count[SPRITE_INDEX_GRID * SPRITE_INDEX_GRID] = { 0 };
+    int cell, total = 0, children = 0, x, y;
+    WindowPtr pWin;
+    BoxRec cells;
+
+    pIndex->root = pRoot;
+    pIndex->cellWidth = max(1, (pRoot->drawable.width + SPRITE_INDEX_GRID - 1)
+                            / SPRITE_INDEX_GRID);
+    pIndex->cellHeight = max(1, (pRoot->drawable.height + SPRITE_INDEX_GRID - 1)
+                             / SPRITE_INDEX_GRID);
+
+    for (pWin = pRoot->firstChild; pWin; pWin = pWin->nextSib) {
+        children++;
+        if (!miSpriteIndexCells(pIndex, pWin, &cells))
+            continue;
+        for (y = cells.y1; y <= cells.y2; y++)
+            for (x = cells.x1; x <= cells.x2; x++)
+                count[y * SPRITE_INDEX_GRID + x]++;
+    }
+    if (children < SPRITE_INDEX_MIN_WINDOWS)
+        return FALSE;
+
+    for (cell = 0; cell < SPRITE_INDEX_GRID * SPRITE_INDEX_GRID; cell++) {
+        pIndex->start[cell] = total;
+        total += count[cell];
+        count[cell] = pIndex->start[cell];
+    }
+    pIndex->start[cell] = total;
+
+    if (total > pIndex->size) {
+        WindowPtr *windows = reallocarray(pIndex->windows, total,
+                                          sizeof(WindowPtr));
+
+        if (!windows)
+            return FALSE;
+        pIndex->windows = windows;
+        pIndex->size = total;
+    }
+
+    /* Children are visited topmost first, so each cell stays in order */
+    for (pWin = pRoot->firstChild; pWin; pWin = pWin->nextSib) {
+        if (!miSpriteIndexCells(pIndex, pWin, &cells))
+            continue;
+        for (y = cells.y1; y <= cells.y2; y++)
+            for (x = cells.x1; x <= cells.x2; x++)
+                pIndex->windows[count[y * SPRITE_INDEX_GRID + x]++] = pWin;
+    }
+    return TRUE;
+}
+
+/*
+ * Finds the child of the root window pRoot the sprite at x/y is in, if
+ * any, through the index.  Returns FALSE if the children have to be
+ * walked instead.
+ */
+static Bool
+miSpriteIndexLookup(WindowPtr pRoot, int x, int y, WindowPtr *ppWin)
+{
+    miSpriteIndexPtr pIndex;
+    int dx, dy, cell, i;
+
+    if (!dixPrivateKeyRegistered(miSpriteIndexKey))
+        return FALSE;
+    pIndex = GetSpriteIndex(pRoot->drawable.pScreen);
+    if (!pIndex || !pRoot->realized)
+        return FALSE;
+
+    if (!pIndex->valid || pIndex->root != pRoot) {
+        if (pIndex->root == pRoot && ++pIndex->traces < SPRITE_INDEX_REBUILD)
+            return FALSE;
+        pIndex->traces = 0;
+        pIndex->valid = miSpriteIndexBuild(pIndex, pRoot);
+        if (!pIndex->valid)
+            return FALSE;
+    }
+
+    dx = x - pRoot->drawable.x;
+    dy = y - pRoot->drawable.y;
+    if (dx < 0 || dy < 0 ||
+        dx >= pRoot->drawable.width || dy >= pRoot->drawable.height)
+        return FALSE;
+
+    *ppWin = NULL;
+    cell = (dy / pIndex->cellHeight) * SPRITE_INDEX_GRID +
+        dx / pIndex->cellWidth;
+    for (i = pIndex->start[cell]; i < pIndex->start[cell + 1]; i++) {
+        if (miSpriteHit(pIndex->windows[i], x, y)) {
+            *ppWin = pIndex->windows[i];
+            break;
+        }
+    }
+    return TRUE;
+}
+
+static void
+miSpriteTracePush(SpritePtr pSprite, WindowPtr pWin)
+{
+    if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize) {
+        pSprite->spriteTraceSize += 10;
+        pSprite->spriteTrace = reallocarray(pSprite->spriteTrace,
+                                            pSprite->spriteTraceSize,
+                                            sizeof(WindowPtr));
+    }
+    pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
+}
+
 WindowPtr
 miSpriteTrace(SpritePtr pSprite, int x, int y)
 {
-    WindowPtr pWin;
-    BoxRec box;
+    WindowPtr pWin, pTop;
+
+    pWin = DeepestSpriteWin(pSprite);
+    if (!pWin->parent && miSpriteIndexLookup(pWin, x, y, &pTop)) {
+        if (!pTop)
+            return pWin;
+        miSpriteTracePush(pSprite, pTop);
+        pWin = pTop;
+    }
 
-    pWin = DeepestSpriteWin(pSprite)->firstChild;
+    pWin = pWin->firstChild;
     while (pWin) {
-        if ((pWin->mapped) &&
-            (x >= pWin->drawable.x - wBorderWidth(pWin)) &&
-            (x < pWin->drawable.x + (int) pWin->drawable.width +
-             wBorderWidth(pWin)) &&
-            (y >= pWin->drawable.y - wBorderWidth(pWin)) &&
-            (y < pWin->drawable.y + (int) pWin->drawable.height +
-             wBorderWidth(pWin))
-            /* When a window is shaped, a further check
-             * is made to see if the point is inside
-             * borderSize
-             */
-            && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
-            && (!wInputShape(pWin) ||
-                RegionContainsPoint(wInputShape(pWin),
-                                    x - pWin->drawable.x,
-                                    y - pWin->drawable.y, &box))
-            /* In rootless mode windows may be offscreen, even when
-             * they're in X's stack. (E.g. if the native window system
-             * implements some form of virtual desktop system).
-             */
-            && !pWin->unhittable) {
-            if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize) {
-                pSprite->spriteTraceSize += 10;
-                pSprite->spriteTrace = reallocarray(pSprite->spriteTrace,
-                                                    pSprite->spriteTraceSize,
-                                                    sizeof(WindowPtr));
-            }
-            pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
+        if (miSpriteHit(pWin, x, y)) {
+            miSpriteTracePush(pSprite, pWin);
             pWin = pWin->firstChild;
         }
         else
@@ -77,6 +77,7 @@ SOFTWARE.
 #include "opaque.h"
 #include "dixstruct.h"
 #include "misc.h"
+#include "reqstats.h"
 
 CallbackListPtr ReplyCallback;
 CallbackListPtr FlushCallback;
@@ -91,20 +92,39 @@ typedef struct _connectionInput {
     unsigned int ignoreBytes;   /* bytes to ignore before the next request */
 } ConnectionInput;
 
+/*
+ * Once a buffer handed over by WriteBufferToClient has to wait for the
+ * client, it and everything written after it are queued as segments
+ * behind the output buffer: the rest of that buffer itself, and copies
+ * of what came after.
+ */
+typedef struct _connectionOutputSegment {
+    struct _connectionOutputSegment *next;
+    const char *data;           /* next byte to write */
+    int count;                  /* bytes left to write */
+    int size;                   /* size of buf, 0 if data is not a copy */
+    void (*release) (void *closure);
+    void *closure;
+    char buf[];
+} ConnectionOutputSegment, *ConnectionOutputSegmentPtr;
+
 typedef struct _connectionOutput {
     struct _connectionOutput *next;
     unsigned char *buf;
     int size;
     int count;
+    ConnectionOutputSegmentPtr segments;
+    ConnectionOutputSegmentPtr lastSegment;
 } ConnectionOutput;
 
-static ConnectionInputPtr AllocateInputBuffer(void);
-static ConnectionOutputPtr AllocateOutputBuffer(void);
+static ConnectionInputPtr AllocateInputBuffer(OsCommPtr oc);
+static ConnectionOutputPtr AllocateOutputBuffer(OsCommPtr oc);
+static int FlushOutput(ClientPtr who, OsCommPtr oc, const char *extraBuf,
+                       int extraCount, void (*release) (void *closure),
+                       void *closure);
 
 static Bool CriticalOutputPending;
 static int timesThisConnection = 0;
-static ConnectionInputPtr FreeInputs = (ConnectionInputPtr) NULL;
-static ConnectionOutputPtr FreeOutputs = (ConnectionOutputPtr) NULL;
 static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 
 #define get_req_len(req,cli) ((cli)->swapped ? \
@@ -117,7 +137,27 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 				  ((xBigReq *)(req))->length)
 
 #define BUFSIZE 16384
-#define BUFWATERMARK 32768
+
+/*
+ * Input and output buffers come in sizes from BUFSIZE_MIN to BUFSIZE_MAX,
+ * powers of two.  Each connection uses buffers of the size its traffic
+ * calls for: a read or a write that fills its buffer doubles the size,
+ * BUFIDLE in a row that use less than an eighth of it halve it.  Big
+ * requests get a buffer of their own size.  A few buffers of each size
+ * are kept for the next connection that needs one, buffers of other
+ * sizes are freed.
+ */
+#define BUFSIZE_MIN 4096
+#define BUFSIZE_MAX 262144
+#define BUFSIZES 7
+#define BUFIDLE 16
+#define BUFPOOL 8
+
+static void *BufferPool[BUFSIZES][BUFPOOL];
+static int BufferPoolCount[BUFSIZES];
+
+/* At most this many pieces of output are written at once */
+#define FLUSH_IOVECS 16
 
 /*
  *   A lot of the code in this file manipulates a ConnectionInputPtr:
@@ -197,26 +237,101 @@ YieldControlDeath(void)
     timesThisConnection = 0;
 }
 
-/* If an input buffer was empty, either free it if it is too big or link it
- * into our list of free input buffers.  This means that different clients can
- * share the same input buffer (at different times).  This was done to save
- * memory.
+/* Returns the index of a buffer size in the pool, or -1 */
+static int
+BufferPoolIndex(int size)
+{
+    int i;
+
+    for (i = 0; i < BUFSIZES; i++)
+        if (size == BUFSIZE_MIN << i)
+            return i;
+    return -1;
+}
+
+/* Rounds a buffer size up to the next pooled size, if there is one */
+static int
+BufferSize(int size)
+{
+    int i;
+
+    for (i = 0; i < BUFSIZES; i++)
+        if (size <= BUFSIZE_MIN << i)
+            return BUFSIZE_MIN << i;
+    return size;
+}
+
+/* Returns a buffer of size bytes, from the pool if it has one */
+static void *
+AllocBuffer(int size)
+{
+    int i = BufferPoolIndex(size);
+
+    if (i >= 0 && BufferPoolCount[i])
+        return BufferPool[i][--BufferPoolCount[i]];
+    return malloc(size);
+}
+
+static void
+FreeBuffer(void *buf, int size)
+{
+    int i = BufferPoolIndex(size);
+
+    if (i >= 0 && BufferPoolCount[i] < BUFPOOL)
+        BufferPool[i][BufferPoolCount[i]++] = buf;
+    else
+        free(buf);
+}
+
+/*
+ * Adapts a buffer size to how much of a buffer that size the last read
+ * or write used.
+ */
+static void
+AdaptBufferSize(int *size, int *idle, int used)
+{
+    if (used >= *size) {
+        if (*size < BUFSIZE_MAX)
+            *size <<= 1;
+        *idle = 0;
+    }
+    else if (used < *size / 8) {
+        /* buffers for big requests are only kept while they keep coming */
+        if (*size > BUFSIZE_MAX)
+            *size = BUFSIZE_MAX;
+        else if (++*idle >= BUFIDLE && *size > BUFSIZE_MIN) {
+            *size >>= 1;
+            *idle = 0;
+        }
+    }
+    else
+        *idle = 0;
+}
+
+static void
+FreeInputBuffer(ConnectionInputPtr oci)
+{
+    FreeBuffer(oci->buffer, oci->size);
+    free(oci);
+}
+
+static void
+FreeOutputBuffer(ConnectionOutputPtr oco)
+{
+    FreeBuffer(oco->buf, oco->size);
+    free(oco);
+}
+
+/* If an input buffer was empty, give it back to the pool.  This means
+ * that different clients can share the same input buffer (at different
+ * times).  This was done to save memory.
  */
 static void
 NextAvailableInput(OsCommPtr oc)
 {
     if (AvailableInput) {
         if (AvailableInput != oc) {
-            ConnectionInputPtr aci = AvailableInput->input;
-
-            if (aci->size > BUFWATERMARK) {
-                free(aci->buffer);
-                free(aci);
-            }
-            else {
-                aci->next = FreeInputs;
-                FreeInputs = aci;
-            }
+            FreeInputBuffer(AvailableInput->input);
             AvailableInput->input = NULL;
         }
         AvailableInput = NULL;
@@ -239,10 +354,7 @@ ReadRequestFromClient(ClientPtr client)
     /* make sure we have an input buffer */
 
     if (!oci) {
-        if ((oci = FreeInputs)) {
-            FreeInputs = oci->next;
-        }
-        else if (!(oci = AllocateInputBuffer())) {
+        if (!(oci = AllocateInputBuffer(oc))) {
             YieldControlDeath();
             return -1;
         }
@@ -316,23 +428,35 @@ ReadRequestFromClient(ClientPtr client)
             oci->lenLastReq = gotnow;
             return needed;
         }
-        if ((gotnow == 0) || ((oci->bufptr - oci->buffer + needed) > oci->size)) {
-            /* no data, or the request is too big to fit in the buffer */
-
-            if ((gotnow > 0) && (oci->bufptr != oci->buffer))
-                /* save the data we've already read */
-                memmove(oci->buffer, oci->bufptr, gotnow);
-            if (needed > oci->size) {
-                /* make buffer bigger to accomodate request */
-                char *ibuf;
-
-                ibuf = (char *) realloc(oci->buffer, needed);
-                if (!ibuf) {
+        if ((gotnow == 0) || ((oci->bufptr - oci->buffer + needed) > oci->size) ||
+            ((oci->bufptr != oci->buffer) &&
+             (oci->size - oci->bufcnt < oci->size / 4))) {
+            /* no data, the request is too big to fit in the buffer, or
+               there is too little room left to read several requests */
+            int size;
+            char *ibuf = NULL;
+
+            if (needed > oc->inputSize)
+                oc->inputSize = needed;
+            size = BufferSize(oc->inputSize);
+
+            /* change to a buffer of the size the client needs now */
+            if (size != oci->size)
+                ibuf = AllocBuffer(size);
+            if (ibuf) {
+                memcpy(ibuf, oci->bufptr, gotnow);
+                FreeBuffer(oci->buffer, oci->size);
+                oci->size = size;
+                oci->buffer = ibuf;
+            }
+            else {
+                if (needed > oci->size) {
                     YieldControlDeath();
                     return -1;
                 }
-                oci->size = needed;
-                oci->buffer = ibuf;
+                if ((gotnow > 0) && (oci->bufptr != oci->buffer))
+                    /* save the data we've already read */
+                    memmove(oci->buffer, oci->bufptr, gotnow);
             }
             oci->bufptr = oci->buffer;
             oci->bufcnt = gotnow;
@@ -349,6 +473,7 @@ ReadRequestFromClient(ClientPtr client)
             YieldControlDeath();
             return -1;
         }
+        ioStats.reads++;
         result = _XSERVTransRead(oc->trans_conn, oci->buffer + oci->bufcnt,
                                  oci->size - oci->bufcnt);
         if (result <= 0) {
@@ -365,20 +490,11 @@ ReadRequestFromClient(ClientPtr client)
             YieldControlDeath();
             return -1;
         }
+        /* a read that fills the buffer leaves more for the next one */
+        AdaptBufferSize(&oc->inputSize, &oc->inputIdle,
+                        result < oci->size - oci->bufcnt ? result : oci->size);
         oci->bufcnt += result;
         gotnow += result;
-        /* free up some space after huge requests */
-        if ((oci->size > BUFWATERMARK) &&
-            (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE)) {
-            char *ibuf;
-
-            ibuf = (char *) realloc(oci->buffer, BUFSIZE);
-            if (ibuf) {
-                oci->size = BUFSIZE;
-                oci->buffer = ibuf;
-                oci->bufptr = ibuf + oci->bufcnt - gotnow;
-            }
-        }
         if (need_header && gotnow >= needed) {
             /* We wanted an xReq, now we've gotten it. */
             request = (xReq *) oci->bufptr;
@@ -453,6 +569,7 @@ ReadRequestFromClient(ClientPtr client)
         client->req_len -= bytes_to_int32(sizeof(xBigReq) - sizeof(xReq));
     }
     client->requestBuffer = (void *) oci->bufptr;
+    ioStats.requests++;
 #ifdef DEBUG_COMMUNICATION
     {
         xReq *req = client->requestBuffer;
@@ -464,6 +581,46 @@ ReadRequestFromClient(ClientPtr client)
     return needed;
 }
 
+/*****************************************************************
+ * ReadBufferedRequestFromClient
+ *    Like ReadRequestFromClient, but only returns the next request if
+ *    it is already complete in the client's buffer, and returns 0
+ *    otherwise.  It never reads from the connection, and leaves big
+ *    requests, requests carrying file descriptors and requests to be
+ *    ignored to ReadRequestFromClient.  This is what lets Dispatch run
+ *    the requests a client sent in one go as a batch.
+ *****************************************************************/
+
+int
+ReadBufferedRequestFromClient(ClientPtr client)
+{
+    OsCommPtr oc = (OsCommPtr) client->osPrivate;
+    ConnectionInputPtr oci = oc->input;
+    unsigned int gotnow, needed;
+    xReq *request;
+
+    if (!oci || oci->ignoreBytes || client->req_fds > 0)
+        return 0;
+
+    request = (xReq *) (oci->bufptr + oci->lenLastReq);
+    gotnow = oci->bufcnt + oci->buffer - (char *) request;
+    if (gotnow < sizeof(xReq))
+        return 0;
+    needed = get_req_len(request, client) << 2;
+    if (!needed || needed > gotnow)
+        return 0;
+
+    NextAvailableInput(oc);
+    oci->bufptr = (char *) request;
+    oci->lenLastReq = needed;
+    if (gotnow == needed)
+        AvailableInput = oc;
+    client->req_len = needed >> 2;
+    client->requestBuffer = request;
+    ioStats.requests++;
+    return needed;
+}
+
 int
 ReadFdFromClient(ClientPtr client)
 {
@@ -510,9 +667,7 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     NextAvailableInput(oc);
 
     if (!oci) {
-        if ((oci = FreeInputs))
-            FreeInputs = oci->next;
-        else if (!(oci = AllocateInputBuffer()))
+        if (!(oci = AllocateInputBuffer(oc)))
             return FALSE;
         oc->input = oci;
     }
@@ -666,35 +821,31 @@ AbortClient(ClientPtr client)
     }
 }
 
-/*****************
- * WriteToClient
- *    Copies buf into ClientPtr.buf if it fits (with padding), else
- *    flushes ClientPtr.buf and buf to client.  As of this writing,
- *    every use of WriteToClient is cast to void, and the result
- *    is ignored.  Potentially, this could be used by requests
- *    that are sending several chunks of data and want to break
- *    out of a loop on error.  Thus, we will leave the type of
- *    this routine as int.
- *****************/
-
-int
-WriteToClient(ClientPtr who, int count, const void *__buf)
+/*
+ * Does what every write to a client has to: accounting, reply callbacks
+ * and making sure the client has an output buffer.  Returns the output
+ * buffer, or NULL with the value to return in *result if nothing is to
+ * be written.
+ */
+static ConnectionOutputPtr
+PrepareOutput(ClientPtr who, int count, const char *buf, int *result)
 {
     OsCommPtr oc;
     ConnectionOutputPtr oco;
     int padBytes;
-    const char *buf = __buf;
 
-    BUG_RETURN_VAL_MSG(in_input_thread(), 0,
+    *result = 0;
+    BUG_RETURN_VAL_MSG(in_input_thread(), NULL,
                        "******** %s called from input thread *********\n", __func__);
 
 #ifdef DEBUG_COMMUNICATION
     Bool multicount = FALSE;
 #endif
     if (!count || !who || who == serverClient || who->clientGone)
-        return 0;
+        return NULL;
     oc = who->osPrivate;
     oco = oc->output;
+    ReqStatsWrite(who, count);
 #ifdef DEBUG_COMMUNICATION
     {
         char info[128];
@@ -737,13 +888,11 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 #endif
 
     if (!oco) {
-        if ((oco = FreeOutputs)) {
-            FreeOutputs = oco->next;
-        }
-        else if (!(oco = AllocateOutputBuffer())) {
+        if (!(oco = AllocateOutputBuffer(oc))) {
             AbortClient(who);
             MarkClientException(who);
-            return -1;
+            *result = -1;
+            return NULL;
         }
         oc->output = oco;
     }
@@ -790,7 +939,127 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         }
     }
 #endif
-    if (oco->count == 0 || oco->count + count + padBytes > oco->size) {
+    return oco;
+}
+
+static void
+ReleaseSegment(ConnectionOutputSegmentPtr seg)
+{
+    if (seg->release)
+        (*seg->release) (seg->closure);
+    free(seg);
+}
+
+static void
+ReleaseSegments(ConnectionOutputPtr oco)
+{
+    ConnectionOutputSegmentPtr seg;
+
+    while ((seg = oco->segments)) {
+        oco->segments = seg->next;
+        ReleaseSegment(seg);
+    }
+    oco->lastSegment = NULL;
+}
+
+/*
+ * Queues count bytes of data behind the output already queued.  With a
+ * release function the data itself is queued, otherwise a copy of it.
+ */
+static Bool
+AppendSegment(ConnectionOutputPtr oco, const char *data, int count,
+              void (*release) (void *closure), void *closure)
+{
+    ConnectionOutputSegmentPtr seg = oco->lastSegment;
+    int size;
+
+    if (!release && seg && !seg->release &&
+        seg->data - seg->buf + seg->count + count <= seg->size) {
+        memcpy(seg->buf + (seg->data - seg->buf) + seg->count, data, count);
+        seg->count += count;
+        return TRUE;
+    }
+
+    size = release ? 0 : max(count, BUFSIZE);
+    seg = malloc(sizeof(ConnectionOutputSegment) + size);
+    if (!seg)
+        return FALSE;
+    seg->next = NULL;
+    seg->count = count;
+    seg->size = size;
+    seg->release = release;
+    seg->closure = closure;
+    if (release)
+        seg->data = data;
+    else {
+        memcpy(seg->buf, data, count);
+        seg->data = seg->buf;
+    }
+
+    if (oco->lastSegment)
+        oco->lastSegment->next = seg;
+    else
+        oco->segments = seg;
+    oco->lastSegment = seg;
+    return TRUE;
+}
+
+/* Queues a copy of count bytes of data behind the output already queued */
+static Bool
+QueueOutput(ConnectionOutputPtr oco, const char *data, long count)
+{
+    if (!count)
+        return TRUE;
+    if (oco->segments)
+        return AppendSegment(oco, data, count, NULL, NULL);
+
+    if (oco->count + count > oco->size) {
+        unsigned char *obuf = NULL;
+
+        if (oco->count + count + BUFSIZE <= INT_MAX)
+            obuf = realloc(oco->buf, oco->count + count + BUFSIZE);
+        if (!obuf)
+            return FALSE;
+        oco->size = oco->count + count + BUFSIZE;
+        oco->buf = obuf;
+    }
+    memmove(oco->buf + oco->count, data, count);
+    oco->count += count;
+    return TRUE;
+}
+
+/*****************
+ * WriteToClient
+ *    Copies buf into ClientPtr.buf if it fits (with padding), else
+ *    flushes ClientPtr.buf and buf to client.  As of this writing,
+ *    every use of WriteToClient is cast to void, and the result
+ *    is ignored.  Potentially, this could be used by requests
+ *    that are sending several chunks of data and want to break
+ *    out of a loop on error.  Thus, we will leave the type of
+ *    this routine as int.
+ *****************/
+
+int
+WriteToClient(ClientPtr who, int count, const void *__buf)
+{
+    static const char padBuffer[3];
+    OsCommPtr oc;
+    ConnectionOutputPtr oco;
+    int padBytes, result;
+    const char *buf = __buf;
+
+    oco = PrepareOutput(who, count, buf, &result);
+    if (!oco)
+        return result;
+    oc = who->osPrivate;
+
+    padBytes = padding_for_int32(count);
+
+    if (!oco->segments &&
+        (oco->count == 0 || oco->count + count + padBytes > oco->size)) {
+        /* a buffer that fills up between flushes is too small */
+        if (oco->count)
+            AdaptBufferSize(&oc->outputSize, &oc->outputIdle, oco->size);
         output_pending_clear(who);
         if (!any_output_pending()) {
             CriticalOutputPending = FALSE;
@@ -802,15 +1071,71 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 
     NewOutputPending = TRUE;
     output_pending_mark(who);
-    memmove((char *) oco->buf + oco->count, buf, count);
-    oco->count += count;
-    if (padBytes) {
-        memset(oco->buf + oco->count, '\0', padBytes);
-        oco->count += padBytes;
+    if (!QueueOutput(oco, buf, count) ||
+        !QueueOutput(oco, padBuffer, padBytes)) {
+        AbortClient(who);
+        MarkClientException(who);
+        return -1;
     }
     return count;
 }
 
+/*****************
+ * WriteBufferToClient
+ *    Like WriteToClient, but hands buf over instead of copying it
+ *    when the client cannot take all of it right away.  release is
+ *    called with closure once buf is no longer needed, which may be
+ *    before this returns, and buf must not change until then.  Worth
+ *    it for large replies, smaller buffers are just copied.
+ *****************/
+
+int
+WriteBufferToClient(ClientPtr who, int count, const void *buf,
+                    void (*release) (void *closure), void *closure)
+{
+    static const char padBuffer[3];
+    ConnectionOutputPtr oco;
+    int result;
+
+    if (count < BUFSIZE) {
+        result = WriteToClient(who, count, buf);
+        (*release) (closure);
+        return result;
+    }
+
+    oco = PrepareOutput(who, count, buf, &result);
+    if (!oco) {
+        (*release) (closure);
+        return result;
+    }
+
+    /* Already waiting for the client, queue buf behind the rest */
+    if (oco->segments) {
+        NewOutputPending = TRUE;
+        output_pending_mark(who);
+        if (!AppendSegment(oco, buf, count, release, closure)) {
+            (*release) (closure);
+            AbortClient(who);
+            MarkClientException(who);
+            return -1;
+        }
+        if (!QueueOutput(oco, padBuffer, padding_for_int32(count))) {
+            AbortClient(who);
+            MarkClientException(who);
+            return -1;
+        }
+        return count;
+    }
+
+    output_pending_clear(who);
+    if (!any_output_pending()) {
+        CriticalOutputPending = FALSE;
+        NewOutputPending = FALSE;
+    }
+
+    return FlushOutput(who, who->osPrivate, buf, count, release, closure);
+}
+
  /********************
  * FlushClient()
  *    If the client isn't keeping up with us, then we try to continue
@@ -823,78 +1148,97 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 
 int
 FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
+{
+    return FlushOutput(who, oc, __extraBuf, extraCount, NULL, NULL);
+}
+
+/*
+ * Writes what is queued for the client, followed by extraBuf and its
+ * padding, in as few writev calls as it can.  What cannot be written
+ * is queued: extraBuf itself if there is a release function for it,
+ * otherwise a copy of the rest of it.
+ */
+static int
+FlushOutput(ClientPtr who, OsCommPtr oc, const char *extraBuf, int extraCount,
+            void (*release) (void *closure), void *closure)
 {
     ConnectionOutputPtr oco = oc->output;
     XtransConnInfo trans_conn = oc->trans_conn;
-    struct iovec iov[3];
+    ConnectionOutputSegmentPtr seg;
+    struct iovec iov[FLUSH_IOVECS];
     static char padBuffer[3];
-    const char *extraBuf = __extraBuf;
-    long written;
-    long padsize;
-    long notWritten;
-    long todo;
+    long headDone, extraDone, padsize, todo, remain, attempted, len, n;
+    int i;
 
-    if (!oco)
-	return 0;
-    written = 0;
+    if (!oco) {
+        if (release)
+            (*release) (closure);
+        return 0;
+    }
     padsize = padding_for_int32(extraCount);
-    notWritten = oco->count + extraCount + padsize;
-    if (!notWritten)
+    if (!oco->count && !oco->segments && !extraCount)
         return 0;
 
     if (FlushCallback)
         CallCallbacks(&FlushCallback, who);
 
-    todo = notWritten;
-    while (notWritten) {
-        long before = written;  /* amount of whole thing written */
-        long remain = todo;     /* amount to try this time, <= notWritten */
-        int i = 0;
-        long len;
-
-        /* You could be very general here and have "in" and "out" iovecs
-         * and write a loop without using a macro, but what the heck.  This
-         * translates to:
-         *
-         *     how much of this piece is new?
-         *     if more new then we are trying this time, clamp
-         *     if nothing new
-         *         then bump down amount already written, for next piece
-         *         else put new stuff in iovec, will need all of next piece
-         *
-         * Note that todo had better be at least 1 or else we'll end up
-         * writing 0 iovecs.
-         */
-#define InsertIOV(pointer, length) \
-	len = (length) - before; \
-	if (len > remain) \
-	    len = remain; \
-	if (len <= 0) { \
-	    before = (-len); \
-	} else { \
-	    iov[i].iov_len = len; \
-	    iov[i].iov_base = (pointer) + before;	\
+    if (oco->count && !oco->segments)
+        AdaptBufferSize(&oc->outputSize, &oc->outputIdle, oco->count);
+
+    headDone = 0;               /* bytes of oco->buf written */
+    extraDone = 0;              /* bytes of extraBuf and padding written */
+    todo = LONG_MAX;
+    while (headDone < oco->count || oco->segments ||
+           extraDone < extraCount + padsize) {
+        i = 0;
+        remain = todo;
+
+#define AddIOV(pointer, length) \
+	if ((length) > 0 && remain > 0) { \
+	    iov[i].iov_base = (char *) (pointer); \
+	    iov[i].iov_len = min((length), remain); \
+	    remain -= iov[i].iov_len; \
 	    i++; \
-	    remain -= len; \
-	    before = 0; \
 	}
 
-        InsertIOV((char *) oco->buf, oco->count)
-            InsertIOV((char *) extraBuf, extraCount)
-            InsertIOV(padBuffer, padsize)
+        AddIOV(oco->buf + headDone, oco->count - headDone)
+        for (seg = oco->segments; seg && i < FLUSH_IOVECS - 2; seg = seg->next)
+            AddIOV(seg->data, seg->count)
+        /* extraBuf goes after all of the queued output */
+        if (!seg) {
+            AddIOV(extraBuf + extraDone, extraCount - extraDone)
+            AddIOV(padBuffer + max(extraDone - extraCount, 0),
+                   padsize - max(extraDone - extraCount, 0))
+        }
+#undef AddIOV
+        attempted = todo - remain;
 
-            errno = 0;
+        errno = 0;
+        ioStats.writes++;
         if (trans_conn && (len = _XSERVTransWritev(trans_conn, iov, i)) >= 0) {
-            written += len;
-            notWritten -= len;
-            todo = notWritten;
+            n = min(len, oco->count - headDone);
+            headDone += n;
+            len -= n;
+            while (len && (seg = oco->segments)) {
+                n = min(len, seg->count);
+                seg->data += n;
+                seg->count -= n;
+                len -= n;
+                if (!seg->count) {
+                    if (!(oco->segments = seg->next))
+                        oco->lastSegment = NULL;
+                    ReleaseSegment(seg);
+                }
+            }
+            extraDone += len;
+            todo = LONG_MAX;
         }
         else if (ETEST(errno)
 #ifdef SUNSYSV                  /* check for another brain-damaged OS bug */
                  || (errno == 0)
 #endif
 #ifdef EMSGSIZE                 /* check for another brain-damaged OS bug */
-                 || ((errno == EMSGSIZE) && (todo == 1))
+                 || ((errno == EMSGSIZE) && (attempted == 1))
 #endif
             ) {
             /* If we've arrived here, then the client is stuffed to the gills
@@ -902,42 +1246,30 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
                the rest. */
             output_pending_mark(who);
 
-            if (written < oco->count) {
-                if (written > 0) {
-                    oco->count -= written;
-                    memmove((char *) oco->buf,
-                            (char *) oco->buf + written, oco->count);
-                    written = 0;
-                }
-            }
-            else {
-                written -= oco->count;
-                oco->count = 0;
+            if (headDone > 0) {
+                oco->count -= headDone;
+                memmove((char *) oco->buf,
+                        (char *) oco->buf + headDone, oco->count);
             }
 
-            if (notWritten > oco->size) {
-                unsigned char *obuf = NULL;
-
-                if (notWritten + BUFSIZE <= INT_MAX) {
-                    obuf = realloc(oco->buf, notWritten + BUFSIZE);
-                }
-                if (!obuf) {
-                    AbortClient(who);
-                    MarkClientException(who);
-                    oco->count = 0;
-                    return -1;
-                }
-                oco->size = notWritten + BUFSIZE;
-                oco->buf = obuf;
+            if (extraDone < extraCount && release) {
+                if (!AppendSegment(oco, extraBuf + extraDone,
+                                   extraCount - extraDone, release, closure))
+                    goto abort;
+                release = NULL;
+                extraDone = extraCount;
             }
-
+            if (extraDone < extraCount &&
+                !QueueOutput(oco, extraBuf + extraDone, extraCount - extraDone))
+                goto abort;
             /* If the amount written extended into the padBuffer, then the
-               difference "extraCount - written" may be less than 0 */
-            if ((len = extraCount - written) > 0)
-                memmove((char *) oco->buf + oco->count,
-                        extraBuf + written, len);
+               difference "extraCount - extraDone" may be less than 0 */
+            if (!QueueOutput(oco, padBuffer,
+                             padsize - max(extraDone - extraCount, 0)))
+                goto abort;
 
-            oco->count = notWritten;    /* this will include the pad */
+            if (release)
+                (*release) (closure);
             ospoll_listen(server_poll, oc->fd, X_NOTIFY_WRITE);
 
             /* return only the amount explicitly requested */
@@ -945,47 +1277,46 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
         }
 #ifdef EMSGSIZE                 /* check for another brain-damaged OS bug */
         else if (errno == EMSGSIZE) {
-            todo >>= 1;
+            todo = attempted >> 1;
         }
 #endif
-        else {
-            AbortClient(who);
-            MarkClientException(who);
-            oco->count = 0;
-            return -1;
-        }
+        else
+            goto abort;
     }
 
+    if (release)
+        (*release) (closure);
+
     /* everything was flushed out */
-    oco->count = 0;
     output_pending_clear(who);
-
-    if (oco->size > BUFWATERMARK) {
-        free(oco->buf);
-        free(oco);
-    }
-    else {
-        oco->next = FreeOutputs;
-        FreeOutputs = oco;
-    }
+    FreeOutputBuffer(oco);
     oc->output = (ConnectionOutputPtr) NULL;
     return extraCount;          /* return only the amount explicitly requested */
+
+ abort:
+    if (release)
+        (*release) (closure);
+    AbortClient(who);
+    MarkClientException(who);
+    oco->count = 0;
+    ReleaseSegments(oco);
+    return -1;
 }
 
 static ConnectionInputPtr
-AllocateInputBuffer(void)
+AllocateInputBuffer(OsCommPtr oc)
 {
     ConnectionInputPtr oci;
 
     oci = malloc(sizeof(ConnectionInput));
     if (!oci)
         return NULL;
-    oci->buffer = malloc(BUFSIZE);
+    oci->size = BufferSize(min(oc->inputSize, BUFSIZE_MAX));
+    oci->buffer = AllocBuffer(oci->size);
     if (!oci->buffer) {
         free(oci);
         return NULL;
     }
-    oci->size = BUFSIZE;
     oci->bufptr = oci->buffer;
     oci->bufcnt = 0;
     oci->lenLastReq = 0;
@@ -994,23 +1325,34 @@ AllocateInputBuffer(void)
 }
 
 static ConnectionOutputPtr
-AllocateOutputBuffer(void)
+AllocateOutputBuffer(OsCommPtr oc)
 {
     ConnectionOutputPtr oco;
 
     oco = malloc(sizeof(ConnectionOutput));
     if (!oco)
         return NULL;
-    oco->buf = calloc(1, BUFSIZE);
+    oco->buf = AllocBuffer(oc->outputSize);
     if (!oco->buf) {
         free(oco);
         return NULL;
     }
-    oco->size = BUFSIZE;
+    oco->size = oc->outputSize;
     oco->count = 0;
+    oco->segments = NULL;
+    oco->lastSegment = NULL;
     return oco;
 }
 
+void
+InitOsBuffers(OsCommPtr oc)
+{
+    oc->inputSize = BUFSIZE;
+    oc->outputSize = BUFSIZE;
+    oc->inputIdle = 0;
+    oc->outputIdle = 0;
+}
+
 void
 FreeOsBuffers(OsCommPtr oc)
 {
@@ -1019,47 +1361,21 @@ FreeOsBuffers(OsCommPtr oc)
 
     if (AvailableInput == oc)
         AvailableInput = (OsCommPtr) NULL;
-    if ((oci = oc->input)) {
-        if (FreeInputs) {
-            free(oci->buffer);
-            free(oci);
-        }
-        else {
-            FreeInputs = oci;
-            oci->next = (ConnectionInputPtr) NULL;
-            oci->bufptr = oci->buffer;
-            oci->bufcnt = 0;
-            oci->lenLastReq = 0;
-            oci->ignoreBytes = 0;
-        }
-    }
+    if ((oci = oc->input))
+        FreeInputBuffer(oci);
     if ((oco = oc->output)) {
-        if (FreeOutputs) {
-            free(oco->buf);
-            free(oco);
-        }
-        else {
-            FreeOutputs = oco;
-            oco->next = (ConnectionOutputPtr) NULL;
-            oco->count = 0;
-        }
+        ReleaseSegments(oco);
+        FreeOutputBuffer(oco);
     }
 }
 
 void
 ResetOsBuffers(void)
 {
-    ConnectionInputPtr oci;
-    ConnectionOutputPtr oco;
+    int i;
 
-    while ((oci = FreeInputs)) {
-        FreeInputs = oci->next;
-        free(oci->buffer);
-        free(oci);
-    }
-    while ((oco = FreeOutputs)) {
-        FreeOutputs = oco->next;
-        free(oco->buf);
-        free(oco);
+    for (i = 0; i < BUFSIZES; i++) {
+        while (BufferPoolCount[i])
+            free(BufferPool[i][--BufferPoolCount[i]]);
     }
 }
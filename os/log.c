@@ -86,6 +86,10 @@ OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdarg.h>
 #include <stdlib.h>             /* for malloc() */
 #include <errno.h>
+#ifndef WIN32
+#include <signal.h>
+#include <pthread.h>
+#endif
 
 #include "input.h"
 #include "site.h"
@@ -120,6 +124,9 @@ static char *saveBuffer = NULL;
 static int bufferSize = 0, bufferUnused = 0, bufferPos = 0;
 static Bool needBuffer = TRUE;
 
+/* Whether the next message written to the log file starts a line */
+static Bool logNewline = TRUE;
+
 #ifdef __APPLE__
 static char __crashreporter_info_buff__[4096] = { 0 };
 
@@ -174,6 +181,240 @@ strlen_sigsafe(const char *s)
     return len;
 }
 
+#ifndef WIN32
+
+/*
+ * Once LogInit() has run, messages are queued to a ring buffer per
+ * destination and written out by the log thread, so a burst of logging
+ * does not stall the server.  The rings are bounded: a message that does
+ * not fit is dropped and counted, never waited for, and the count is
+ * logged once the ring drains.
+ *
+ * Messages logged in signal context are still written directly, and so
+ * may overtake queued ones.  Logging is synchronous again once the server
+ * is going down, or when the log is to be synced.
+ */
+#define LOG_RING_SIZE	(64 * 1024)
+
+typedef struct _LogRing {
+    int fd;
+    Bool timestamp;
+    size_t head, tail;          /* head - tail bytes are queued */
+    unsigned int dropped;
+    char buf[LOG_RING_SIZE];
+} LogRingRec, *LogRingPtr;
+
+static LogRingRec stderrRing = { .fd = 2 };
+static LogRingRec fileRing = { .fd = -1, .timestamp = TRUE };
+
+static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logQueued = PTHREAD_COND_INITIALIZER;
+static pthread_t logThread;
+static Bool logThreadStarted;
+/* Protected by logMutex */
+static Bool logAsync;
+static Bool logAsyncStop;
+static Bool logThreadWaiting;
+
+static void
+LogRingCopy(LogRingPtr ring, const char *buf, size_t len)
+{
+    size_t pos = ring->head % LOG_RING_SIZE;
+    size_t n = min(len, LOG_RING_SIZE - pos);
+
+    memcpy(ring->buf + pos, buf, n);
+    memcpy(ring->buf, buf + n, len - n);
+    ring->head += len;
+}
+
+static void
+LogRingQueue(LogRingPtr ring, const char *prefix, size_t prefixLen,
+             const char *buf, size_t len)
+{
+    if (prefixLen + len > LOG_RING_SIZE - (ring->head - ring->tail)) {
+        ring->dropped++;
+        return;
+    }
+    LogRingCopy(ring, prefix, prefixLen);
+    LogRingCopy(ring, buf, len);
+}
+
+/* Writes out the first contiguous part of @ring, with logMutex held. */
+static void
+LogRingFlush(LogRingPtr ring)
+{
+    size_t pos = ring->tail % LOG_RING_SIZE;
+    size_t len = min(ring->head - ring->tail, LOG_RING_SIZE - pos);
+    ssize_t ret;
+
+    pthread_mutex_unlock(&logMutex);
+    ret = write(ring->fd, ring->buf + pos, len);
+    pthread_mutex_lock(&logMutex);
+
+    /* There's no place to log an error message if the write fails */
+    ring->tail += ret > 0 ? ret : len;
+
+    if (ring->head == ring->tail && ring->dropped) {
+        char note[80];
+        int n = 0;
+
+        if (ring->timestamp)
+            n = snprintf(note, sizeof(note), "[%10.3f] ",
+                         GetTimeInMillis() / 1000.0);
+        n += snprintf(note + n, sizeof(note) - n,
+                      "%s %u log messages dropped\n", X_WARNING_STRING,
+                      ring->dropped);
+        ring->dropped = 0;
+
+        pthread_mutex_unlock(&logMutex);
+        ret = write(ring->fd, note, n);
+        pthread_mutex_lock(&logMutex);
+    }
+}
+
+static void *
+LogThreadDoWork(void *arg)
+{
+    sigset_t set;
+
+    /* Don't handle any signals on this thread */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+#if defined(HAVE_PTHREAD_SETNAME_NP_WITH_TID)
+    pthread_setname_np(pthread_self(), "LogThread");
+#elif defined(HAVE_PTHREAD_SETNAME_NP_WITHOUT_TID)
+    pthread_setname_np("LogThread");
+#endif
+
+    pthread_mutex_lock(&logMutex);
+    for (;;) {
+        if (stderrRing.head != stderrRing.tail)
+            LogRingFlush(&stderrRing);
+        else if (fileRing.head != fileRing.tail)
+            LogRingFlush(&fileRing);
+        else if (logAsyncStop)
+            break;
+        else {
+            logThreadWaiting = TRUE;
+            pthread_cond_wait(&logQueued, &logMutex);
+            logThreadWaiting = FALSE;
+        }
+    }
+    logAsync = FALSE;
+    pthread_mutex_unlock(&logMutex);
+    return NULL;
+}
+
+/*
+ * Queues a message for the log thread, unless logging is synchronous.
+ */
+static Bool
+LogQueue(int verb, const char *buf, size_t len, Bool end_line)
+{
+    char stamp[32];
+    int stampLen = 0;
+
+    pthread_mutex_lock(&logMutex);
+    if (!logAsync) {
+        pthread_mutex_unlock(&logMutex);
+        return FALSE;
+    }
+
+    if (verb < 0 || logVerbosity >= verb)
+        LogRingQueue(&stderrRing, NULL, 0, buf, len);
+
+    if ((verb < 0 || logFileVerbosity >= verb) && fileRing.fd >= 0) {
+        if (logNewline)
+            stampLen = snprintf(stamp, sizeof(stamp), "[%10.3f] ",
+                                GetTimeInMillis() / 1000.0);
+        logNewline = end_line;
+        LogRingQueue(&fileRing, stamp, stampLen, buf, len);
+    }
+
+    /* The thread only sleeps with empty rings */
+    if (logThreadWaiting)
+        pthread_cond_signal(&logQueued);
+    pthread_mutex_unlock(&logMutex);
+    return TRUE;
+}
+
+/* Writes out what is queued, racing with the log thread. */
+static void
+LogRingDrainSigSafe(LogRingPtr ring)
+{
+    while (ring->head != ring->tail) {
+        size_t pos = ring->tail % LOG_RING_SIZE;
+        size_t len = min(ring->head - ring->tail, LOG_RING_SIZE - pos);
+        ssize_t ret = write(ring->fd, ring->buf + pos, len);
+
+        ring->tail += ret > 0 ? ret : len;
+    }
+}
+
+/*
+ * Writes out all queued messages and makes logging synchronous.  In
+ * signal context, where the log thread can't be waited for, the queued
+ * messages are written directly instead.
+ */
+static void
+LogAsyncStop(void)
+{
+    if (!logThreadStarted)
+        return;
+
+    if (inSignalContext) {
+        LogRingDrainSigSafe(&stderrRing);
+        LogRingDrainSigSafe(&fileRing);
+        return;
+    }
+
+    pthread_mutex_lock(&logMutex);
+    logAsyncStop = TRUE;
+    pthread_cond_signal(&logQueued);
+    pthread_mutex_unlock(&logMutex);
+    pthread_join(logThread, NULL);
+    logThreadStarted = FALSE;
+}
+
+static void
+LogAsyncStart(void)
+{
+    static Bool registered;
+
+    if (logThreadStarted || logSync)
+        return;
+
+    fileRing.fd = logFileFd;
+    logAsync = TRUE;
+    logAsyncStop = FALSE;
+    if (pthread_create(&logThread, NULL, LogThreadDoWork, NULL) != 0) {
+        logAsync = FALSE;
+        return;
+    }
+    logThreadStarted = TRUE;
+
+    /* Don't lose what is queued when the server exits without LogClose() */
+    if (!registered) {
+        atexit(LogAsyncStop);
+        registered = TRUE;
+    }
+}
+
+#else
+
+static void
+LogAsyncStart(void)
+{
+}
+
+static void
+LogAsyncStop(void)
+{
+}
+
+#endif
+
 /*
  * LogFilePrep is called to setup files for logging, including getting
  * an old file out of the way, but it doesn't actually open the file,
@@ -241,6 +482,8 @@ LogInit(const char *fname, const char *backup)
 {
     char *logFileName = NULL;
 
+    LogAsyncStop();
+
     if (fname && *fname) {
         if (displayfd != -1) {
             /* Display isn't set yet, so we can't use it in filenames yet. */
@@ -285,6 +528,8 @@ LogInit(const char *fname, const char *backup)
     }
     needBuffer = FALSE;
 
+    LogAsyncStart();
+
     return logFileName;
 }
 
@@ -321,6 +566,8 @@ LogSetDisplay(void)
 void
 LogClose(enum ExitCode error)
 {
+    LogAsyncStop();
+
     if (logFile) {
         int msgtype = (error == EXIT_NO_ERROR) ? X_INFO : X_ERROR;
         LogMessageVerbSigSafe(msgtype, -1,
@@ -342,6 +589,9 @@ LogSetParameter(LogParameter param, int value)
         return TRUE;
     case XLOG_SYNC:
         logSync = value ? TRUE : FALSE;
+        /* Synced messages must be on disk before the server goes on */
+        if (logSync)
+            LogAsyncStop();
         return TRUE;
     case XLOG_VERBOSITY:
         logVerbosity = value;
@@ -590,9 +840,13 @@ pnprintf(char *string, int size, const char *f, ...)
 static void
 LogSWrite(int verb, const char *buf, size_t len, Bool end_line)
 {
-    static Bool newline = TRUE;
     int ret;
 
+#ifndef WIN32
+    if (!inSignalContext && LogQueue(verb, buf, len, end_line))
+        return;
+#endif
+
     if (verb < 0 || logVerbosity >= verb)
         ret = write(2, buf, len);
 
@@ -605,9 +859,9 @@ LogSWrite(int verb, const char *buf, size_t len, Bool end_line)
 #endif
         }
         else if (!inSignalContext && logFile) {
-            if (newline)
+            if (logNewline)
                 fprintf(logFile, "[%10.3f] ", GetTimeInMillis() / 1000.0);
-            newline = end_line;
+            logNewline = end_line;
             fwrite(buf, len, 1, logFile);
             if (logFlush) {
                 fflush(logFile);
@@ -979,6 +1233,8 @@ FatalError(const char *f, ...)
     va_list args2;
     static Bool beenhere = FALSE;
 
+    LogAsyncStop();
+
     if (beenhere)
         ErrorFSigSafe("\nFatalError re-entered, aborting\n");
     else
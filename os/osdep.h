@@ -119,6 +119,10 @@ typedef struct _osComm {
     CARD32 conn_time;           /* timestamp if not established, else 0  */
     struct _XtransConnInfo *trans_conn; /* transport connection object */
     int flags;
+    int inputSize;              /* size of the buffers to read into */
+    int outputSize;             /* size of the buffers to write from */
+    int inputIdle;              /* reads in a row that used little of it */
+    int outputIdle;             /* flushes in a row that used little of it */
 } OsCommRec, *OsCommPtr;
 
 #define OS_COMM_GRAB_IMPERVIOUS 1
@@ -133,6 +137,9 @@ extern int FlushClient(ClientPtr /*who */ ,
 extern void FreeOsBuffers(OsCommPtr     /*oc */
     );
 
+extern void InitOsBuffers(OsCommPtr     /*oc */
+    );
+
 void
 CloseDownFileDescriptor(OsCommPtr oc);
 
@@ -146,6 +146,7 @@ Bool noSecurityExtension = FALSE;
 #ifdef RES
 Bool noResExtension = FALSE;
 #endif
+Bool noReqStatsExtension = FALSE;
 #ifdef XF86BIGFONT
 Bool noXFree86BigfontExtension = FALSE;
 #endif
@@ -577,6 +578,7 @@ UseMsg(void)
     ErrorF
         ("-dumbSched             Disable smart scheduling and threaded input, enable old behavior\n");
     ErrorF("-schedInterval int     Set scheduler interval in msec\n");
+    ErrorF("-schedBoost int        Favor clients that got input in the last int msec\n");
     ErrorF("-sigstop               Enable SIGSTOP based startup\n");
     ErrorF("+extension name        Enable extension\n");
     ErrorF("-extension name        Disable extension\n");
@@ -1000,6 +1002,7 @@ ProcessCommandLine(int argc, char *argv[])
 #ifdef HAVE_SETITIMER
             SmartScheduleSignalEnable = FALSE;
 #endif
+            SmartScheduleBoost = 0;
         }
         else if (strcmp(argv[i], "-schedInterval") == 0) {
             if (++i < argc) {
@@ -1016,6 +1019,13 @@ ProcessCommandLine(int argc, char *argv[])
             else
                 UseMsg();
         }
+        else if (strcmp(argv[i], "-schedBoost") == 0) {
+            if (++i < argc) {
+                SmartScheduleBoost = atoi(argv[i]);
+            }
+            else
+                UseMsg();
+        }
         else if (strcmp(argv[i], "-render") == 0) {
             if (++i < argc) {
                 int policy = PictureParseCmapPolicy(argv[i]);
@@ -0,0 +1,267 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <X11/Xatom.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "os.h"
+#include "dix.h"
+
+#include "tests-common.h"
+
+#define BENCH_CLIENTS 1000
+
+/* What a GTK or Qt application interns at startup, give or take */
+static const char *toolkit_atoms[] = {
+    "UTF8_STRING", "CLIPBOARD", "TARGETS", "MULTIPLE", "TIMESTAMP",
+    "SAVE_TARGETS", "CLIPBOARD_MANAGER", "TEXT", "COMPOUND_TEXT",
+    "text/plain", "text/plain;charset=utf-8", "text/uri-list",
+    "text/html", "image/png", "application/x-qt-image", "INCR",
+    "WM_PROTOCOLS", "WM_DELETE_WINDOW", "WM_TAKE_FOCUS", "WM_STATE",
+    "WM_CHANGE_STATE", "WM_CLIENT_LEADER", "WM_WINDOW_ROLE",
+    "WM_LOCALE_NAME", "SM_CLIENT_ID", "_MOTIF_WM_HINTS",
+    "_NET_SUPPORTED", "_NET_SUPPORTING_WM_CHECK", "_NET_ACTIVE_WINDOW",
+    "_NET_CLIENT_LIST", "_NET_CLIENT_LIST_STACKING",
+    "_NET_CURRENT_DESKTOP", "_NET_NUMBER_OF_DESKTOPS",
+    "_NET_DESKTOP_NAMES", "_NET_DESKTOP_VIEWPORT", "_NET_WORKAREA",
+    "_NET_FRAME_EXTENTS", "_NET_REQUEST_FRAME_EXTENTS", "_NET_WM_NAME",
+    "_NET_WM_ICON_NAME", "_NET_WM_VISIBLE_NAME", "_NET_WM_ICON",
+    "_NET_WM_PID", "_NET_WM_PING", "_NET_WM_SYNC_REQUEST",
+    "_NET_WM_SYNC_REQUEST_COUNTER", "_NET_WM_USER_TIME",
+    "_NET_WM_USER_TIME_WINDOW", "_NET_WM_DESKTOP", "_NET_WM_STATE",
+    "_NET_WM_STATE_ABOVE", "_NET_WM_STATE_BELOW",
+    "_NET_WM_STATE_FULLSCREEN", "_NET_WM_STATE_HIDDEN",
+    "_NET_WM_STATE_MAXIMIZED_VERT", "_NET_WM_STATE_MAXIMIZED_HORZ",
+    "_NET_WM_STATE_MODAL", "_NET_WM_STATE_SKIP_PAGER",
+    "_NET_WM_STATE_SKIP_TASKBAR", "_NET_WM_STATE_STAYS_ON_TOP",
+    "_NET_WM_STATE_STICKY", "_NET_WM_STATE_DEMANDS_ATTENTION",
+    "_NET_WM_STATE_FOCUSED", "_NET_WM_WINDOW_TYPE",
+    "_NET_WM_WINDOW_TYPE_NORMAL", "_NET_WM_WINDOW_TYPE_DIALOG",
+    "_NET_WM_WINDOW_TYPE_UTILITY", "_NET_WM_WINDOW_TYPE_TOOLBAR",
+    "_NET_WM_WINDOW_TYPE_SPLASH", "_NET_WM_WINDOW_TYPE_MENU",
+    "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", "_NET_WM_WINDOW_TYPE_POPUP_MENU",
+    "_NET_WM_WINDOW_TYPE_TOOLTIP", "_NET_WM_WINDOW_TYPE_NOTIFICATION",
+    "_NET_WM_WINDOW_TYPE_COMBO", "_NET_WM_WINDOW_TYPE_DND",
+    "_NET_WM_WINDOW_TYPE_DOCK", "_NET_WM_WINDOW_TYPE_DESKTOP",
+    "_NET_WM_WINDOW_OPACITY", "_NET_WM_BYPASS_COMPOSITOR",
+    "_NET_WM_OPAQUE_REGION", "_NET_WM_CM_S0", "_NET_WM_MOVERESIZE",
+    "_NET_MOVERESIZE_WINDOW", "_NET_CLOSE_WINDOW", "_NET_RESTACK_WINDOW",
+    "_NET_STARTUP_ID", "_NET_STARTUP_INFO", "_NET_STARTUP_INFO_BEGIN",
+    "_NET_SYSTEM_TRAY_S0", "_NET_SYSTEM_TRAY_OPCODE",
+    "_NET_SYSTEM_TRAY_ORIENTATION", "_NET_SYSTEM_TRAY_VISUAL",
+    "_XEMBED", "_XEMBED_INFO", "_XSETTINGS_S0", "_XSETTINGS_SETTINGS",
+    "_GTK_FRAME_EXTENTS", "_GTK_SHOW_WINDOW_MENU", "_GTK_EDGE_CONSTRAINTS",
+    "_GTK_THEME_VARIANT", "_GTK_APPLICATION_ID", "_GTK_WORKAREAS_D0",
+    "_GTK_HIDE_TITLEBAR_WHEN_MAXIMIZED", "_KDE_NET_WM_FRAME_STRUT",
+    "_KDE_NET_WM_WINDOW_TYPE_OVERRIDE", "_QT_SELECTION",
+    "_QT_CLIPBOARD_SENTINEL", "_QT_SELECTION_SENTINEL",
+    "_QT_INPUT_ENCODING", "_XKB_RULES_NAMES", "XdndAware", "XdndEnter",
+    "XdndPosition", "XdndStatus", "XdndLeave", "XdndDrop", "XdndFinished",
+    "XdndSelection", "XdndTypeList", "XdndActionCopy", "XdndActionMove",
+    "XdndActionLink", "XdndActionAsk", "XdndActionPrivate",
+    "XdndActionList", "XdndProxy", "RESOURCE_MANAGER", "_XIM_SERVERS",
+    "_XIM_PROTOCOL", "_XIM_XCONNECT", "_XIM_MOREDATA",
+    "Abs X", "Abs Y", "Rel X", "Rel Y", "Rel Horiz Wheel",
+    "Rel Vert Wheel", "Button Left", "Button Middle", "Button Right",
+    "Button Wheel Up", "Button Wheel Down", "EDID", "Backlight",
+    "_ICC_PROFILE", "_XROOTPMAP_ID", "ESETROOT_PMAP_ID",
+};
+
+static void
+atom_predefined(void)
+{
+    Atom a;
+
+    assert(!strcmp(NameForAtom(XA_PRIMARY), "PRIMARY"));
+    assert(!strcmp(NameForAtom(XA_WM_TRANSIENT_FOR), "WM_TRANSIENT_FOR"));
+    assert(!NameForAtom(None));
+    assert(!NameForAtom(XA_LAST_PREDEFINED + 1));
+
+    for (a = 1; a <= XA_LAST_PREDEFINED; a++) {
+        const char *name = NameForAtom(a);
+
+        assert(name);
+        assert(MakeAtom(name, strlen(name), FALSE) == a);
+        assert(MakeAtom(name, strlen(name), TRUE) == a);
+    }
+}
+
+static void
+atom_make(void)
+{
+    const char *name = "_NET_WM_STATE_FULLSCREEN";
+    Atom a, b;
+    int i;
+
+    assert(MakeAtom(name, strlen(name), FALSE) == None);
+    a = MakeAtom(name, strlen(name), TRUE);
+    assert(a == XA_LAST_PREDEFINED + 1);
+    assert(ValidAtom(a));
+    assert(!ValidAtom(a + 1));
+    assert(!strcmp(NameForAtom(a), name));
+    assert(NameForAtom(a) != name);
+    assert(MakeAtom(name, strlen(name), FALSE) == a);
+
+    /* Prefixes are different atoms */
+    b = MakeAtom(name, strlen("_NET_WM_STATE"), TRUE);
+    assert(b != a);
+    assert(!strcmp(NameForAtom(b), "_NET_WM_STATE"));
+
+    /* Enough atoms to grow every table */
+    for (i = 0; i < 10000; i++) {
+        char buf[32];
+
+        snprintf(buf, sizeof(buf), "ATOM_%d", i);
+        assert(MakeAtom(buf, strlen(buf), TRUE) == b + 1 + i);
+    }
+    for (i = 0; i < 10000; i++) {
+        char buf[32];
+
+        snprintf(buf, sizeof(buf), "ATOM_%d", i);
+        assert(MakeAtom(buf, strlen(buf), FALSE) == b + 1 + i);
+        assert(!strcmp(NameForAtom(b + 1 + i), buf));
+    }
+    assert(MakeAtom(name, strlen(name), FALSE) == a);
+}
+
+int
+atom_test(void)
+{
+    InitAtoms();
+    atom_predefined();
+    atom_make();
+    FreeAllAtoms();
+
+    return 0;
+}
+
+/*
+ * The fingerprint tree atom.c used before, as a baseline for the
+ * benchmark.
+ */
+typedef struct _RefNode {
+    struct _RefNode *left, *right;
+    Atom a;
+    unsigned int fingerPrint;
+    const char *string;
+} RefNodeRec, *RefNodePtr;
+
+static RefNodePtr ref_root;
+static Atom ref_last;
+
+static Atom
+ref_make_atom(const char *string, unsigned len)
+{
+    RefNodePtr *np = &ref_root, nd;
+    unsigned int fp = 0;
+    unsigned i;
+    int comp;
+
+    for (i = 0; i < (len + 1) / 2; i++) {
+        fp = fp * 27 + string[i];
+        fp = fp * 27 + string[len - 1 - i];
+    }
+    while (*np != NULL) {
+        if (fp < (*np)->fingerPrint)
+            np = &((*np)->left);
+        else if (fp > (*np)->fingerPrint)
+            np = &((*np)->right);
+        else {
+            comp = strncmp(string, (*np)->string, (int) len);
+            if ((comp < 0) || ((comp == 0) && (len < strlen((*np)->string))))
+                np = &((*np)->left);
+            else if (comp > 0)
+                np = &((*np)->right);
+            else
+                return (*np)->a;
+        }
+    }
+    nd = malloc(sizeof(RefNodeRec));
+    nd->string = strndup(string, len);
+    nd->left = nd->right = NULL;
+    nd->fingerPrint = fp;
+    nd->a = ++ref_last;
+    *np = nd;
+    return nd->a;
+}
+
+static void
+ref_free(RefNodePtr node)
+{
+    if (!node)
+        return;
+    ref_free(node->left);
+    ref_free(node->right);
+    free((char *) node->string);
+    free(node);
+}
+
+/**
+ * Interns the predefined and the toolkit atoms the way every starting
+ * client does, first with the hash table and then with the tree atom.c
+ * used before.  This only reports numbers, it does not fail on them.
+ */
+int
+atom_bench(void)
+{
+    const char *names[XA_LAST_PREDEFINED + ARRAY_SIZE(toolkit_atoms)];
+    unsigned lens[ARRAY_SIZE(names)];
+    int n = 0, i, j;
+    CARD64 start, end;
+
+    InitAtoms();
+    for (i = 1; i <= XA_LAST_PREDEFINED; i++)
+        names[n++] = NameForAtom(i);
+    for (i = 0; i < ARRAY_SIZE(toolkit_atoms); i++)
+        names[n++] = toolkit_atoms[i];
+    for (i = 0; i < n; i++)
+        lens[i] = strlen(names[i]);
+
+    start = GetTimeInMicros();
+    for (j = 0; j < BENCH_CLIENTS; j++)
+        for (i = 0; i < n; i++)
+            MakeAtom(names[i], lens[i], TRUE);
+    end = GetTimeInMicros();
+    printf("  hash table:       %6.1f ns/atom\n",
+           (end - start) * 1000.0 / (BENCH_CLIENTS * n));
+
+    for (i = 0; i < n; i++)
+        ref_make_atom(names[i], lens[i]);
+    start = GetTimeInMicros();
+    for (j = 0; j < BENCH_CLIENTS; j++)
+        for (i = 0; i < n; i++)
+            ref_make_atom(names[i], lens[i]);
+    end = GetTimeInMicros();
+    printf("  fingerprint tree: %6.1f ns/atom\n",
+           (end - start) * 1000.0 / (BENCH_CLIENTS * n));
+    ref_free(ref_root);
+    FreeAllAtoms();
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <string.h>
+#include "tests.h"
+#include "tests-common.h"
+
+/*
+ * Benchmarks of the dix data structures against the ones they replaced.
+ * They only report numbers, they do not fail on them.  With arguments,
+ * only the benchmarks named there are run.
+ */
+
+static int bench_argc;
+static char **bench_argv;
+
+static int
+want_bench(const char *name)
+{
+    int i;
+
+    if (bench_argc < 2)
+        return 1;
+    for (i = 1; i < bench_argc; i++)
+        if (!strcmp(bench_argv[i], name))
+            return 1;
+    return 0;
+}
+
+#define run_bench(func) \
+    do { \
+        if (want_bench(#func)) \
+            run_test(func); \
+    } while (0)
+
+int
+main(int argc, char **argv)
+{
+    bench_argc = argc;
+    bench_argv = argv;
+
+    run_bench(atom_bench);
+    run_bench(property_bench);
+    run_bench(resource_bench);
+    run_bench(spritetrace_bench);
+
+    return 0;
+}
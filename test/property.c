@@ -0,0 +1,242 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <X11/Xatom.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "misc.h"
+#include "os.h"
+#include "dix.h"
+#include "dixstruct.h"
+#include "scrnintstr.h"
+#include "windowstr.h"
+#include "propertyst.h"
+
+#include "tests-common.h"
+
+#define NUM_PROPS       200
+#define BENCH_PROPS     150
+#define BENCH_ROUNDS    2000
+
+static ScreenRec screen;
+static ClientRec server_client;
+static WindowRec root;
+static WindowOptRec optional;
+static Atom atoms[NUM_PROPS];
+
+static void
+property_init(void)
+{
+    int i;
+
+    root.drawable.id = 0xab;
+    root.drawable.pScreen = &screen;
+    root.optional = &optional;
+    screen.root = &root;
+    dixResetPrivates();
+    serverClient = &server_client;
+    InitClient(serverClient, 0, (void *) NULL);
+    InitAtoms();
+
+    for (i = 0; i < NUM_PROPS; i++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "_TEST_PROPERTY_%d", i);
+        atoms[i] = MakeAtom(name, strlen(name), TRUE);
+    }
+}
+
+static void
+change(int i, CARD32 value, int mode)
+{
+    int rc;
+
+    rc = dixChangeWindowProperty(serverClient, &root, atoms[i], XA_CARDINAL,
+                                 32, mode, 1, &value, FALSE);
+    assert(rc == Success);
+}
+
+static PropertyPtr
+lookup(int i)
+{
+    PropertyPtr pProp;
+    int rc;
+
+    rc = dixLookupProperty(&pProp, &root, atoms[i], serverClient,
+                           DixReadAccess);
+    assert(rc == Success || rc == BadMatch);
+    assert((rc == Success) == (pProp != NULL));
+    return pProp;
+}
+
+/**
+ * The list is in the opposite order the properties were created in, as
+ * ListProperties returns them, whether the window is indexed or not.
+ */
+static void
+check_list(int n, int step)
+{
+    PropertyPtr pProp = wUserProps(&root);
+    int i;
+
+    for (i = n - 1; i >= 0; i--) {
+        if (step && i % step == 0)
+            continue;
+        assert(pProp && pProp->propertyName == atoms[i]);
+        pProp = pProp->next;
+    }
+    assert(!pProp);
+}
+
+static void
+property_many(void)
+{
+    PropertyPtr pProp;
+    int i;
+
+    for (i = 0; i < NUM_PROPS; i++) {
+        change(i, i, PropModeReplace);
+        check_list(i + 1, 0);
+    }
+    assert(optional.propIndex);
+
+    for (i = 0; i < NUM_PROPS; i++) {
+        pProp = lookup(i);
+        assert(pProp->propertyName == atoms[i]);
+        assert(*(CARD32 *) pProp->data == i);
+    }
+
+    /* Changing a property keeps it where it is */
+    change(0, 1000, PropModeReplace);
+    change(1, 1001, PropModeAppend);
+    assert(*(CARD32 *) lookup(0)->data == 1000);
+    pProp = lookup(1);
+    assert(pProp->size == 2);
+    assert(((CARD32 *) pProp->data)[1] == 1001);
+    check_list(NUM_PROPS, 0);
+
+    for (i = 0; i < NUM_PROPS; i += 3)
+        assert(DeleteProperty(serverClient, &root, atoms[i]) == Success);
+    for (i = 0; i < NUM_PROPS; i++) {
+        pProp = lookup(i);
+        if (i % 3 == 0)
+            assert(!pProp);
+        else
+            assert(pProp && pProp->propertyName == atoms[i]);
+    }
+    check_list(NUM_PROPS, 3);
+
+    /* Deleting a property that does not exist succeeds */
+    assert(DeleteProperty(serverClient, &root, atoms[0]) == Success);
+
+    for (i = 0; i < NUM_PROPS; i += 3)
+        change(i, i, PropModeReplace);
+    for (i = 0; i < NUM_PROPS; i++)
+        assert(lookup(i)->propertyName == atoms[i]);
+
+    for (i = 0; i < NUM_PROPS; i++)
+        assert(DeleteProperty(serverClient, &root, atoms[i]) == Success);
+    assert(!wUserProps(&root));
+    assert(!optional.propIndex);
+    assert(!lookup(0));
+
+    change(0, 0, PropModeReplace);
+    DeleteAllWindowProperties(&root);
+    assert(!wUserProps(&root));
+    assert(!optional.propIndex);
+}
+
+int
+property_test(void)
+{
+    property_init();
+    property_many();
+
+    return 0;
+}
+
+/* Finding a property the way dixLookupProperty did before the index */
+static PropertyPtr
+ref_lookup(Atom name)
+{
+    PropertyPtr pProp;
+
+    for (pProp = wUserProps(&root); pProp; pProp = pProp->next)
+        if (pProp->propertyName == name)
+            break;
+    return pProp;
+}
+
+/**
+ * Gets and changes the properties of a root window with as many
+ * properties as a desktop session puts there, in a scattered order.
+ * This only reports numbers, it does not fail on them.
+ */
+int
+property_bench(void)
+{
+    const int n = BENCH_PROPS;
+    PropertyPtr sink = NULL;
+    CARD64 start, end;
+    int i, j;
+
+    property_init();
+    for (i = 0; i < n; i++)
+        change(i, i, PropModeReplace);
+
+    printf("root window, %d properties:\n", n);
+
+    start = GetTimeInMicros();
+    for (j = 0; j < BENCH_ROUNDS; j++)
+        for (i = 0; i < n; i++)
+            sink = lookup(i * 37 % n);
+    end = GetTimeInMicros();
+    printf("  get, indexed:    %6.1f ns/op\n",
+           (end - start) * 1000.0 / (BENCH_ROUNDS * n));
+    assert(sink->propertyName == atoms[(n - 1) * 37 % n]);
+
+    start = GetTimeInMicros();
+    for (j = 0; j < BENCH_ROUNDS; j++)
+        for (i = 0; i < n; i++)
+            sink = ref_lookup(atoms[i * 37 % n]);
+    end = GetTimeInMicros();
+    printf("  get, list walk:  %6.1f ns/op\n",
+           (end - start) * 1000.0 / (BENCH_ROUNDS * n));
+    assert(sink->propertyName == atoms[(n - 1) * 37 % n]);
+
+    start = GetTimeInMicros();
+    for (j = 0; j < BENCH_ROUNDS; j++)
+        for (i = 0; i < n; i++)
+            change(i * 37 % n, j, PropModeReplace);
+    end = GetTimeInMicros();
+    printf("  change, indexed: %6.1f ns/op\n",
+           (end - start) * 1000.0 / (BENCH_ROUNDS * n));
+
+    DeleteAllWindowProperties(&root);
+
+    return 0;
+}
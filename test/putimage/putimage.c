@@ -0,0 +1,175 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * PutImage throughput, for square images from 16x16 up to the size of
+ * the screen, drawn into a window (or with -p, a pixmap).  Each size is
+ * drawn for about a second, and the images and megapixels per second
+ * are printed.  The putimage-fb benchmark runs it against Xvfb, which
+ * only has fb, and putimage-glamor against a Xephyr using glamor.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+sync_server(xcb_connection_t *c)
+{
+    free(xcb_get_input_focus_reply(c, xcb_get_input_focus(c), NULL));
+}
+
+static int
+bits_per_pixel(const xcb_setup_t *setup, uint8_t depth)
+{
+    xcb_format_iterator_t f = xcb_setup_pixmap_formats_iterator(setup);
+
+    for (; f.rem; xcb_format_next(&f))
+        if (f.data->depth == depth)
+            return f.data->bits_per_pixel;
+    return 0;
+}
+
+/* Sends a size x size image, in bands that fit in a request */
+static void
+put_image(xcb_connection_t *c, xcb_drawable_t drawable, xcb_gcontext_t gc,
+          uint8_t depth, int size, int stride, int band, const uint8_t *data)
+{
+    int y, h;
+
+    for (y = 0; y < size; y += band) {
+        h = size - y < band ? size - y : band;
+        xcb_put_image(c, XCB_IMAGE_FORMAT_Z_PIXMAP, drawable, gc,
+                      size, h, 0, y, 0, depth,
+                      h * stride, data + y * stride);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int sizes[] = { 16, 32, 64, 128, 256, 512, 1024 };
+    const int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    xcb_connection_t *c;
+    const xcb_setup_t *setup;
+    xcb_screen_t *screen;
+    xcb_drawable_t drawable;
+    xcb_gcontext_t gc;
+    uint8_t *data;
+    int use_pixmap = 0;
+    int max_size, bpp, stride, band, i, n, size;
+    size_t max_request;
+    double start, elapsed;
+
+    if (argc > 1 && strcmp(argv[1], "-p") == 0)
+        use_pixmap = 1;
+
+    c = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(c)) {
+        fprintf(stderr, "cannot open display\n");
+        return 1;
+    }
+    setup = xcb_get_setup(c);
+    screen = xcb_setup_roots_iterator(setup).data;
+
+    bpp = bits_per_pixel(setup, screen->root_depth);
+    if (bpp < 8) {
+        fprintf(stderr, "unsupported depth %d\n", screen->root_depth);
+        return 1;
+    }
+
+    max_size = screen->width_in_pixels < screen->height_in_pixels ?
+        screen->width_in_pixels : screen->height_in_pixels;
+    max_request = (size_t) xcb_get_maximum_request_length(c) * 4 -
+        sizeof(xcb_put_image_request_t);
+
+    data = malloc((size_t) max_size * max_size * (bpp / 8));
+    if (!data)
+        return 1;
+    for (i = 0; i < max_size * max_size * (bpp / 8); i++)
+        data[i] = i * 7;
+
+    drawable = xcb_generate_id(c);
+    if (use_pixmap) {
+        xcb_create_pixmap(c, screen->root_depth, drawable, screen->root,
+                          max_size, max_size);
+    } else {
+        uint32_t override = 1;
+
+        xcb_create_window(c, screen->root_depth, drawable, screen->root,
+                          0, 0, max_size, max_size, 0,
+                          XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual,
+                          XCB_CW_OVERRIDE_REDIRECT, &override);
+        xcb_map_window(c, drawable);
+    }
+    gc = xcb_generate_id(c);
+    xcb_create_gc(c, gc, drawable, 0, NULL);
+    sync_server(c);
+
+    printf("%-10s %12s %12s\n", "size", "images/s", "MPix/s");
+
+    /* The listed sizes that fit, then the full screen */
+    for (i = 0; i <= nsizes; i++) {
+        size = i < nsizes ? sizes[i] : max_size;
+        if (size > max_size || (i == nsizes && size == sizes[nsizes - 1]))
+            continue;
+
+        stride = ((size * bpp + 31) / 32) * 4;
+        band = max_request / stride;
+
+        /* Warm up, then draw for about a second */
+        put_image(c, drawable, gc, screen->root_depth, size, stride, band,
+                  data);
+        sync_server(c);
+
+        n = 0;
+        start = now();
+        do {
+            int j;
+
+            for (j = 0; j < 16; j++)
+                put_image(c, drawable, gc, screen->root_depth, size, stride,
+                          band, data);
+            sync_server(c);
+            n += 16;
+            elapsed = now() - start;
+        } while (elapsed < 1.0);
+
+        printf("%4dx%-5d %12.1f %12.1f\n", size, size, n / elapsed,
+               (double) n * size * size / elapsed / 1e6);
+    }
+
+    free(data);
+    xcb_disconnect(c);
+    return 0;
+}
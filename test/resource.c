@@ -0,0 +1,452 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "misc.h"
+#include "os.h"
+#include "resource.h"
+#include "dixstruct.h"
+#include "opaque.h"
+
+#include "tests-common.h"
+
+#define BENCH_RESOURCES 50000
+#define BENCH_LOOKUPS   10
+
+static RESTYPE type_a, type_b;
+static ClientRec server_client, test_client;
+
+static int num_freed;
+static intptr_t freed[8];
+
+static int
+test_delete(void *value, XID id)
+{
+    if (num_freed < (int) ARRAY_SIZE(freed))
+        freed[num_freed] = (intptr_t) value;
+    num_freed++;
+    return Success;
+}
+
+static XID
+test_id(int i)
+{
+    return test_client.clientAsMask | i;
+}
+
+static void *
+test_lookup(XID id, RESTYPE type)
+{
+    void *value;
+    int rc;
+
+    rc = dixLookupResourceByType(&value, id, type, NULL, DixReadAccess);
+    assert(rc == Success || value == NULL);
+    return value;
+}
+
+static void
+count_resource(void *value, XID id, void *cdata)
+{
+    int *count = cdata;
+
+    (*count)++;
+}
+
+static void
+free_next_resource(void *value, XID id, void *cdata)
+{
+    int *count = cdata;
+
+    (*count)++;
+    FreeResource(id + 1, RT_NONE);
+}
+
+static void
+add_resource(void *value, XID id, void *cdata)
+{
+    int *count = cdata;
+
+    assert(AddResource(test_id(100000 + *count), type_b, (void *) 3));
+    (*count)++;
+}
+
+static void
+resource_init(void)
+{
+    dixResetPrivates();
+    serverClient = &server_client;
+    InitClient(serverClient, 0, (void *) NULL);
+    if (!InitClientResources(serverClient))
+        FatalError("couldn't init server resources");
+
+    InitClient(&test_client, 1, (void *) NULL);
+    if (!InitClientResources(&test_client))
+        FatalError("couldn't init client resources");
+    clients[0] = serverClient;
+    clients[1] = &test_client;
+
+    type_a = CreateNewResourceType(test_delete, "TestA");
+    type_b = CreateNewResourceType(test_delete, "TestB");
+    assert(type_a && type_b);
+}
+
+static void
+resource_add_lookup(void)
+{
+    const int n = 5000;
+    int i, count;
+
+    for (i = 0; i < n; i++)
+        assert(AddResource(test_id(i), type_a, (void *) (intptr_t) (i + 1)));
+
+    for (i = 0; i < n; i++)
+        assert(test_lookup(test_id(i), type_a) == (void *) (intptr_t) (i + 1));
+    assert(!test_lookup(test_id(n), type_a));
+    assert(!test_lookup(test_id(0), type_b));
+
+    num_freed = 0;
+    for (i = 0; i < n; i += 2)
+        FreeResource(test_id(i), RT_NONE);
+    assert(num_freed == n / 2);
+
+    for (i = 0; i < n; i++) {
+        void *value = test_lookup(test_id(i), type_a);
+
+        assert(value == ((i & 1) ? (void *) (intptr_t) (i + 1) : NULL));
+    }
+
+    count = 0;
+    FindClientResourcesByType(&test_client, type_a, count_resource, &count);
+    assert(count == n / 2);
+
+    /* The freed slots can be used again */
+    for (i = 0; i < n; i += 2)
+        assert(AddResource(test_id(i), type_a, (void *) (intptr_t) (i + 1)));
+    for (i = 0; i < n; i++)
+        assert(test_lookup(test_id(i), type_a) == (void *) (intptr_t) (i + 1));
+
+    num_freed = 0;
+    FreeClientResources(&test_client);
+    assert(num_freed == n);
+    assert(InitClientResources(&test_client));
+}
+
+/**
+ * Resources sharing an ID are freed together, in the opposite order they
+ * were added.
+ */
+static void
+resource_shared_id(void)
+{
+    XID id = test_id(42);
+
+    assert(AddResource(id, type_a, (void *) 1));
+    assert(AddResource(id, type_b, (void *) 2));
+    assert(test_lookup(id, type_a) == (void *) 1);
+    assert(test_lookup(id, type_b) == (void *) 2);
+
+    num_freed = 0;
+    FreeResourceByType(id, type_a, FALSE);
+    assert(num_freed == 1);
+    assert(!test_lookup(id, type_a));
+    assert(test_lookup(id, type_b) == (void *) 2);
+
+    assert(AddResource(id, type_a, (void *) 3));
+    assert(ChangeResourceValue(id, type_b, (void *) 4));
+    assert(!ChangeResourceValue(test_id(43), type_b, (void *) 4));
+
+    num_freed = 0;
+    FreeResource(id, RT_NONE);
+    assert(num_freed == 2);
+    assert(freed[0] == 3);
+    assert(freed[1] == 4);
+    assert(!test_lookup(id, type_a));
+    assert(!test_lookup(id, type_b));
+}
+
+/**
+ * Resources may be freed by the callback of a walk over the table.
+ */
+static void
+resource_free_while_walking(void)
+{
+    const int n = 1000;
+    int i, count;
+
+    for (i = 0; i < n; i++)
+        assert(AddResource(test_id(2 * i), type_a, (void *) 1));
+    for (i = 0; i < n; i++)
+        assert(AddResource(test_id(2 * i + 1), type_b, (void *) 2));
+
+    count = 0;
+    num_freed = 0;
+    FindClientResourcesByType(&test_client, type_a, free_next_resource,
+                              &count);
+    assert(count >= n);
+    assert(num_freed == n);
+
+    count = 0;
+    FindClientResourcesByType(&test_client, 0, count_resource, &count);
+    assert(count == n);
+
+    num_freed = 0;
+    FreeClientResources(&test_client);
+    assert(num_freed == n);
+    assert(InitClientResources(&test_client));
+}
+
+/**
+ * Resources may be added by the callback of a walk, which visits every
+ * resource once as long as that doesn't fill the table.
+ */
+static void
+resource_add_while_walking(void)
+{
+    const int n = 200;
+    int i, count;
+
+    for (i = 0; i < n; i++)
+        assert(AddResource(test_id(i), type_a, (void *) 1));
+
+    count = 0;
+    FindClientResourcesByType(&test_client, type_a, add_resource, &count);
+    assert(count == n);
+
+    count = 0;
+    FindClientResourcesByType(&test_client, type_b, count_resource, &count);
+    assert(count == n);
+
+    num_freed = 0;
+    FreeClientResources(&test_client);
+    assert(num_freed == 2 * n);
+    assert(InitClientResources(&test_client));
+}
+
+int
+resource_test(void)
+{
+    resource_init();
+    resource_add_lookup();
+    resource_shared_id();
+    resource_free_while_walking();
+    resource_add_while_walking();
+
+    return 0;
+}
+
+/*
+ * The chained hash table resource.c used before, as a baseline for the
+ * benchmark.
+ */
+typedef struct _RefResource {
+    struct _RefResource *next;
+    XID id;
+    RESTYPE type;
+    void *value;
+} RefResourceRec, *RefResourcePtr;
+
+static struct {
+    RefResourcePtr *resources;
+    int elements;
+    int buckets;
+    int hashsize;
+} ref;
+
+static void
+ref_init(void)
+{
+    ref.buckets = 64;
+    ref.hashsize = 6;
+    ref.elements = 0;
+    ref.resources = calloc(ref.buckets, sizeof(RefResourcePtr));
+}
+
+static void
+ref_rebuild(void)
+{
+    RefResourcePtr *resources, res, next;
+    int i;
+
+    resources = calloc(2 * ref.buckets, sizeof(RefResourcePtr));
+    ref.hashsize++;
+    for (i = 0; i < ref.buckets; i++) {
+        for (res = ref.resources[i]; res; res = next) {
+            RefResourcePtr *head =
+                &resources[HashResourceID(res->id, ref.hashsize)];
+
+            next = res->next;
+            res->next = *head;
+            *head = res;
+        }
+    }
+    free(ref.resources);
+    ref.resources = resources;
+    ref.buckets *= 2;
+}
+
+static void
+ref_add(XID id, RESTYPE type, void *value)
+{
+    RefResourcePtr res, *head;
+
+    if (ref.elements >= 4 * ref.buckets && ref.hashsize < 16)
+        ref_rebuild();
+    head = &ref.resources[HashResourceID(id, ref.hashsize)];
+    res = malloc(sizeof(RefResourceRec));
+    res->next = *head;
+    res->id = id;
+    res->type = type;
+    res->value = value;
+    *head = res;
+    ref.elements++;
+}
+
+static void *
+ref_lookup(XID id, RESTYPE type)
+{
+    RefResourcePtr res;
+
+    if (CLIENT_ID(id) >= LimitClients)
+        return NULL;
+
+    res = ref.resources[HashResourceID(id, ref.hashsize)];
+    for (; res; res = res->next)
+        if (res->id == id && res->type == type)
+            return res->value;
+    return NULL;
+}
+
+static void
+ref_free(XID id)
+{
+    RefResourcePtr res, *prev;
+
+    prev = &ref.resources[HashResourceID(id, ref.hashsize)];
+    while ((res = *prev)) {
+        if (res->id == id) {
+            *prev = res->next;
+            ref.elements--;
+            free(res);
+        }
+        else
+            prev = &res->next;
+    }
+}
+
+static void
+bench_report(const char *what, CARD64 start, CARD64 end, int ops)
+{
+    printf("  %-20s %8.1f ns/op\n", what, (end - start) * 1000.0 / ops);
+}
+
+/**
+ * Compares insert, lookup and delete throughput of the resource table
+ * with the chained hash table it replaced.  Resources are created in
+ * XID order, as Xlib allocates them, but looked up and freed in a
+ * scattered order.  The first round of inserts includes growing the
+ * table, the second one is the steady state of a client that keeps
+ * creating and freeing resources.  This only reports numbers, it does
+ * not fail on them.
+ */
+int
+resource_bench(void)
+{
+    const int n = BENCH_RESOURCES;
+    CARD64 t0, t1, t2, t3, t4;
+    XID *ids, *order;
+    int i, j;
+    void *sink = NULL;
+
+    resource_init();
+
+    ids = xallocarray(n, sizeof(XID));
+    order = xallocarray(n, sizeof(XID));
+    assert(ids && order);
+    for (i = 0; i < n; i++)
+        ids[i] = test_id(i + 1);
+    /* n is not a multiple of 7919, so this is a permutation */
+    for (i = 0; i < n; i++)
+        order[i] = ids[(i * 7919) % n];
+
+    t0 = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        AddResource(ids[i], type_a, &ids[i]);
+    t1 = GetTimeInMicros();
+    for (j = 0; j < BENCH_LOOKUPS; j++)
+        for (i = 0; i < n; i++)
+            sink = test_lookup(order[i], type_a);
+    t2 = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        FreeResource(order[i], RT_NONE);
+    t3 = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        AddResource(ids[i], type_a, &ids[i]);
+    t4 = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        FreeResource(order[i], RT_NONE);
+
+    printf("open addressing table, %d resources:\n", n);
+    bench_report("insert", t0, t1, n);
+    bench_report("lookup", t1, t2, n * BENCH_LOOKUPS);
+    bench_report("delete", t2, t3, n);
+    bench_report("insert, table grown", t3, t4, n);
+    assert(sink == &ids[(n - 1) * 7919 % n]);
+
+    ref_init();
+    t0 = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        ref_add(ids[i], type_a, &ids[i]);
+    t1 = GetTimeInMicros();
+    for (j = 0; j < BENCH_LOOKUPS; j++)
+        for (i = 0; i < n; i++)
+            sink = ref_lookup(order[i], type_a);
+    t2 = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        ref_free(order[i]);
+    t3 = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        ref_add(ids[i], type_a, &ids[i]);
+    t4 = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        ref_free(order[i]);
+    free(ref.resources);
+
+    printf("chained hash table, %d resources:\n", n);
+    bench_report("insert", t0, t1, n);
+    bench_report("lookup", t1, t2, n * BENCH_LOOKUPS);
+    bench_report("delete", t2, t3, n);
+    bench_report("insert, table grown", t3, t4, n);
+    assert(sink == &ids[(n - 1) * 7919 % n]);
+
+    free(order);
+    free(ids);
+
+    return 0;
+}
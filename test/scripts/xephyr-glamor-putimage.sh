@@ -0,0 +1,23 @@
+#!/bin/sh
+
+# Runs the PutImage benchmark given as arguments against a Xephyr using
+# glamor.  Since the benchmark environment is headless, we start an Xvfb
+# first to host the Xephyr, and this script runs again inside it to start
+# the Xephyr itself.
+if test "x$1" = "x--nested"; then
+    shift
+    exec $XSERVER_BUILDDIR/test/simple-xinit \
+            "$@" \
+            -- \
+            $XSERVER_BUILDDIR/hw/kdrive/ephyr/Xephyr \
+            -glamor \
+            -glamor-skip-present \
+            -noreset \
+            -screen 1280x1024
+fi
+
+exec $XSERVER_BUILDDIR/test/simple-xinit \
+        "$0" --nested "$@" \
+        -- \
+        $XSERVER_BUILDDIR/hw/vfb/Xvfb \
+        -screen scrn 1280x1024x24
@@ -0,0 +1,310 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "os.h"
+#include "scrnintstr.h"
+#include "windowstr.h"
+#include "inputstr.h"
+#include "mi.h"
+
+#include "tests-common.h"
+
+#define SCREEN_WIDTH    1920
+#define SCREEN_HEIGHT   1080
+#define NUM_TOPLEVELS   1000
+#define NUM_CHILDREN    4
+#define BENCH_TRACES    200000
+
+static ScreenRec screen;
+static WindowRec root;
+static WindowRec toplevels[NUM_TOPLEVELS];
+static WindowRec children[NUM_TOPLEVELS][NUM_CHILDREN];
+static WindowOptRec shaped_optional;
+static RegionRec empty_region;
+static SpriteRec sprite, ref_sprite;
+
+static unsigned int seed = 1;
+
+static int
+rnd(int n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static void
+init_window(WindowPtr pWin, WindowPtr pParent, int x, int y, int w, int h)
+{
+    pWin->drawable.pScreen = &screen;
+    pWin->drawable.x = pParent->drawable.x + x;
+    pWin->drawable.y = pParent->drawable.y + y;
+    pWin->drawable.width = w;
+    pWin->drawable.height = h;
+    pWin->parent = pParent;
+    pWin->mapped = TRUE;
+    pWin->realized = pParent->realized;
+
+    /* Added at the bottom of the stack */
+    pWin->prevSib = pParent->lastChild;
+    if (pParent->lastChild)
+        pParent->lastChild->nextSib = pWin;
+    else
+        pParent->firstChild = pWin;
+    pParent->lastChild = pWin;
+}
+
+/**
+ * A desktop of small and large top level windows, some of them with
+ * children, borders or no input, some unmapped.
+ */
+static void
+spritetrace_init(void)
+{
+    int i, j;
+
+    dixResetPrivates();
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+    screen.myNum = 0;
+    screen.root = &root;
+    assert(miSpriteIndexInit(&screen));
+
+    root.drawable.pScreen = &screen;
+    root.drawable.width = SCREEN_WIDTH;
+    root.drawable.height = SCREEN_HEIGHT;
+    root.mapped = root.realized = TRUE;
+
+    RegionNull(&empty_region);
+    shaped_optional.inputShape = &empty_region;
+
+    for (i = 0; i < NUM_TOPLEVELS; i++) {
+        WindowPtr pWin = &toplevels[i];
+        int w = i % 10 ? 20 + rnd(300) : 200 + rnd(1200);
+        int h = i % 10 ? 10 + rnd(200) : 200 + rnd(800);
+
+        init_window(pWin, &root, rnd(SCREEN_WIDTH + 100) - 100,
+                    rnd(SCREEN_HEIGHT + 100) - 100, w, h);
+        pWin->borderWidth = i % 3;
+        pWin->mapped = i % 7 != 0;
+        if (i % 50 == 1)
+            pWin->optional = &shaped_optional;
+        if (i % 5 == 0) {
+            for (j = 0; j < NUM_CHILDREN; j++)
+                init_window(&children[i][j], pWin, rnd(w), rnd(h),
+                            1 + rnd(w / 2), 1 + rnd(h / 2));
+        }
+    }
+}
+
+/* miSpriteTrace as it was, walking all children */
+static Bool
+ref_hit(WindowPtr pWin, int x, int y)
+{
+    BoxRec box;
+
+    return pWin->mapped &&
+        x >= pWin->drawable.x - wBorderWidth(pWin) &&
+        x < pWin->drawable.x + (int) pWin->drawable.width +
+        wBorderWidth(pWin) &&
+        y >= pWin->drawable.y - wBorderWidth(pWin) &&
+        y < pWin->drawable.y + (int) pWin->drawable.height +
+        wBorderWidth(pWin) &&
+        (!wInputShape(pWin) ||
+         RegionContainsPoint(wInputShape(pWin), x - pWin->drawable.x,
+                             y - pWin->drawable.y, &box)) &&
+        !pWin->unhittable;
+}
+
+static WindowPtr
+ref_trace(SpritePtr pSprite, int x, int y)
+{
+    WindowPtr pWin;
+
+    pSprite->spriteTraceGood = 1;
+    pWin = root.firstChild;
+    while (pWin) {
+        if (ref_hit(pWin, x, y)) {
+            pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
+            pWin = pWin->firstChild;
+        }
+        else
+            pWin = pWin->nextSib;
+    }
+    return DeepestSpriteWin(pSprite);
+}
+
+static void
+init_sprite(SpritePtr pSprite)
+{
+    pSprite->spriteTraceSize = 10;
+    pSprite->spriteTrace = calloc(pSprite->spriteTraceSize,
+                                  sizeof(WindowPtr));
+    pSprite->spriteTrace[0] = &root;
+    pSprite->spriteTraceGood = 1;
+}
+
+static void
+check_trace(int x, int y)
+{
+    WindowPtr pWin, pRef;
+
+    pWin = miXYToWindow(&screen, &sprite, x, y);
+    pRef = ref_trace(&ref_sprite, x, y);
+    assert(pWin == pRef);
+    assert(sprite.spriteTraceGood == ref_sprite.spriteTraceGood);
+    assert(!memcmp(sprite.spriteTrace, ref_sprite.spriteTrace,
+                   sprite.spriteTraceGood * sizeof(WindowPtr)));
+}
+
+static void
+check_screen(void)
+{
+    int x, y;
+
+    for (y = -3; y < SCREEN_HEIGHT + 3; y += 7)
+        for (x = -3; x < SCREEN_WIDTH + 3; x += 5)
+            check_trace(x, y);
+}
+
+/* Moves a window to the top of the stack */
+static void
+raise_window(WindowPtr pWin)
+{
+    if (!pWin->prevSib)
+        return;
+    pWin->prevSib->nextSib = pWin->nextSib;
+    if (pWin->nextSib)
+        pWin->nextSib->prevSib = pWin->prevSib;
+    else
+        root.lastChild = pWin->prevSib;
+    pWin->prevSib = NULL;
+    pWin->nextSib = root.firstChild;
+    root.firstChild->prevSib = pWin;
+    root.firstChild = pWin;
+}
+
+/**
+ * The trace is the same as walking every child, whatever happens to the
+ * windows, as long as the root window is validated after each change.
+ */
+static void
+spritetrace_same(void)
+{
+    int i;
+
+    init_sprite(&sprite);
+    init_sprite(&ref_sprite);
+
+    check_screen();
+
+    for (i = 0; i < 20; i++) {
+        WindowPtr pWin = &toplevels[rnd(NUM_TOPLEVELS)];
+
+        switch (i % 4) {
+        case 0:
+            pWin->drawable.x = rnd(SCREEN_WIDTH);
+            pWin->drawable.y = rnd(SCREEN_HEIGHT);
+            break;
+        case 1:
+            pWin->mapped = !pWin->mapped;
+            break;
+        case 2:
+            raise_window(pWin);
+            break;
+        case 3:
+            pWin->drawable.width = 1 + rnd(SCREEN_WIDTH);
+            pWin->borderWidth = rnd(20);
+            break;
+        }
+        miSpriteIndexInvalidate(&root);
+        check_screen();
+    }
+
+    /* Rootless windows can be unhittable without the tree changing */
+    toplevels[1].unhittable = TRUE;
+    check_screen();
+    toplevels[1].unhittable = FALSE;
+}
+
+int
+spritetrace_test(void)
+{
+    spritetrace_init();
+    spritetrace_same();
+    free(sprite.spriteTrace);
+    free(ref_sprite.spriteTrace);
+    (*screen.CloseScreen) (&screen);
+
+    return 0;
+}
+
+/**
+ * Moves the sprite around a desktop with a thousand top level windows,
+ * tracing it the way every pointer motion does.  This only reports
+ * numbers, it does not fail on them.
+ */
+int
+spritetrace_bench(void)
+{
+    CARD64 start, end;
+    int i, x = 0, y = 0;
+
+    spritetrace_init();
+    init_sprite(&sprite);
+    init_sprite(&ref_sprite);
+
+    start = GetTimeInMicros();
+    for (i = 0; i < BENCH_TRACES; i++) {
+        x = (x + 7) % SCREEN_WIDTH;
+        y = (y + 3) % SCREEN_HEIGHT;
+        miXYToWindow(&screen, &sprite, x, y);
+    }
+    end = GetTimeInMicros();
+    printf("%d top level windows:\n", NUM_TOPLEVELS);
+    printf("  grid:        %6.1f ns/trace\n",
+           (end - start) * 1000.0 / BENCH_TRACES);
+
+    start = GetTimeInMicros();
+    for (i = 0; i < BENCH_TRACES; i++) {
+        x = (x + 7) % SCREEN_WIDTH;
+        y = (y + 3) % SCREEN_HEIGHT;
+        ref_trace(&ref_sprite, x, y);
+    }
+    end = GetTimeInMicros();
+    printf("  window walk: %6.1f ns/trace\n",
+           (end - start) * 1000.0 / BENCH_TRACES);
+
+    free(sprite.spriteTrace);
+    free(ref_sprite.spriteTrace);
+    (*screen.CloseScreen) (&screen);
+
+    return 0;
+}
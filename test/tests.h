@@ -1,18 +1,27 @@
 #ifndef TESTS_H
 #define TESTS_H
 
+int atom_test(void);
 int fixes_test(void);
 int hashtabletest_test(void);
 int input_test(void);
 int list_test(void);
 int misc_test(void);
+int property_test(void);
+int resource_test(void);
 int signal_logging_test(void);
+int spritetrace_test(void);
 int string_test(void);
 int touch_test(void);
 int xfree86_test(void);
 int xkb_test(void);
 int xtest_test(void);
 
+int atom_bench(void);
+int property_bench(void);
+int resource_bench(void);
+int spritetrace_bench(void);
+
 int protocol_xchangedevicecontrol_test(void);
 
 int protocol_xiqueryversion_test(void);
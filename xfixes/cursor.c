@@ -409,9 +409,9 @@ ProcXFixesGetCursorImage(ClientPtr client)
         swapl(&rep->cursorSerial);
         SwapLongs(image, npixels);
     }
-    WriteToClient(client,
-                  sizeof(xXFixesGetCursorImageReply) + (npixels << 2), rep);
-    free(rep);
+    WriteBufferToClient(client,
+                        sizeof(xXFixesGetCursorImageReply) + (npixels << 2),
+                        rep, free, rep);
     return Success;
 }
 
@@ -566,9 +566,8 @@ ProcXFixesGetCursorImageAndName(ClientPtr client)
         swaps(&rep->nbytes);
         SwapLongs(image, npixels);
     }
-    WriteToClient(client, sizeof(xXFixesGetCursorImageAndNameReply) +
-                  (npixels << 2) + nbytesRound, rep);
-    free(rep);
+    WriteBufferToClient(client, sizeof(xXFixesGetCursorImageAndNameReply) +
+                        (npixels << 2) + nbytesRound, rep, free, rep);
     return Success;
 }
 